@@ -57,13 +57,44 @@ For more information, please refer to <http://unlicense.org>
 #include "cpptoml.h"
 
 #include <cassert>
+#include <cerrno>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <algorithm>
+#include <atomic>
 #include <charconv>
+#include <condition_variable>
 #include <iterator>
 #include <limits>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#ifdef __linux__
+#    include <poll.h>
+#    include <sys/eventfd.h>
+#    include <sys/inotify.h>
+#    include <unistd.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define CPPTOML_MMAP
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#    define CPPTOML_X86
+#    ifdef _MSC_VER
+#        include <intrin.h>
+#    endif
+#    include <immintrin.h>
+#endif
 
 #ifdef CPPTOML_DEBUG
 #    define CPPTOML_ASSERT(exp) assert((exp))
@@ -71,149 +102,361 @@ For more information, please refer to <http://unlicense.org>
 #    define CPPTOML_ASSERT(exp)
 #endif
 
+#if defined(_MSC_VER) && !defined(__clang__)
+#    define CPPTOML_TARGET(isa)
+#else
+#    define CPPTOML_TARGET(isa) __attribute__((target(isa)))
+#endif
+
 namespace cpptoml
 {
 namespace
 {
-    bool validate_object(TomlProxy proxy);
-    bool validate_array(TomlProxy proxy);
-    bool validate_keyvalue(TomlProxy proxy);
-    bool validate_string(TomlProxy proxy);
-    bool validate_integer(TomlProxy proxy);
-    bool validate_hex(TomlProxy proxy);
-    bool validate_oct(TomlProxy proxy);
-    bool validate_bin(TomlProxy proxy);
-    bool validate_float(TomlProxy proxy);
-    bool validate_inf(TomlProxy proxy);
-    bool validate_nan(TomlProxy proxy);
-    bool validate_datetime(TomlProxy proxy);
-    bool validate_true(TomlProxy proxy);
-    bool validate_false(TomlProxy proxy);
-
-    bool validate(TomlProxy proxy)
-    {
-        switch(proxy.type()) {
-        case TomlType::Table:
-            return validate_object(proxy);
-        case TomlType::Array:
-            return validate_array(proxy);
-        case TomlType::KeyValue:
-            return validate_keyvalue(proxy);
-        case TomlType::String:
-            return validate_string(proxy);
-        case TomlType::Integer:
-            return validate_integer(proxy);
+    /**
+     * @brief Kind of a value for the homogeneous check of arrays, every integer, float and boolean is one kind
+     */
+    TomlType value_kind(uint32_t type)
+    {
+        switch(static_cast<TomlType>(type)) {
         case TomlType::Hex:
-            return validate_hex(proxy);
         case TomlType::Oct:
-            return validate_oct(proxy);
         case TomlType::Bin:
-            return validate_bin(proxy);
-        case TomlType::Float:
-            return validate_float(proxy);
+            return TomlType::Integer;
         case TomlType::Inf:
-            return validate_inf(proxy);
         case TomlType::NaN:
-            return validate_nan(proxy);
-        case TomlType::DateTime:
-            return validate_datetime(proxy);
-        case TomlType::True:
-            return validate_true(proxy);
+            return TomlType::Float;
         case TomlType::False:
-            return validate_false(proxy);
+            return TomlType::True;
         default:
-            return false;
+            return static_cast<TomlType>(type);
         }
     }
 
-    bool validate_object(TomlProxy proxy)
+    /**
+     * @brief Add a value to the kind of an array, false if the array already has another kind
+     */
+    bool same_kind(TomlType& kind, uint32_t type)
     {
-        for(TomlProxy i = proxy.begin(); i; i = i.next()) {
-            if (!validate(i.value())) {
-                return false;
-            }
+        TomlType value = value_kind(type);
+        if(TomlType::Invalid == kind) {
+            kind = value;
+            return true;
         }
-        return true;
+        return kind == value;
     }
 
-    bool validate_array(TomlProxy proxy)
+    bool validate_array(const TomlValue* values, uint32_t array)
     {
-        TomlType type = TomlType::Invalid;
-        for(TomlProxy i = proxy.begin(); i; i = i.next()) {
-            if(!validate(i)) {
-                return false;
-            }
-            if (TomlType::Invalid == i.type()) {
+        TomlType kind = TomlType::Invalid;
+        for(uint32_t i = static_cast<uint32_t>(values[array].start_); TomlParser::Invalid != i; i = values[i].next_) {
+            TomlType type = value_kind(values[i].type_);
+            if(TomlType::Invalid == type) {
                 return false;
             }
-            if(TomlType::Invalid == type) {
-                type = i.type();
-            } else if(type != i.type()) {
+            if(TomlType::Invalid == kind) {
+                kind = type;
+            } else if(kind != type) {
                 return false;
             }
         }
         return true;
     }
 
-    bool validate_keyvalue(TomlProxy proxy)
+    /**
+     * @brief FNV-1a of a key segment, tells most different segments apart before comparing bytes
+     */
+    uint32_t key_hash(const char* begin, const char* end)
     {
-        return validate(proxy.value());
+        uint32_t hash = 2166136261U;
+        for(; begin < end; ++begin) {
+            hash = (hash ^ static_cast<uint8_t>(*begin)) * 16777619U;
+        }
+        return hash;
     }
 
-    bool validate_string(cpptoml::TomlProxy /*proxy*/)
+    /**
+     * @brief The first line from str which begins with a header, or end
+     * @details A [[header]] shortly after is preferred, a chunk which begins with a sub table of an array
+     * and then continues the array can not be parsed alone.
+     */
+    const char* split_point(const char* str, const char* end)
     {
-        return true;
+        static constexpr uint64_t Window = 64 * 1024;
+        const char* header = CPPTOML_NULL;
+        while(str < end) {
+            const char* line = reinterpret_cast<const char*>(::memchr(str, '\n', static_cast<size_t>(end - str)));
+            if(CPPTOML_NULL == line || end <= (line + 2)) {
+                break;
+            }
+            str = line + 1;
+            if(CPPTOML_NULL != header && Window < static_cast<uint64_t>(str - header)) {
+                break;
+            }
+            if('[' != str[0]) {
+                continue;
+            }
+            if('[' == str[1]) {
+                return str;
+            }
+            if(CPPTOML_NULL == header) {
+                header = str;
+            }
+        }
+        return (CPPTOML_NULL != header) ? header : end;
     }
 
-    bool validate_integer(cpptoml::TomlProxy /*proxy*/)
+    /**
+     * @brief Hash of a section of reparse_incremental, eight bytes at a time
+     */
+    uint64_t text_hash(const char* begin, const char* end)
     {
-        return true;
+        uint64_t hash = 14695981039346656037ULL;
+        for(; 8 <= (end - begin); begin += 8) {
+            uint64_t word;
+            ::memcpy(&word, begin, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ULL;
+            hash ^= hash >> 32;
+        }
+        for(; begin < end; ++begin) {
+            hash = (hash ^ static_cast<uint8_t>(*begin)) * 1099511628211ULL;
+        }
+        return hash;
     }
 
-    bool validate_hex(TomlProxy /*proxy*/)
+    /**
+     * @brief The first key of a header line
+     * @return the length of the key
+     */
+    uint64_t header_key(const char* line, const char* end, const char*& key)
     {
-        return true;
+        const char* str = line + 1;
+        if(str < end && '[' == str[0]) {
+            ++str;
+        }
+        while(str < end && (' ' == str[0] || '\t' == str[0])) {
+            ++str;
+        }
+        key = str;
+        while(str < end && '.' != str[0] && ']' != str[0] && ' ' != str[0] && '\t' != str[0] && '\n' != str[0]) {
+            ++str;
+        }
+        return static_cast<uint64_t>(str - key);
     }
 
-    bool validate_oct(TomlProxy /*proxy*/)
+    /**
+     * @brief Bytes which complete_lines stops at
+     */
+    struct LineTable
     {
-        return true;
-    }
+        uint8_t special_[256];
+    };
 
-    bool validate_bin(TomlProxy /*proxy*/)
+    constexpr LineTable line_table()
     {
-        return true;
+        LineTable table = {};
+        for(char c : {'\n', '[', ']', '{', '}', '#', '"', '\''}) {
+            table.special_[static_cast<uint8_t>(c)] = 1;
+        }
+        return table;
     }
 
-    bool validate_float(cpptoml::TomlProxy /*proxy*/)
-    {
-        return true;
-    }
+    constexpr LineTable LineChars = line_table();
 
-    bool validate_inf(TomlProxy /*proxy*/)
+    /**
+     * @brief The end of the last line from str which ends at the top level, after its newline
+     * @param [in] header ... stop at the first line after str which begins with a header, end if none
+     * @return str when no line ends yet, an array, inline table or multi-line string which is not closed continues on the next lines
+     */
+    const char* complete_lines(const char* str, const char* end, bool header = false)
     {
-        return true;
+        int32_t depth = 0;
+        const char* last = str;
+        while(str < end) {
+            switch(str[0]) {
+            case '\n':
+                ++str;
+                if(depth <= 0) {
+                    last = str;
+                    if(header) {
+                        const char* line = str;
+                        while(line < end && (' ' == line[0] || '\t' == line[0])) {
+                            ++line;
+                        }
+                        if(line < end && '[' == line[0]) {
+                            return str;
+                        }
+                    }
+                }
+                break;
+            case '[':
+            case '{':
+                ++depth;
+                ++str;
+                break;
+            case ']':
+            case '}':
+                if(0 < depth) {
+                    --depth;
+                }
+                ++str;
+                break;
+            case '#':
+                str = reinterpret_cast<const char*>(::memchr(str, '\n', static_cast<size_t>(end - str)));
+                if(CPPTOML_NULL == str) {
+                    return header ? end : last;
+                }
+                break;
+            case '"':
+            case '\'':
+            {
+                char quote = str[0];
+                if((str + 2) < end && quote == str[1] && quote == str[2]) {
+                    str += 3;
+                    while(str < end && !((str + 2) < end && quote == str[0] && quote == str[1] && quote == str[2])) {
+                        str += ('"' == quote && '\\' == str[0]) ? 2 : 1;
+                    }
+                    if(end <= str) {
+                        return header ? end : last;
+                    }
+                    str += 3;
+                    for(uint32_t i = 0; i < 2 && str < end && quote == str[0]; ++i) {
+                        ++str;
+                    }
+                } else {
+                    // a string which is not closed in its line ends there, the parser reports it
+                    ++str;
+                    while(str < end && quote != str[0] && '\n' != str[0]) {
+                        str += ('"' == quote && '\\' == str[0] && (str + 1) < end && '\n' != str[1]) ? 2 : 1;
+                    }
+                    if(str < end && quote == str[0]) {
+                        ++str;
+                    }
+                }
+            } break;
+            default:
+                // most bytes are none of the above
+                ++str;
+                while(str < end && 0 == LineChars.special_[static_cast<uint8_t>(str[0])]) {
+                    ++str;
+                }
+                break;
+            }
+        }
+        return header ? end : last;
     }
 
-    bool validate_nan(TomlProxy /*proxy*/)
+    /**
+     * @brief The closing bracket of the array at str, recording commas of the array at least slice bytes apart
+     * @return CPPTOML_NULL when a string or a comment is not closed, the serial parse reports it
+     */
+    const char* array_commas(const char* str, const char* end, uint64_t slice, const char** commas, uint32_t capacity, uint32_t& count)
     {
-        return true;
+        int32_t depth = 0;
+        const char* last = str;
+        count = 0;
+        while(str < end) {
+            switch(str[0]) {
+            case '[':
+            case '{':
+                ++depth;
+                ++str;
+                break;
+            case ']':
+            case '}':
+                if(--depth <= 0) {
+                    return str;
+                }
+                ++str;
+                break;
+            case ',':
+                if(1 == depth && slice <= static_cast<uint64_t>(str - last) && count < capacity) {
+                    commas[count++] = str;
+                    last = str;
+                }
+                ++str;
+                break;
+            case '#':
+                str = reinterpret_cast<const char*>(::memchr(str, '\n', static_cast<size_t>(end - str)));
+                if(CPPTOML_NULL == str) {
+                    return CPPTOML_NULL;
+                }
+                break;
+            case '"':
+            case '\'':
+            {
+                char quote = str[0];
+                if((str + 2) < end && quote == str[1] && quote == str[2]) {
+                    str += 3;
+                    while(str < end && !((str + 2) < end && quote == str[0] && quote == str[1] && quote == str[2])) {
+                        str += ('"' == quote && '\\' == str[0]) ? 2 : 1;
+                    }
+                    if(end <= str) {
+                        return CPPTOML_NULL;
+                    }
+                    str += 3;
+                    // up to two quotes belong to the string
+                    for(uint32_t i = 0; i < 2 && str < end && quote == str[0]; ++i) {
+                        ++str;
+                    }
+                } else {
+                    ++str;
+                    while(str < end && quote != str[0]) {
+                        if('\n' == str[0]) {
+                            return CPPTOML_NULL;
+                        }
+                        str += ('"' == quote && '\\' == str[0]) ? 2 : 1;
+                    }
+                    ++str;
+                }
+            } break;
+            default:
+                ++str;
+                break;
+            }
+        }
+        return CPPTOML_NULL;
     }
+} // namespace
 
-    bool validate_datetime(TomlProxy /*proxy*/)
-    {
-        return true;
-    }
+//--- TomlHandler
+//---------------------------------------
+TomlHandler::~TomlHandler()
+{
+}
 
-    bool validate_true(cpptoml::TomlProxy)
-    {
-        return true;
-    }
+bool TomlHandler::on_table_header(const TomlSpan*, uint32_t, bool)
+{
+    return true;
+}
 
-    bool validate_false(cpptoml::TomlProxy)
-    {
-        return true;
-    }
+bool TomlHandler::on_key(const TomlSpan*, uint32_t)
+{
+    return true;
+}
+
+bool TomlHandler::on_value(TomlType, TomlSpan)
+{
+    return true;
+}
+
+bool TomlHandler::on_array_begin()
+{
+    return true;
+}
+
+bool TomlHandler::on_array_end()
+{
+    return true;
+}
+
+bool TomlHandler::on_inline_table_begin()
+{
+    return true;
+}
+
+bool TomlHandler::on_inline_table_end()
+{
+    return true;
 }
 
 //--- TomlProxy
@@ -250,6 +493,9 @@ TomlProxy TomlProxy::begin() const
 TomlProxy TomlProxy::next() const
 {
     CPPTOML_ASSERT(TomlParser::Invalid != value_);
+    if(TomlType::Key == type()) {
+        return {TomlParser::Invalid, CPPTOML_NULL, CPPTOML_NULL};
+    }
     return {values_[value_].next_, data_, values_};
 }
 
@@ -268,7 +514,34 @@ TomlProxy TomlProxy::value() const
     if(TomlType::KeyValue != type()) {
         return {TomlParser::Invalid, CPPTOML_NULL, CPPTOML_NULL};
     }
-    return {values_[value_].size_, data_, values_};
+    return TomlParser::resolve(values_[value_].size_, data_, values_);
+}
+
+TomlProxy TomlProxy::find(uint32_t key) const
+{
+    CPPTOML_ASSERT(TomlParser::Invalid != value_);
+    if(TomlType::Table != type() || TomlParser::Invalid == key) {
+        return {TomlParser::Invalid, CPPTOML_NULL, CPPTOML_NULL};
+    }
+    for(uint32_t i = static_cast<uint32_t>(values_[value_].start_); TomlParser::Invalid != i; i = values_[i].next_) {
+        if(key == values_[values_[i].start_].next_) {
+            return TomlParser::resolve(values_[i].size_, data_, values_);
+        }
+    }
+    return {TomlParser::Invalid, CPPTOML_NULL, CPPTOML_NULL};
+}
+
+uint32_t TomlProxy::getKeyId() const
+{
+    CPPTOML_ASSERT(TomlParser::Invalid != value_);
+    switch(type()) {
+    case TomlType::Key:
+        return values_[value_].next_;
+    case TomlType::KeyValue:
+        return values_[values_[value_].start_].next_;
+    default:
+        return TomlParser::Invalid;
+    }
 }
 
 namespace
@@ -341,9 +614,39 @@ int64_t TomlProxy::getInt64() const
 {
     const char* first = data_ + values_[value_].start_;
     const char* last = first + values_[value_].size_;
-    int64_t value = 0;
-    std::from_chars(first, last, value);
-    return value;
+    uint64_t radix = 10;
+    switch(static_cast<TomlType>(values_[value_].type_)) {
+    case TomlType::Hex:
+        radix = 16;
+        first += 2;
+        break;
+    case TomlType::Oct:
+        radix = 8;
+        first += 2;
+        break;
+    case TomlType::Bin:
+        radix = 2;
+        first += 2;
+        break;
+    default:
+        break;
+    }
+    bool negative = false;
+    if(first < last && ('+' == first[0] || '-' == first[0])) {
+        negative = '-' == first[0];
+        ++first;
+    }
+    // the lexer has already checked the digits, only skip underscores here
+    uint64_t value = 0;
+    for(; first < last; ++first) {
+        uint32_t c = static_cast<uint8_t>(first[0]);
+        if('_' == c) {
+            continue;
+        }
+        uint32_t digit = c <= '9' ? c - '0' : (c | 0x20U) - 'a' + 10;
+        value = value * radix + digit;
+    }
+    return negative ? static_cast<int64_t>(0ULL - value) : static_cast<int64_t>(value);
 }
 
 double TomlProxy::getFloat64() const
@@ -352,15 +655,23 @@ double TomlProxy::getFloat64() const
         return 0.0;
     }
     const char* first = data_ + values_[value_].start_;
-#if _MSC_VER
     const char* last = first + values_[value_].size_;
+    // drop underscores and a leading plus, which neither converter accepts
+    char buffer[128];
+    uint64_t size = 0;
+    if('+' == first[0]) {
+        ++first;
+    }
+    for(; first < last && size < 127; ++first) {
+        if('_' != first[0]) {
+            buffer[size++] = first[0];
+        }
+    }
+    buffer[size] = '\0';
+#if _MSC_VER
     double value = 0.0;
-    std::from_chars(first, last, value);
+    std::from_chars(buffer, buffer + size, value);
 #else
-    char buffer[127];
-    uint64_t size = values_[value_].size_ < 128ULL ? values_[value_].size_ : 127ULL;
-    ::memcpy(buffer, first, size);
-    buffer[size] = '\0';
     double value = strtod(buffer, CPPTOML_NULL);
 #endif
     return value;
@@ -382,1779 +693,5855 @@ bool TomlProxy::equalsString(const char* str) const
     return 0==::strncmp(str, data_ + values_[value_].start_, values_[value_].size_);
 }
 
-//--- TomlParser
+//--- TomlKernels
 //---------------------------------------
-TomlParser::TomlParser(CPPTOML_MALLOC_TYPE allocator, CPPTOML_FREE_TYPE deallocator)
-    : allocator_(allocator)
-    , deallocator_(deallocator)
-    , begin_(CPPTOML_NULL)
-    , end_(CPPTOML_NULL)
-    , current_(Invalid)
-    , capacity_(0)
-    , size_(0)
-    , values_(CPPTOML_NULL)
+/**
+ * @brief Lexer kernels, each one returns the first position of which character is out of its class
+ */
+struct TomlKernels
 {
-    if(CPPTOML_NULL == allocator_ || CPPTOML_NULL == deallocator_) {
-        allocator_ = ::malloc;
-        deallocator_ = ::free;
-    }
-}
+    const char* (*whitespace_)(const char* str, const char* end); //!< wschar
+    const char* (*basic_)(const char* str, const char* end);      //!< ascii of basic-unescaped and tab
+    const char* (*literal_)(const char* str, const char* end);    //!< ascii of literal-char
+    const char* (*non_eol_)(const char* str, const char* end);    //!< ascii of non-eol
+    const char* (*digits_)(const char* str, const char* end);     //!< DIGIT
+    TomlISA isa_;
+    bool padded_; //!< the input is followed by TomlParser::Padding zero bytes
+};
 
-TomlParser::~TomlParser()
+namespace
 {
-    deallocator_(values_);
-}
+    enum class CharClass
+    {
+        Whitespace,
+        Basic,
+        Literal,
+        NonEol,
+        Digit,
+    };
 
-bool TomlParser::parse(const char* begin, const char* end)
-{
-    CPPTOML_ASSERT(CPPTOML_NULL != begin);
-    CPPTOML_ASSERT(CPPTOML_NULL != end);
-    CPPTOML_ASSERT(begin <= end);
-    begin_ = begin;
-    end_ = end;
-    current_ = Invalid;
-    size_ = 0;
-    current_ = add_table();
-    const char* str = bom(begin_);
-    while(str < end_) {
-        str = parse_expression(str);
-        if(CPPTOML_NULL == str) {
-            return false;
-        }
-        const char* next = newline(str);
-        if(str == next && str < end_) {
-            return false;
+    template<CharClass C>
+    inline bool in_class(uint8_t c)
+    {
+        if constexpr(CharClass::Whitespace == C) {
+            return 0x09 == c || 0x20 == c;
+        } else if constexpr(CharClass::Digit == C) {
+            return '0' <= c && c <= '9';
+        } else if constexpr(CharClass::Basic == C) {
+            return 0x09 == c || (0x20 <= c && c <= 0x7E && '"' != c && '\\' != c);
+        } else if constexpr(CharClass::Literal == C) {
+            return 0x09 == c || (0x20 <= c && c <= 0x7E && '\'' != c);
+        } else {
+            return 0x09 == c || (0x20 <= c && c <= 0x7E);
         }
-        str = next;
-    }
-    if (str < end_) {
-        return false;
     }
-    return validate(root());
-}
 
-TomlProxy TomlParser::root() const
-{
-    if(size_ <= 0) {
-        return {Invalid, CPPTOML_NULL, CPPTOML_NULL};
+    inline uint32_t ctz32(uint32_t x)
+    {
+        CPPTOML_ASSERT(0 != x);
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward(&index, x);
+        return static_cast<uint32_t>(index);
+#else
+        return static_cast<uint32_t>(__builtin_ctz(x));
+#endif
     }
-    return {0, begin_, values_};
-}
 
-int64_t TomlParser::next_symbol(const char*& str) const
-{
-    const uint8_t* u = reinterpret_cast<const uint8_t*>(str);
-    if(u[0] <= 0x7FU) {
-        str += 1;
-        return u[0];
+    inline uint32_t ctz64(uint64_t x)
+    {
+        CPPTOML_ASSERT(0 != x);
+#if defined(_MSC_VER) && !defined(__clang__)
+        uint32_t low = static_cast<uint32_t>(x);
+        return 0 != low ? ctz32(low) : 32 + ctz32(static_cast<uint32_t>(x >> 32));
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(x));
+#endif
     }
-    if(0b1100'0000U == (u[0] & 0b1110'0000U)) {
-        if(end_ <= (str + 1)) {
-            return -1;
-        }
-        if(0b1000'0000U != (u[1] & 0b1100'0000U)) {
-            return -1;
+
+    // The padded variants rely on the zero bytes after the end, no class contains zero.
+    template<CharClass C, bool Padded>
+    const char* scan_scalar(const char* str, const char* end)
+    {
+        while((Padded || str < end) && in_class<C>(static_cast<uint8_t>(str[0]))) {
+            ++str;
         }
-        str += 2;
-        return ((static_cast<int64_t>(u[0]) & 0b1'1111U) << 6)
-               + (static_cast<int64_t>(u[1]) & 0b11'1111U);
+        return str;
     }
-    if(0b1110'0000U == (u[0] & 0b1111'0000U)) {
-        if(end_ <= (str + 2)) {
-            return -1;
-        }
-        if(0b1000'0000U != (u[1] & 0b1100'0000U)) {
-            return -1;
-        }
-        if(0b1000'0000U != (u[2] & 0b1100'0000U)) {
-            return -1;
-        }
-        str += 3;
-        return ((static_cast<int64_t>(u[0]) & 0b1111U) << 12)
-               + ((static_cast<int64_t>(u[1]) & 0b11'1111U) << 6)
-               + ((static_cast<int64_t>(u[2]) & 0b11'1111U));
+
+    //--- SWAR
+    // Each byte is tested on its lower 7 bits, so that the additions never carry over to the next byte.
+    constexpr uint64_t Ones = 0x0101'0101'0101'0101ULL;
+    constexpr uint64_t Highs = 0x8080'8080'8080'8080ULL;
+
+    inline uint64_t swar_ge(uint64_t y, uint8_t n)
+    {
+        return (y + (0x80U - n) * Ones) & Highs;
     }
-    if(0b1111000U == (u[0] & 0b1111100U)) {
-        if(end_ <= (str + 3)) {
-            return -1;
+
+    inline uint64_t swar_eq(uint64_t y, uint8_t c)
+    {
+        return ~((y ^ (c * Ones)) + 0x7FU * Ones) & Highs;
+    }
+
+    template<CharClass C>
+    inline uint64_t swar_class(uint64_t x)
+    {
+        uint64_t y = x & ~Highs;
+        uint64_t in = 0;
+        if constexpr(CharClass::Whitespace == C) {
+            in = swar_eq(y, 0x09) | swar_eq(y, 0x20);
+        } else if constexpr(CharClass::Digit == C) {
+            in = swar_ge(y, '0') & ~swar_ge(y, '9' + 1);
+        } else {
+            in = swar_ge(y, 0x20) & ~swar_ge(y, 0x7F);
+            if constexpr(CharClass::Basic == C) {
+                in &= ~(swar_eq(y, '"') | swar_eq(y, '\\'));
+            } else if constexpr(CharClass::Literal == C) {
+                in &= ~swar_eq(y, '\'');
+            }
+            in |= swar_eq(y, 0x09);
+        }
+        return in & ~x & Highs;
+    }
+
+    inline uint32_t swar_first(uint64_t mask)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return static_cast<uint32_t>(__builtin_clzll(mask)) >> 3;
+#else
+        return ctz64(mask) >> 3;
+#endif
+    }
+
+    template<CharClass C, bool Padded>
+    const char* scan_swar(const char* str, const char* end)
+    {
+        while(Padded || 8 <= (end - str)) {
+            uint64_t x;
+            ::memcpy(&x, str, sizeof(uint64_t));
+            uint64_t out = ~swar_class<C>(x) & Highs;
+            if(0 != out) {
+                return str + swar_first(out);
+            }
+            str += 8;
+        }
+        return scan_scalar<C, Padded>(str, end);
+    }
+
+#ifdef CPPTOML_X86
+    //--- SSE2
+    template<CharClass C>
+    CPPTOML_TARGET("sse2") inline __m128i sse2_class(__m128i v)
+    {
+        if constexpr(CharClass::Whitespace == C) {
+            return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(0x09)), _mm_cmpeq_epi8(v, _mm_set1_epi8(0x20)));
+        } else if constexpr(CharClass::Digit == C) {
+            return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+        } else {
+            // signed comparison, so that non-ascii bytes are out of the range
+            __m128i in = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1F)), _mm_cmplt_epi8(v, _mm_set1_epi8(0x7F)));
+            if constexpr(CharClass::Basic == C) {
+                in = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))), in);
+            } else if constexpr(CharClass::Literal == C) {
+                in = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')), in);
+            }
+            return _mm_or_si128(in, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x09)));
+        }
+    }
+
+    template<CharClass C, bool Padded>
+    CPPTOML_TARGET("sse2") const char* scan_sse2(const char* str, const char* end)
+    {
+        while(Padded || 16 <= (end - str)) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str));
+            uint32_t out = ~static_cast<uint32_t>(_mm_movemask_epi8(sse2_class<C>(v))) & 0xFFFFU;
+            if(0 != out) {
+                return str + ctz32(out);
+            }
+            str += 16;
+        }
+        return scan_swar<C, Padded>(str, end);
+    }
+
+    //--- SSE4.2
+    template<CharClass C, bool Padded>
+    CPPTOML_TARGET("sse4.2") const char* scan_sse42(const char* str, const char* end)
+    {
+        __m128i ranges;
+        int length;
+        if constexpr(CharClass::Whitespace == C) {
+            ranges = _mm_setr_epi8(0x09, 0x09, 0x20, 0x20, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+            length = 4;
+        } else if constexpr(CharClass::Digit == C) {
+            ranges = _mm_setr_epi8('0', '9', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+            length = 2;
+        } else if constexpr(CharClass::Basic == C) {
+            ranges = _mm_setr_epi8(0x09, 0x09, 0x20, 0x21, 0x23, 0x5B, 0x5D, 0x7E, 0, 0, 0, 0, 0, 0, 0, 0);
+            length = 8;
+        } else if constexpr(CharClass::Literal == C) {
+            ranges = _mm_setr_epi8(0x09, 0x09, 0x20, 0x26, 0x28, 0x7E, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+            length = 6;
+        } else {
+            ranges = _mm_setr_epi8(0x09, 0x09, 0x20, 0x7E, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+            length = 4;
+        }
+        if constexpr(Padded) {
+            // the implicit length stops at the zero sentinel, which is out of the ranges
+            (void)length;
+            for(;;) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str));
+                int index = _mm_cmpistri(ranges, v, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+                if(index < 16) {
+                    return str + index;
+                }
+                str += 16;
+            }
+        }
+        while(16 <= (end - str)) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str));
+            int index = _mm_cmpestri(ranges, length, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+            if(index < 16) {
+                return str + index;
+            }
+            str += 16;
+        }
+        return scan_swar<C, Padded>(str, end);
+    }
+
+    //--- AVX2
+    template<CharClass C>
+    CPPTOML_TARGET("avx2") inline __m256i avx2_class(__m256i v)
+    {
+        if constexpr(CharClass::Whitespace == C) {
+            return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x09)), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x20)));
+        } else if constexpr(CharClass::Digit == C) {
+            return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+        } else {
+            __m256i in = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x1F)), _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7F), v));
+            if constexpr(CharClass::Basic == C) {
+                in = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))), in);
+            } else if constexpr(CharClass::Literal == C) {
+                in = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')), in);
+            }
+            return _mm256_or_si256(in, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x09)));
+        }
+    }
+
+    template<CharClass C, bool Padded>
+    CPPTOML_TARGET("avx2") const char* scan_avx2(const char* str, const char* end)
+    {
+        while(Padded || 32 <= (end - str)) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str));
+            uint32_t out = ~static_cast<uint32_t>(_mm256_movemask_epi8(avx2_class<C>(v)));
+            if(0 != out) {
+                return str + ctz32(out);
+            }
+            str += 32;
+        }
+        return scan_swar<C, Padded>(str, end);
+    }
+
+    //--- AVX-512BW
+    template<CharClass C>
+    CPPTOML_TARGET("avx512bw") inline uint64_t avx512bw_class(__m512i v)
+    {
+        if constexpr(CharClass::Whitespace == C) {
+            return _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(0x09)) | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(0x20));
+        } else if constexpr(CharClass::Digit == C) {
+            return _mm512_cmpgt_epi8_mask(v, _mm512_set1_epi8('0' - 1)) & _mm512_cmplt_epi8_mask(v, _mm512_set1_epi8('9' + 1));
+        } else {
+            uint64_t in = _mm512_cmpgt_epi8_mask(v, _mm512_set1_epi8(0x1F)) & _mm512_cmplt_epi8_mask(v, _mm512_set1_epi8(0x7F));
+            if constexpr(CharClass::Basic == C) {
+                in &= ~(_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('"')) | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\\')));
+            } else if constexpr(CharClass::Literal == C) {
+                in &= ~_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\''));
+            }
+            return in | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(0x09));
+        }
+    }
+
+    template<CharClass C, bool Padded>
+    CPPTOML_TARGET("avx512bw") const char* scan_avx512bw(const char* str, const char* end)
+    {
+        while(Padded || 64 <= (end - str)) {
+            __m512i v = _mm512_loadu_si512(str);
+            uint64_t out = ~avx512bw_class<C>(v);
+            if(0 != out) {
+                return str + ctz64(out);
+            }
+            str += 64;
+        }
+        if(str < end) {
+            // masked loads never fault on the bytes out of the mask
+            uint64_t valid = (~0ULL) >> (64 - (end - str));
+            __m512i v = _mm512_maskz_loadu_epi8(valid, str);
+            uint64_t out = ~avx512bw_class<C>(v) & valid;
+            return 0 != out ? str + ctz64(out) : end;
+        }
+        return str;
+    }
+#endif
+
+#define CPPTOML_KERNELS(scan, isa, padded) {scan<CharClass::Whitespace, padded>, scan<CharClass::Basic, padded>, scan<CharClass::Literal, padded>, scan<CharClass::NonEol, padded>, scan<CharClass::Digit, padded>, isa, padded}
+
+    const TomlKernels kernels_table[] = {
+        CPPTOML_KERNELS(scan_scalar, TomlISA::Scalar, false),
+        CPPTOML_KERNELS(scan_swar, TomlISA::SWAR, false),
+#ifdef CPPTOML_X86
+        CPPTOML_KERNELS(scan_sse2, TomlISA::SSE2, false),
+        CPPTOML_KERNELS(scan_sse42, TomlISA::SSE42, false),
+        CPPTOML_KERNELS(scan_avx2, TomlISA::AVX2, false),
+        CPPTOML_KERNELS(scan_avx512bw, TomlISA::AVX512BW, false),
+#endif
+    };
+
+    const TomlKernels kernels_padded_table[] = {
+        CPPTOML_KERNELS(scan_scalar, TomlISA::Scalar, true),
+        CPPTOML_KERNELS(scan_swar, TomlISA::SWAR, true),
+#ifdef CPPTOML_X86
+        CPPTOML_KERNELS(scan_sse2, TomlISA::SSE2, true),
+        CPPTOML_KERNELS(scan_sse42, TomlISA::SSE42, true),
+        CPPTOML_KERNELS(scan_avx2, TomlISA::AVX2, true),
+        CPPTOML_KERNELS(scan_avx512bw, TomlISA::AVX512BW, true),
+#endif
+    };
+
+#undef CPPTOML_KERNELS
+
+    bool cpu_supports(TomlISA isa)
+    {
+        switch(isa) {
+        case TomlISA::Scalar:
+        case TomlISA::SWAR:
+            return true;
+#ifdef CPPTOML_X86
+#    if defined(_MSC_VER) && !defined(__clang__)
+        default: {
+            int info[4];
+            __cpuid(info, 0);
+            int max = info[0];
+            __cpuid(info, 1);
+            bool sse2 = 0 != (info[3] & (1 << 26));
+            bool sse42 = 0 != (info[2] & (1 << 20));
+            uint64_t xcr0 = 0 != (info[2] & (1 << 27)) ? _xgetbv(0) : 0;
+            bool avx2 = false;
+            bool avx512bw = false;
+            if(7 <= max) {
+                __cpuidex(info, 7, 0);
+                avx2 = 0x6 == (xcr0 & 0x6) && 0 != (info[1] & (1 << 5));
+                avx512bw = 0xE6 == (xcr0 & 0xE6) && 0 != (info[1] & (1 << 16)) && 0 != (info[1] & (1 << 30));
+            }
+            switch(isa) {
+            case TomlISA::SSE2:
+                return sse2;
+            case TomlISA::SSE42:
+                return sse42;
+            case TomlISA::AVX2:
+                return avx2;
+            case TomlISA::AVX512BW:
+                return avx512bw;
+            default:
+                return false;
+            }
+        }
+#    else
+        case TomlISA::SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case TomlISA::SSE42:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.2");
+        case TomlISA::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case TomlISA::AVX512BW:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512bw");
+        default:
+            return false;
+#    endif
+#else
+        default:
+            return false;
+#endif
+        }
+    }
+
+    TomlISA supported_isa(TomlISA isa)
+    {
+        if(TomlISA::Auto == isa) {
+            isa = TomlISA::AVX512BW;
+        }
+        while(!cpu_supports(isa)) {
+            isa = static_cast<TomlISA>(static_cast<uint32_t>(isa) - 1);
+        }
+        return isa;
+    }
+
+    TomlISA environment_isa()
+    {
+        static const char* names[] = {"scalar", "swar", "sse2", "sse42", "avx2", "avx512bw"};
+        const char* env = ::getenv("CPPTOML_ISA");
+        if(CPPTOML_NULL != env) {
+            for(uint32_t i = 0; i < std::size(names); ++i) {
+                if(0 == ::strcmp(env, names[i])) {
+                    return static_cast<TomlISA>(i);
+                }
+            }
+        }
+        return TomlISA::Auto;
+    }
+
+    std::atomic<const TomlKernels*> selected_kernels{CPPTOML_NULL};
+
+    const TomlKernels* current_kernels(bool padded)
+    {
+        const TomlKernels* kernels = selected_kernels.load(std::memory_order_acquire);
+        if(CPPTOML_NULL == kernels) {
+            kernels = &kernels_table[static_cast<uint32_t>(supported_isa(environment_isa()))];
+            selected_kernels.store(kernels, std::memory_order_release);
+        }
+        return padded ? &kernels_padded_table[static_cast<uint32_t>(kernels->isa_)] : kernels;
+    }
+}
+
+TomlISA set_isa(TomlISA isa)
+{
+    TomlISA supported = supported_isa(isa);
+    selected_kernels.store(&kernels_table[static_cast<uint32_t>(supported)], std::memory_order_release);
+    return supported;
+}
+
+TomlISA get_isa()
+{
+    return current_kernels(false)->isa_;
+}
+
+//--- TomlPipeline
+//---------------------------------------
+namespace
+{
+    /**
+     * @brief Whether [str, end) is UTF-8 which parse_non_ascii accepts, no surrogates nor overlong forms
+     */
+    bool valid_utf8(const char* str, const char* end)
+    {
+        const uint8_t* u = reinterpret_cast<const uint8_t*>(str);
+        const uint8_t* e = reinterpret_cast<const uint8_t*>(end);
+        while(u < e) {
+            // eight ascii bytes at a time
+            if(8 <= (e - u)) {
+                uint64_t word;
+                ::memcpy(&word, u, sizeof(word));
+                if(0 == (word & 0x8080'8080'8080'8080ULL)) {
+                    u += 8;
+                    continue;
+                }
+            }
+            if(u[0] <= 0x7FU) {
+                ++u;
+                continue;
+            }
+            uint32_t size = 0;
+            uint32_t c = 0;
+            if(0b1100'0000U == (u[0] & 0b1110'0000U)) {
+                size = 2;
+                c = u[0] & 0b1'1111U;
+            } else if(0b1110'0000U == (u[0] & 0b1111'0000U)) {
+                size = 3;
+                c = u[0] & 0b1111U;
+            } else if(0b1111'0000U == (u[0] & 0b1111'1000U)) {
+                size = 4;
+                c = u[0] & 0b111U;
+            } else {
+                return false;
+            }
+            if((e - u) < size) {
+                return false;
+            }
+            for(uint32_t i = 1; i < size; ++i) {
+                if(0b1000'0000U != (u[i] & 0b1100'0000U)) {
+                    return false;
+                }
+                c = (c << 6) + (u[i] & 0b11'1111U);
+            }
+            static constexpr uint32_t Minimums[] = {0, 0, 0x80, 0x800, 0x1'0000};
+            if(c < Minimums[size] || 0x10'FFFF < c || (0xD800 <= c && c <= 0xDFFF)) {
+                return false;
+            }
+            u += size;
+        }
+        return true;
+    }
+} // namespace
+
+/**
+ * @brief Blocks of parse_pipelined, which a producer thread validates ahead of the parser
+ * @details The producer pushes the end of each block into a single producer single consumer ring, the parser pops them
+ * as it goes. The ring bounds how far the producer runs ahead, so the validated blocks stay in the cache.
+ */
+struct TomlPipeline
+{
+    static constexpr uint64_t BlockSize = 64 * 1024;
+    static constexpr uint32_t Capacity = 16; //!< blocks validated ahead of the parser
+
+    const char* ends_[Capacity];  //!< end of each validated block, CPPTOML_NULL for an invalid one
+    std::atomic<uint32_t> head_;  //!< blocks pushed by the producer
+    std::atomic<uint32_t> tail_;  //!< blocks popped by the parser
+    std::atomic<bool> stop_;
+    const char* validated_;       //!< the input before here is valid, seen by the parser
+    bool invalid_;                //!< the parser checks the rest by itself
+
+    explicit TomlPipeline(const char* begin)
+        : head_(0)
+        , tail_(0)
+        , stop_(false)
+        , validated_(begin)
+        , invalid_(false)
+    {
+    }
+
+    void produce(const char* begin, const char* end)
+    {
+        uint32_t head = 0;
+        while(begin < end) {
+            const char* block = (BlockSize < static_cast<uint64_t>(end - begin)) ? begin + BlockSize : end;
+            // a block ends at the beginning of a character
+            for(uint32_t i = 0; i < 3 && block < end && 0b1000'0000U == (static_cast<uint8_t>(block[0]) & 0b1100'0000U); ++i) {
+                --block;
+            }
+            bool valid = valid_utf8(begin, block);
+            while((head - tail_.load(std::memory_order_acquire)) >= Capacity) {
+                if(stop_.load(std::memory_order_acquire)) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+            ends_[head % Capacity] = valid ? block : CPPTOML_NULL;
+            head_.store(++head, std::memory_order_release);
+            if(!valid || stop_.load(std::memory_order_acquire)) {
+                return;
+            }
+            begin = block;
+        }
+    }
+
+    /**
+     * @brief The end of the blocks validated so far, popping blocks which the producer pushed
+     */
+    const char* validated(const char* str)
+    {
+        if(str < validated_ || invalid_) {
+            return validated_;
+        }
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        for(; tail != head && !invalid_; ++tail) {
+            const char* end = ends_[tail % Capacity];
+            if(CPPTOML_NULL == end) {
+                invalid_ = true;
+            } else {
+                validated_ = end;
+            }
+        }
+        tail_.store(tail, std::memory_order_release);
+        return validated_;
+    }
+};
+
+//--- TomlShared
+//---------------------------------------
+/**
+ * @brief Reference count and nodes of a TomlDocument, the text follows in the same allocation
+ */
+struct TomlShared
+{
+    std::atomic<uint32_t> references_;
+    CPPTOML_FREE_TYPE deallocator_;
+    TomlValue* values_;
+    const char* text_;
+
+    TomlShared(CPPTOML_FREE_TYPE deallocator, TomlValue* values)
+        : references_(1)
+        , deallocator_(deallocator)
+        , values_(values)
+        , text_(CPPTOML_NULL)
+    {
+    }
+};
+
+//--- TomlLazy
+//---------------------------------------
+/**
+ * @brief Nodes parsed from a deferred value, which never move
+ */
+struct TomlSubtree
+{
+    uint64_t start_;    //!< the text of the value
+    TomlValue* values_;
+    uint64_t root_;     //!< the value in values_
+    TomlSubtree* next_;
+};
+
+/**
+ * @brief Values deferred by OptionLazy, the first proxy which reaches one parses it under the lock
+ */
+struct TomlLazy
+{
+    std::mutex mutex_;
+    CPPTOML_MALLOC_TYPE allocator_;
+    CPPTOML_FREE_TYPE deallocator_;
+    uint64_t size_;         //!< the length of the document
+    TomlSubtree* subtrees_;
+
+    TomlLazy(CPPTOML_MALLOC_TYPE allocator, CPPTOML_FREE_TYPE deallocator)
+        : allocator_(allocator)
+        , deallocator_(deallocator)
+        , size_(0)
+        , subtrees_(CPPTOML_NULL)
+    {
+    }
+};
+
+namespace
+{
+    constexpr uint32_t DeferredType = 0x100U; //!< start_ is the text of the value, size_ the TomlLazy
+    constexpr uint32_t ExpandedType = 0x101U; //!< start_ is the TomlSubtree, size_ the TomlLazy
+    constexpr uint32_t BrokenType = 0x102U;   //!< start_ is the text of a value which failed to parse, size_ the TomlLazy
+
+    /**
+     * @brief The type of a node which may be deferred, which proxies of other threads read
+     */
+    std::atomic<uint32_t>& node_type(const TomlValue& value)
+    {
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "a type is replaced in place");
+        return *reinterpret_cast<std::atomic<uint32_t>*>(const_cast<uint32_t*>(&value.type_));
+    }
+} // namespace
+
+//--- WordPattern
+//---------------------------------------
+namespace
+{
+    /**
+     * @brief Fixed-width pattern of up to 8 bytes, 'D' matches a DIGIT, other characters match themselves.
+     */
+    struct WordPattern
+    {
+        uint64_t mask_;   //!< bytes of the pattern
+        uint64_t digits_; //!< bytes which are DIGIT
+        uint64_t fixed_;  //!< literal bytes
+    };
+
+    constexpr uint32_t byte_shift(uint32_t index)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return 56 - index * 8;
+#else
+        return index * 8;
+#endif
+    }
+
+    template<uint32_t N>
+    constexpr WordPattern word_pattern(const char (&pattern)[N])
+    {
+        static_assert(N <= 9, "a word pattern must fit in 8 bytes");
+        WordPattern result = {0, 0, 0};
+        for(uint32_t i = 0; i < (N - 1); ++i) {
+            uint64_t byte = 0xFFULL << byte_shift(i);
+            result.mask_ |= byte;
+            if('D' == pattern[i]) {
+                result.digits_ |= byte;
+            } else {
+                result.fixed_ |= static_cast<uint64_t>(static_cast<uint8_t>(pattern[i])) << byte_shift(i);
+            }
+        }
+        return result;
+    }
+
+    constexpr WordPattern PatternTrue = word_pattern("true");
+    constexpr WordPattern PatternFalse = word_pattern("false");
+    constexpr WordPattern PatternInf = word_pattern("inf");
+    constexpr WordPattern PatternNaN = word_pattern("nan");
+    constexpr WordPattern PatternDate = word_pattern("DDDD-DD-");
+    constexpr WordPattern PatternDay = word_pattern("DD");
+    constexpr WordPattern PatternTime = word_pattern("DD:DD:DD");
+    constexpr WordPattern PatternOffset = word_pattern("DD:DD");
+
+    /**
+     * @brief Test the word against the pattern without branches
+     */
+    inline bool match(uint64_t word, const WordPattern& pattern)
+    {
+        word &= pattern.mask_;
+        // Put '0' on the literal bytes, then every byte has to be in '0'-'9'.
+        uint64_t digits = (word & pattern.digits_) | ('0' * Ones & ~pattern.digits_);
+        bool fixed = (word & ~pattern.digits_) == pattern.fixed_;
+        bool high = (digits & (0xF0 * Ones)) == ('0' * Ones);
+        bool low = ((digits + 0x06 * Ones) & (0xF0 * Ones)) == ('0' * Ones);
+        return fixed & high & low;
+    }
+} // namespace
+
+//--- Value ranges
+//---------------------------------------
+namespace
+{
+    /**
+     * @brief Check a decimal integer with an optional sign and underscores fits in int64_t
+     */
+    bool integer_in_range(const char* str, const char* end)
+    {
+        bool negative = '-' == str[0];
+        if('-' == str[0] || '+' == str[0]) {
+            ++str;
+        }
+        // 18 digits always fit
+        if((end - str) < 19) {
+            return true;
+        }
+        uint64_t limit = negative ? 0x8000'0000'0000'0000ULL : 0x7FFF'FFFF'FFFF'FFFFULL;
+        uint64_t value = 0;
+        for(; str < end; ++str) {
+            if('_' == str[0]) {
+                continue;
+            }
+            uint64_t digit = static_cast<uint64_t>(str[0] - '0');
+            if(((limit - digit) / 10) < value) {
+                return false;
+            }
+            value = value * 10 + digit;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Check the digits after 0x, 0o or 0b fit in int64_t
+     */
+    bool radix_in_range(const char* str, const char* end, TomlType type)
+    {
+        uint32_t bits = TomlType::Hex == type ? 4 : (TomlType::Oct == type ? 3 : 1);
+        uint64_t limit = 0x7FFF'FFFF'FFFF'FFFFULL >> bits;
+        uint64_t value = 0;
+        for(; str < end; ++str) {
+            uint32_t c = static_cast<uint8_t>(str[0]);
+            if('_' == c) {
+                continue;
+            }
+            if(limit < value) {
+                return false;
+            }
+            uint32_t digit = c <= '9' ? c - '0' : (c | 0x20U) - 'a' + 10;
+            value = (value << bits) | digit;
+        }
+        return true;
+    }
+
+    inline uint32_t two_digits(const char* str)
+    {
+        return static_cast<uint32_t>(str[0] - '0') * 10 + static_cast<uint32_t>(str[1] - '0');
+    }
+
+    /**
+     * @brief Check the fields of YYYY-MM-DD, the syntax has been checked
+     */
+    bool valid_date(const char* str)
+    {
+        static constexpr uint8_t days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        uint32_t year = two_digits(str) * 100 + two_digits(str + 2);
+        uint32_t month = two_digits(str + 5);
+        uint32_t day = two_digits(str + 8);
+        if(month < 1 || 12 < month || day < 1) {
+            return false;
+        }
+        bool leap = 0 == (year % 4) && (0 != (year % 100) || 0 == (year % 400));
+        return day <= (days[month - 1] + ((2 == month && leap) ? 1U : 0U));
+    }
+
+    /**
+     * @brief Check the fields of HH:MM:SS, a leap second is allowed
+     */
+    bool valid_time(const char* str)
+    {
+        return two_digits(str) < 24 && two_digits(str + 3) < 60 && two_digits(str + 6) <= 60;
+    }
+
+    /**
+     * @brief Check a date-time token whose syntax has been checked
+     */
+    bool valid_datetime(const char* str, const char* end)
+    {
+        if(':' == str[2]) {
+            return valid_time(str);
+        }
+        if(!valid_date(str)) {
+            return false;
+        }
+        if((end - str) <= 10) {
+            return true;
+        }
+        str += 11;
+        if(!valid_time(str)) {
+            return false;
+        }
+        str += 8;
+        if(str < end && '.' == str[0]) {
+            ++str;
+            while(str < end && '0' <= str[0] && str[0] <= '9') {
+                ++str;
+            }
+        }
+        if(str < end && ('+' == str[0] || '-' == str[0])) {
+            // HH:MM of the offset
+            return two_digits(str + 1) < 24 && two_digits(str + 4) < 60;
+        }
+        return true;
+    }
+} // namespace
+
+#ifdef CPPTOML_TABLE_LEXER
+//--- ScalarLexer
+//---------------------------------------
+namespace
+{
+    // Character classes of the scalar lexer, only the characters which can appear in a number, a date-time or a keyword have their own.
+    enum ScalarClass : uint8_t
+    {
+        ClassOther = 0,
+        ClassZero,      //!< 0
+        ClassOne,       //!< 1
+        ClassOctal,     //!< 2-7
+        ClassDecimal,   //!< 8-9
+        ClassPlus,      //!< +
+        ClassMinus,     //!< -
+        ClassUnderscore,
+        ClassDot,
+        ClassColon,
+        ClassSpace,
+        ClassX,         //!< x
+        ClassO,         //!< o
+        ClassB,         //!< b
+        ClassLowerE,    //!< e
+        ClassUpperE,    //!< E
+        ClassLowerA,    //!< a
+        ClassLowerF,    //!< f
+        ClassLowerT,    //!< t
+        ClassUpperT,    //!< T
+        ClassZ,         //!< z Z
+        ClassI,         //!< i
+        ClassN,         //!< n
+        ClassR,         //!< r
+        ClassU,         //!< u
+        ClassL,         //!< l
+        ClassS,         //!< s
+        ClassHexUpper,  //!< A B C D F
+        ClassHexLower,  //!< c d
+        ClassCount,
+    };
+
+    enum ScalarState : uint8_t
+    {
+        StateError = 0,
+        StateStart,
+        StateSign,
+        StateZero,
+        StateSignedZero,
+        StateDec1,
+        StateDec2,
+        StateDec3,
+        StateDec4,
+        StateLead2,
+        StateLead3,
+        StateLead4,
+        StateInt,
+        StateIntUnder,
+        StateFracDot,
+        StateFrac,
+        StateFracUnder,
+        StateExp,
+        StateExpSign,
+        StateExpDigits,
+        StateExpUnder,
+        StateHexPrefix,
+        StateHex,
+        StateHexUnder,
+        StateOctPrefix,
+        StateOct,
+        StateOctUnder,
+        StateBinPrefix,
+        StateBin,
+        StateBinUnder,
+        StateInf1,
+        StateInf2,
+        StateInf,
+        StateNaN1,
+        StateNaN2,
+        StateNaN,
+        StateTrue1,
+        StateTrue2,
+        StateTrue3,
+        StateTrue,
+        StateFalse1,
+        StateFalse2,
+        StateFalse3,
+        StateFalse4,
+        StateFalse,
+        StateDate5,
+        StateDate6,
+        StateDate7,
+        StateDate8,
+        StateDate9,
+        StateDate,
+        StateDateDelim,
+        StateDateSpace,
+        StateHour1,
+        StateHour2,
+        StateTime3,
+        StateMinute1,
+        StateMinute2,
+        StateTime6,
+        StateSecond1,
+        StateTime,
+        StateTimeDot,
+        StateTimeFrac,
+        StateZulu,
+        StateOffsetSign,
+        StateOffsetHour1,
+        StateOffsetHour2,
+        StateOffsetColon,
+        StateOffsetMinute1,
+        StateOffset,
+        StateLocalTime3,
+        StateLocalMinute1,
+        StateLocalMinute2,
+        StateLocalTime6,
+        StateLocalSecond1,
+        StateLocalTime,
+        StateLocalTimeDot,
+        StateLocalTimeFrac,
+        StateCount,
+    };
+
+    struct ScalarTable
+    {
+        uint8_t classes_[256];
+        uint8_t next_[StateCount][ClassCount];
+        TomlType accept_[StateCount]; //!< the type of the token which ends at a state, or Invalid
+    };
+
+    constexpr ScalarTable build_scalar_table()
+    {
+        ScalarTable table = {};
+        for(uint32_t i = 0; i < 256; ++i) {
+            table.classes_[i] = ClassOther;
+        }
+        table.classes_['0'] = ClassZero;
+        table.classes_['1'] = ClassOne;
+        for(uint32_t i = '2'; i <= '7'; ++i) {
+            table.classes_[i] = ClassOctal;
+        }
+        table.classes_['8'] = ClassDecimal;
+        table.classes_['9'] = ClassDecimal;
+        table.classes_['+'] = ClassPlus;
+        table.classes_['-'] = ClassMinus;
+        table.classes_['_'] = ClassUnderscore;
+        table.classes_['.'] = ClassDot;
+        table.classes_[':'] = ClassColon;
+        table.classes_[' '] = ClassSpace;
+        table.classes_['x'] = ClassX;
+        table.classes_['o'] = ClassO;
+        table.classes_['b'] = ClassB;
+        table.classes_['e'] = ClassLowerE;
+        table.classes_['E'] = ClassUpperE;
+        table.classes_['a'] = ClassLowerA;
+        table.classes_['f'] = ClassLowerF;
+        table.classes_['t'] = ClassLowerT;
+        table.classes_['T'] = ClassUpperT;
+        table.classes_['z'] = ClassZ;
+        table.classes_['Z'] = ClassZ;
+        table.classes_['i'] = ClassI;
+        table.classes_['n'] = ClassN;
+        table.classes_['r'] = ClassR;
+        table.classes_['u'] = ClassU;
+        table.classes_['l'] = ClassL;
+        table.classes_['s'] = ClassS;
+        table.classes_['A'] = ClassHexUpper;
+        table.classes_['B'] = ClassHexUpper;
+        table.classes_['C'] = ClassHexUpper;
+        table.classes_['D'] = ClassHexUpper;
+        table.classes_['F'] = ClassHexUpper;
+        table.classes_['c'] = ClassHexLower;
+        table.classes_['d'] = ClassHexLower;
+
+        for(uint32_t i = 0; i < StateCount; ++i) {
+            table.accept_[i] = TomlType::Invalid;
+        }
+
+        constexpr uint8_t Binary[] = {ClassZero, ClassOne};
+        constexpr uint8_t Octal[] = {ClassZero, ClassOne, ClassOctal};
+        constexpr uint8_t Digits[] = {ClassZero, ClassOne, ClassOctal, ClassDecimal};
+        constexpr uint8_t NonZero[] = {ClassOne, ClassOctal, ClassDecimal};
+        constexpr uint8_t Hex[] = {ClassZero, ClassOne, ClassOctal, ClassDecimal, ClassLowerA, ClassB, ClassHexLower, ClassLowerE, ClassLowerF, ClassUpperE, ClassHexUpper};
+        auto on = [&table](uint8_t from, uint8_t c, uint8_t to) {
+            table.next_[from][c] = to;
+        };
+        auto on_set = [&table](uint8_t from, const auto& set, uint8_t to) {
+            for(uint8_t c: set) {
+                table.next_[from][c] = to;
+            }
+        };
+
+        // sign, keywords and special floats
+        on(StateStart, ClassPlus, StateSign);
+        on(StateStart, ClassMinus, StateSign);
+        on(StateStart, ClassZero, StateZero);
+        on_set(StateStart, NonZero, StateDec1);
+        on(StateStart, ClassI, StateInf1);
+        on(StateStart, ClassN, StateNaN1);
+        on(StateStart, ClassLowerT, StateTrue1);
+        on(StateStart, ClassLowerF, StateFalse1);
+        on(StateSign, ClassZero, StateSignedZero);
+        on_set(StateSign, NonZero, StateInt);
+        on(StateSign, ClassI, StateInf1);
+        on(StateSign, ClassN, StateNaN1);
+        on(StateInf1, ClassN, StateInf2);
+        on(StateInf2, ClassLowerF, StateInf);
+        on(StateNaN1, ClassLowerA, StateNaN2);
+        on(StateNaN2, ClassN, StateNaN);
+        on(StateTrue1, ClassR, StateTrue2);
+        on(StateTrue2, ClassU, StateTrue3);
+        on(StateTrue3, ClassLowerE, StateTrue);
+        on(StateFalse1, ClassLowerA, StateFalse2);
+        on(StateFalse2, ClassL, StateFalse3);
+        on(StateFalse3, ClassS, StateFalse4);
+        on(StateFalse4, ClassLowerE, StateFalse);
+
+        // integers, the first four digits are counted for the year and the hour of date-times
+        on(StateZero, ClassX, StateHexPrefix);
+        on(StateZero, ClassO, StateOctPrefix);
+        on(StateZero, ClassB, StateBinPrefix);
+        on_set(StateZero, Digits, StateLead2);
+        on_set(StateLead2, Digits, StateLead3);
+        on_set(StateLead3, Digits, StateLead4);
+        on_set(StateDec1, Digits, StateDec2);
+        on_set(StateDec2, Digits, StateDec3);
+        on_set(StateDec3, Digits, StateDec4);
+        on_set(StateDec4, Digits, StateInt);
+        on_set(StateInt, Digits, StateInt);
+        on_set(StateIntUnder, Digits, StateInt);
+        const uint8_t decimals[] = {StateDec1, StateDec2, StateDec3, StateDec4, StateInt};
+        for(uint8_t state: decimals) {
+            on(state, ClassUnderscore, StateIntUnder);
+        }
+        const uint8_t mantissas[] = {StateZero, StateSignedZero, StateDec1, StateDec2, StateDec3, StateDec4, StateInt};
+        for(uint8_t state: mantissas) {
+            on(state, ClassDot, StateFracDot);
+            on(state, ClassLowerE, StateExp);
+            on(state, ClassUpperE, StateExp);
+        }
+
+        // floats
+        on_set(StateFracDot, Digits, StateFrac);
+        on_set(StateFrac, Digits, StateFrac);
+        on_set(StateFracUnder, Digits, StateFrac);
+        on(StateFrac, ClassUnderscore, StateFracUnder);
+        on(StateFrac, ClassLowerE, StateExp);
+        on(StateFrac, ClassUpperE, StateExp);
+        on(StateExp, ClassPlus, StateExpSign);
+        on(StateExp, ClassMinus, StateExpSign);
+        on_set(StateExp, Digits, StateExpDigits);
+        on_set(StateExpSign, Digits, StateExpDigits);
+        on_set(StateExpDigits, Digits, StateExpDigits);
+        on_set(StateExpUnder, Digits, StateExpDigits);
+        on(StateExpDigits, ClassUnderscore, StateExpUnder);
+
+        // prefixed integers
+        on_set(StateHexPrefix, Hex, StateHex);
+        on_set(StateHex, Hex, StateHex);
+        on_set(StateHexUnder, Hex, StateHex);
+        on(StateHex, ClassUnderscore, StateHexUnder);
+        on_set(StateOctPrefix, Octal, StateOct);
+        on_set(StateOct, Octal, StateOct);
+        on_set(StateOctUnder, Octal, StateOct);
+        on(StateOct, ClassUnderscore, StateOctUnder);
+        on_set(StateBinPrefix, Binary, StateBin);
+        on_set(StateBin, Binary, StateBin);
+        on_set(StateBinUnder, Binary, StateBin);
+        on(StateBin, ClassUnderscore, StateBinUnder);
+
+        // full-date, and the time after it
+        on(StateDec4, ClassMinus, StateDate5);
+        on(StateLead4, ClassMinus, StateDate5);
+        on_set(StateDate5, Digits, StateDate6);
+        on_set(StateDate6, Digits, StateDate7);
+        on(StateDate7, ClassMinus, StateDate8);
+        on_set(StateDate8, Digits, StateDate9);
+        on_set(StateDate9, Digits, StateDate);
+        on(StateDate, ClassLowerT, StateDateDelim);
+        on(StateDate, ClassUpperT, StateDateDelim);
+        on(StateDate, ClassSpace, StateDateSpace);
+        on_set(StateDateDelim, Digits, StateHour1);
+        on_set(StateDateSpace, Digits, StateHour1);
+        on_set(StateHour1, Digits, StateHour2);
+        on(StateHour2, ClassColon, StateTime3);
+        on_set(StateTime3, Digits, StateMinute1);
+        on_set(StateMinute1, Digits, StateMinute2);
+        on(StateMinute2, ClassColon, StateTime6);
+        on_set(StateTime6, Digits, StateSecond1);
+        on_set(StateSecond1, Digits, StateTime);
+        on(StateTime, ClassDot, StateTimeDot);
+        on_set(StateTimeDot, Digits, StateTimeFrac);
+        on_set(StateTimeFrac, Digits, StateTimeFrac);
+        const uint8_t times[] = {StateTime, StateTimeFrac};
+        for(uint8_t state: times) {
+            on(state, ClassZ, StateZulu);
+            on(state, ClassPlus, StateOffsetSign);
+            on(state, ClassMinus, StateOffsetSign);
+        }
+        on_set(StateOffsetSign, Digits, StateOffsetHour1);
+        on_set(StateOffsetHour1, Digits, StateOffsetHour2);
+        on(StateOffsetHour2, ClassColon, StateOffsetColon);
+        on_set(StateOffsetColon, Digits, StateOffsetMinute1);
+        on_set(StateOffsetMinute1, Digits, StateOffset);
+
+        // partial-time
+        on(StateDec2, ClassColon, StateLocalTime3);
+        on(StateLead2, ClassColon, StateLocalTime3);
+        on_set(StateLocalTime3, Digits, StateLocalMinute1);
+        on_set(StateLocalMinute1, Digits, StateLocalMinute2);
+        on(StateLocalMinute2, ClassColon, StateLocalTime6);
+        on_set(StateLocalTime6, Digits, StateLocalSecond1);
+        on_set(StateLocalSecond1, Digits, StateLocalTime);
+        on(StateLocalTime, ClassDot, StateLocalTimeDot);
+        on_set(StateLocalTimeDot, Digits, StateLocalTimeFrac);
+        on_set(StateLocalTimeFrac, Digits, StateLocalTimeFrac);
+
+        const uint8_t integers[] = {StateZero, StateSignedZero, StateDec1, StateDec2, StateDec3, StateDec4, StateInt};
+        for(uint8_t state: integers) {
+            table.accept_[state] = TomlType::Integer;
+        }
+        table.accept_[StateFrac] = TomlType::Float;
+        table.accept_[StateExpDigits] = TomlType::Float;
+        table.accept_[StateHex] = TomlType::Hex;
+        table.accept_[StateOct] = TomlType::Oct;
+        table.accept_[StateBin] = TomlType::Bin;
+        table.accept_[StateInf] = TomlType::Inf;
+        table.accept_[StateNaN] = TomlType::NaN;
+        table.accept_[StateTrue] = TomlType::True;
+        table.accept_[StateFalse] = TomlType::False;
+        const uint8_t datetimes[] = {StateDate, StateTime, StateTimeFrac, StateZulu, StateOffset, StateLocalTime, StateLocalTimeFrac};
+        for(uint8_t state: datetimes) {
+            table.accept_[state] = TomlType::DateTime;
+        }
+        return table;
+    }
+
+    constexpr ScalarTable scalar_table = build_scalar_table();
+} // namespace
+#endif // CPPTOML_TABLE_LEXER
+
+//--- TomlParser
+//---------------------------------------
+TomlParser::TomlParser(CPPTOML_MALLOC_TYPE allocator, CPPTOML_FREE_TYPE deallocator)
+    : allocator_(allocator)
+    , deallocator_(deallocator)
+    , kernels_(CPPTOML_NULL)
+    , begin_(CPPTOML_NULL)
+    , end_(CPPTOML_NULL)
+    , current_(Invalid)
+    , capacity_(0)
+    , size_(0)
+    , values_(CPPTOML_NULL)
+    , frames_(CPPTOML_NULL)
+    , options_(0)
+    , array_table_{0, 0, Invalid, Invalid}
+    , tails_{CPPTOML_NULL, 0, 0}
+    , entries_{CPPTOML_NULL, 0, 0}
+    , header_path_{Invalid, 0, {}}
+    , key_path_{Invalid, 0, {}}
+    , keys_{CPPTOML_NULL, CPPTOML_NULL, 0, 0, 0}
+    , headers_{CPPTOML_NULL, 0, 0, false}
+    , threads_(1)
+    , pipeline_(CPPTOML_NULL)
+    , sections_{CPPTOML_NULL, 0, 0}
+    , resume_(0)
+    , file_{CPPTOML_NULL, 0, false}
+    , stream_{CPPTOML_NULL, 0, 0, false, false}
+    , spans_{CPPTOML_NULL, 0, 0}
+    , lazy_(CPPTOML_NULL)
+{
+    if(CPPTOML_NULL == allocator_ || CPPTOML_NULL == deallocator_) {
+        allocator_ = ::malloc;
+        deallocator_ = ::free;
+    }
+}
+
+TomlParser::~TomlParser()
+{
+    release_file();
+    release_lazy();
+    clear_sections();
+    deallocator_(stream_.text_);
+    deallocator_(spans_.spans_);
+    deallocator_(headers_.tables_);
+    deallocator_(entries_.slots_);
+    deallocator_(tails_.slots_);
+    deallocator_(keys_.slots_);
+    deallocator_(keys_.keys_);
+    deallocator_(frames_);
+    deallocator_(values_);
+}
+
+bool TomlParser::parse(const char* begin, const char* end)
+{
+    kernels_ = current_kernels(false);
+    threads_ = 1;
+    return parse_document(begin, end);
+}
+
+namespace
+{
+    /**
+     * @brief A path of a TomlFilter split into keys
+     */
+    struct FilterPath
+    {
+        TomlSpan* keys_;
+        uint32_t size_;
+        bool open_; //!< a section of the path has begun
+        bool done_; //!< the path has been read
+    };
+
+    enum class FilterMatch
+    {
+        Outside,
+        Ancestor, //!< a prefix of a path of the filter
+        Inside,   //!< a path of the filter is a prefix of it
+    };
+
+    /**
+     * @return true if the keys of a are the first keys of b
+     */
+    bool key_prefix(const TomlSpan* a, uint32_t a_size, const TomlSpan* b, uint32_t b_size)
+    {
+        if(b_size < a_size) {
+            return false;
+        }
+        for(uint32_t i = 0; i < a_size; ++i) {
+            size_t size = static_cast<size_t>(a[i].end_ - a[i].begin_);
+            if(size != static_cast<size_t>(b[i].end_ - b[i].begin_) || 0 != ::memcmp(a[i].begin_, b[i].begin_, size)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    FilterMatch filter_match(const FilterPath* paths, uint32_t count, const TomlSpan* keys, uint32_t size)
+    {
+        FilterMatch match = FilterMatch::Outside;
+        for(uint32_t i = 0; i < count; ++i) {
+            if(key_prefix(paths[i].keys_, paths[i].size_, keys, size)) {
+                return FilterMatch::Inside;
+            }
+            if(key_prefix(keys, size, paths[i].keys_, paths[i].size_)) {
+                match = FilterMatch::Ancestor;
+            }
+        }
+        return match;
+    }
+
+    /**
+     * @brief Split a dotted path, a quoted key keeps its dots
+     * @return the number of keys, which are written to keys if it is not null
+     */
+    uint32_t split_path(const char* path, TomlSpan* keys)
+    {
+        uint32_t size = 0;
+        while('\0' != path[0]) {
+            const char* begin = path;
+            if('"' == path[0] || '\'' == path[0]) {
+                const char* close = ::strchr(path + 1, path[0]);
+                path = (CPPTOML_NULL != close) ? close + 1 : path + ::strlen(path);
+            }
+            while('\0' != path[0] && '.' != path[0]) {
+                ++path;
+            }
+            if(CPPTOML_NULL != keys) {
+                keys[size] = {begin, path};
+            }
+            ++size;
+            if('.' == path[0]) {
+                ++path;
+            }
+        }
+        return size;
+    }
+} // namespace
+
+bool TomlParser::parse(const char* begin, const char* end, const TomlFilter& filter)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(begin <= end);
+    kernels_ = current_kernels(false);
+    threads_ = 1;
+    begin_document(begin, end);
+
+    uint32_t total = 0;
+    for(uint32_t i = 0; i < filter.size_; ++i) {
+        total += split_path(filter.paths_[i], CPPTOML_NULL);
+    }
+    FilterPath* paths = reinterpret_cast<FilterPath*>(allocator_(sizeof(FilterPath) * (filter.size_ + 1)));
+    TomlSpan* keys = reinterpret_cast<TomlSpan*>(allocator_(sizeof(TomlSpan) * (total + 1)));
+    total = 0;
+    for(uint32_t i = 0; i < filter.size_; ++i) {
+        paths[i] = {keys + total, split_path(filter.paths_[i], keys + total), false, false};
+        total += paths[i].size_;
+    }
+    uint32_t remaining = filter.size_;
+    auto finish = [&remaining](FilterPath& path) {
+        if(!path.done_) {
+            path.done_ = true;
+            --remaining;
+        }
+    };
+
+    // The header and then the keys of the current expression, checked against the filter.
+    TomlSpan* current = CPPTOML_NULL;
+    uint32_t header = 0;
+    uint32_t capacity = 0;
+    auto reserve_path = [this, &current, &header, &capacity](uint32_t size) {
+        if(capacity < size) {
+            capacity = (std::max)(size, capacity * 2);
+            TomlSpan* path = reinterpret_cast<TomlSpan*>(allocator_(sizeof(TomlSpan) * capacity));
+            if(0 < header) {
+                ::memcpy(path, current, sizeof(TomlSpan) * header);
+            }
+            deallocator_(current);
+            current = path;
+        }
+    };
+    TomlHandler syntax; // skipped expressions are only lexed
+    FilterMatch section = filter_match(paths, filter.size_, current, 0);
+    bool result = true;
+    const char* str = bom(begin_);
+    while(result && str < end_ && (!filter.trusted_ || 0 < remaining)) {
+        str = whitespace(str);
+        if(end_ <= str) {
+            break;
+        }
+        const char* next = str;
+        if('[' == str[0]) {
+            next = event_table(str, syntax);
+            if(CPPTOML_NULL == next) {
+                result = false;
+                break;
+            }
+            header = 0;
+            reserve_path(spans_.size_);
+            ::memcpy(current, spans_.spans_, sizeof(TomlSpan) * spans_.size_);
+            header = spans_.size_;
+            for(uint32_t i = 0; i < filter.size_; ++i) {
+                // a table of the filter is read at the first header outside it
+                bool inside = key_prefix(paths[i].keys_, paths[i].size_, current, header);
+                if(filter.trusted_ && paths[i].open_ && !inside) {
+                    finish(paths[i]);
+                }
+                paths[i].open_ = paths[i].open_ || inside;
+            }
+            if(filter.trusted_ && remaining <= 0) {
+                break;
+            }
+            section = filter_match(paths, filter.size_, current, header);
+            if(FilterMatch::Outside != section) {
+                next = std::get<0>(parse_table(str));
+            }
+        } else if('#' != str[0] && ('"' == str[0] || '\'' == str[0] || parse_unquated_key_char(next))) {
+            FilterMatch match = section;
+            if(FilterMatch::Ancestor == section) {
+                next = event_key(str);
+                if(CPPTOML_NULL == next) {
+                    result = false;
+                    break;
+                }
+                uint32_t size = header + spans_.size_;
+                reserve_path(size);
+                ::memcpy(current + header, spans_.spans_, sizeof(TomlSpan) * spans_.size_);
+                match = filter_match(paths, filter.size_, current, size);
+                for(uint32_t i = 0; filter.trusted_ && FilterMatch::Inside == match && i < filter.size_; ++i) {
+                    // a value is read whole, the paths in it are done
+                    if(key_prefix(current, size, paths[i].keys_, paths[i].size_)) {
+                        finish(paths[i]);
+                    }
+                }
+            }
+            if(FilterMatch::Outside == match) {
+                next = event_key(str);
+                if(CPPTOML_NULL == next || end_ <= next || 0x3D != next[0]) {
+                    result = false;
+                    break;
+                }
+                next = whitespace(next + 1);
+                next = (end_ <= next) ? CPPTOML_NULL : event_value(next, syntax);
+            } else {
+                next = std::get<0>(parse_keyvalue(str));
+            }
+        }
+        if(CPPTOML_NULL == next) {
+            result = false;
+            break;
+        }
+        str = whitespace(next);
+        str = comment(str);
+        if(CPPTOML_NULL == str) {
+            result = false;
+            break;
+        }
+        next = newline(str);
+        if(str == next && str < end_) {
+            result = false;
+            break;
+        }
+        str = next;
+    }
+    deallocator_(current);
+    deallocator_(keys);
+    deallocator_(paths);
+    if(result && 0 != (options_ & OptionValidate)) {
+        return validate();
+    }
+    return result;
+}
+
+bool TomlParser::parse_pipelined(const char* begin, const char* end)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(begin <= end);
+    kernels_ = current_kernels(false);
+    threads_ = 1;
+    if(static_cast<uint64_t>(end - begin) < 2 * TomlPipeline::BlockSize) {
+        return parse_document(begin, end);
+    }
+    TomlPipeline* pipeline = new(allocator_(sizeof(TomlPipeline))) TomlPipeline(begin);
+    std::thread producer([pipeline, begin, end]() {
+        pipeline->produce(begin, end);
+    });
+    pipeline_ = pipeline;
+    bool result = parse_document(begin, end);
+    pipeline_ = CPPTOML_NULL;
+    pipeline->stop_.store(true, std::memory_order_release);
+    producer.join();
+    pipeline->~TomlPipeline();
+    deallocator_(pipeline);
+    return result;
+}
+
+bool TomlParser::parse_padded(const char* begin, const char* end)
+{
+#ifdef CPPTOML_DEBUG
+    for(uint32_t i = 0; i < Padding; ++i) {
+        CPPTOML_ASSERT('\0' == end[i]);
+    }
+#endif
+    kernels_ = current_kernels(true);
+    threads_ = 1;
+    return parse_document(begin, end);
+}
+
+TomlStatus TomlParser::parse_file(const char* path)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != path);
+    threads_ = 1;
+    // the last document stays until the new text is read
+    FileText text = {CPPTOML_NULL, 0, false};
+    bool padded = false;
+#ifdef CPPTOML_MMAP
+    int descriptor = ::open(path, O_RDONLY);
+    if(descriptor < 0) {
+        return TomlStatus::FileError;
+    }
+    struct stat status;
+    if(0 != ::fstat(descriptor, &status) || !S_ISREG(status.st_mode)) {
+        ::close(descriptor);
+        return TomlStatus::FileError;
+    }
+    uint64_t size = static_cast<uint64_t>(status.st_size);
+    void* address = CPPTOML_NULL;
+    if(0 < size) {
+        int flags = MAP_PRIVATE;
+#    ifdef MAP_POPULATE
+        if(0 != (options_ & OptionPrefault)) {
+            flags |= MAP_POPULATE;
+        }
+#    endif
+        address = ::mmap(CPPTOML_NULL, static_cast<size_t>(size), PROT_READ, flags, descriptor, 0);
+    }
+    ::close(descriptor);
+    if(MAP_FAILED == address) {
+        return TomlStatus::FileError;
+    }
+    if(0 < size) {
+        text = {address, size, true};
+        ::madvise(address, static_cast<size_t>(size), MADV_SEQUENTIAL);
+#    ifndef MAP_POPULATE
+        if(0 != (options_ & OptionPrefault)) {
+            ::madvise(address, static_cast<size_t>(size), MADV_WILLNEED);
+        }
+#    endif
+        // the rest of the last page is zero, which serves as the padding of parse_padded
+        uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+        padded = 0 < page && Padding <= (page - size % page) % page;
+    }
+#else
+    FILE* file = ::fopen(path, "rb");
+    if(CPPTOML_NULL == file) {
+        return TomlStatus::FileError;
+    }
+    long length = (0 == ::fseek(file, 0, SEEK_END)) ? ::ftell(file) : -1;
+    char* buffer = (0 <= length && 0 == ::fseek(file, 0, SEEK_SET)) ? allocate_padded(static_cast<uint64_t>(length)) : CPPTOML_NULL;
+    bool result = CPPTOML_NULL != buffer && (length <= 0 || 1 == ::fread(buffer, static_cast<size_t>(length), 1, file));
+    ::fclose(file);
+    if(!result) {
+        deallocate_padded(buffer);
+        return TomlStatus::FileError;
+    }
+    uint64_t size = static_cast<uint64_t>(length);
+    text = {buffer, size, false};
+    padded = true;
+#endif
+    release_file();
+    file_ = text;
+    const char* begin = (CPPTOML_NULL != file_.address_) ? static_cast<const char*>(file_.address_) : "";
+    kernels_ = current_kernels(padded);
+    bool result = parse_document(begin, begin + size);
+#ifdef CPPTOML_MMAP
+    if(file_.mapped_) {
+        // proxies read the text in any order
+        ::madvise(file_.address_, static_cast<size_t>(file_.size_), MADV_NORMAL);
+    }
+#endif
+    return result ? TomlStatus::Success : TomlStatus::ParseError;
+}
+
+void TomlParser::release_file()
+{
+    if(CPPTOML_NULL == file_.address_) {
+        return;
+    }
+#ifdef CPPTOML_MMAP
+    if(file_.mapped_) {
+        ::munmap(file_.address_, static_cast<size_t>(file_.size_));
+    } else {
+        deallocate_padded(static_cast<char*>(file_.address_));
+    }
+#else
+    deallocate_padded(static_cast<char*>(file_.address_));
+#endif
+    file_ = {CPPTOML_NULL, 0, false};
+}
+
+TomlProxy TomlParser::resolve(uint64_t value, const char* data, const TomlValue* values)
+{
+    if(Invalid == value) {
+        return {Invalid, CPPTOML_NULL, CPPTOML_NULL};
+    }
+    const TomlValue& node = values[value];
+    uint32_t type = node_type(node).load(std::memory_order_acquire);
+    if(DeferredType != type && ExpandedType != type && BrokenType != type) {
+        return {value, data, values};
+    }
+    if(DeferredType == type) {
+        TomlLazy* lazy = reinterpret_cast<TomlLazy*>(static_cast<uintptr_t>(node.size_));
+        std::lock_guard<std::mutex> lock(lazy->mutex_);
+        if(DeferredType == node_type(node).load(std::memory_order_relaxed)) {
+            // the value is parsed alone, its nodes go to a subtree which the node points to from now on
+            TomlParser parser(lazy->allocator_, lazy->deallocator_);
+            parser.kernels_ = current_kernels(false);
+            parser.begin_document(data, data + lazy->size_);
+            auto [n, v] = parser.parse_value(data + node.start_);
+            if(CPPTOML_NULL == n) {
+                // the error stays, the value is not parsed again
+                node_type(node).store(BrokenType, std::memory_order_release);
+                return {Invalid, CPPTOML_NULL, CPPTOML_NULL};
+            }
+            TomlSubtree* subtree = new(lazy->allocator_(sizeof(TomlSubtree))) TomlSubtree{node.start_, parser.values_, v, lazy->subtrees_};
+            parser.values_ = CPPTOML_NULL;
+            lazy->subtrees_ = subtree;
+            const_cast<TomlValue&>(node).start_ = reinterpret_cast<uintptr_t>(subtree);
+            node_type(node).store(ExpandedType, std::memory_order_release);
+        }
+        type = node_type(node).load(std::memory_order_relaxed);
+    }
+    if(BrokenType == type) {
+        return {Invalid, CPPTOML_NULL, CPPTOML_NULL};
+    }
+    const TomlSubtree* subtree = reinterpret_cast<const TomlSubtree*>(static_cast<uintptr_t>(node.start_));
+    return {subtree->root_, data, subtree->values_};
+}
+
+bool TomlParser::expand_lazy()
+{
+    // Deferred values are parsed into this buffer, then no node points to a subtree.
+    TomlLazy* lazy = lazy_;
+    lazy_ = CPPTOML_NULL;
+    uint32_t count = size_;
+    bool result = true;
+    for(uint32_t i = 0; result && i < count; ++i) {
+        uint64_t start = 0;
+        switch(values_[i].type_) {
+        case DeferredType:
+            start = values_[i].start_;
+            break;
+        case ExpandedType:
+            start = reinterpret_cast<const TomlSubtree*>(static_cast<uintptr_t>(values_[i].start_))->start_;
+            break;
+        case BrokenType:
+            result = false;
+            continue;
+        default:
+            continue;
+        }
+        auto [n, v] = parse_value(begin_ + start);
+        if(CPPTOML_NULL == n) {
+            node_type(values_[i]).store(BrokenType, std::memory_order_release);
+            result = false;
+            break;
+        }
+        values_[i] = {values_[v].start_, values_[v].size_, values_[i].next_, values_[v].type_};
+    }
+    lazy_ = lazy;
+    return result;
+}
+
+void TomlParser::release_lazy()
+{
+    if(CPPTOML_NULL == lazy_) {
+        return;
+    }
+    for(TomlSubtree* subtree = lazy_->subtrees_; CPPTOML_NULL != subtree;) {
+        TomlSubtree* next = subtree->next_;
+        deallocator_(subtree->values_);
+        deallocator_(subtree);
+        subtree = next;
+    }
+    lazy_->~TomlLazy();
+    deallocator_(lazy_);
+    lazy_ = CPPTOML_NULL;
+}
+
+char* TomlParser::allocate_padded(uint64_t size) const
+{
+    char* buffer = reinterpret_cast<char*>(allocator_(static_cast<size_t>(size + Padding)));
+    if(CPPTOML_NULL != buffer) {
+        ::memset(buffer + size, 0, Padding);
+    }
+    return buffer;
+}
+
+void TomlParser::deallocate_padded(char* buffer) const
+{
+    deallocator_(buffer);
+}
+
+void TomlParser::begin_document(const char* begin, const char* end)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(CPPTOML_NULL != end);
+    CPPTOML_ASSERT(begin <= end);
+    begin_ = begin;
+    end_ = end;
+    current_ = Invalid;
+    size_ = 0;
+    array_table_.array_ = Invalid;
+    if(0 < tails_.size_) {
+        ::memset(tails_.slots_, 0xFF, sizeof(ChildTail) * tails_.capacity_);
+        tails_.size_ = 0;
+    }
+    if(0 < entries_.size_) {
+        ::memset(entries_.slots_, 0xFF, sizeof(KeyEntry) * entries_.capacity_);
+        entries_.size_ = 0;
+    }
+    if(CPPTOML_NULL != file_.address_ && begin != file_.address_) {
+        // another document replaces the one of parse_file
+        release_file();
+    }
+    header_path_.size_ = 0;
+    key_path_.size_ = 0;
+    resume_ = 0;
+    reset_keys();
+    if(CPPTOML_NULL == frames_) {
+        frames_ = reinterpret_cast<Frame*>(allocator_(sizeof(Frame) * MaxNesting));
+    }
+    // subtrees of the last document go, interned keys are not deferred
+    release_lazy();
+    if(OptionLazy == (options_ & (OptionLazy | OptionInternKeys))) {
+        lazy_ = new(allocator_(sizeof(TomlLazy))) TomlLazy(allocator_, deallocator_);
+    }
+    current_ = add_table();
+}
+
+bool TomlParser::parse_document(const char* begin, const char* end)
+{
+    begin_document(begin, end);
+    bool result = kernels_->padded_ ? parse_expressions<true>(bom(begin_)) : parse_expressions(bom(begin_));
+    if(!result) {
+        return false;
+    }
+    if(0 != (options_ & OptionValidate)) {
+        return validate();
+    }
+    return true;
+}
+
+template<bool Padded>
+bool TomlParser::parse_expressions(const char* str)
+{
+    while(str < end_) {
+        if(CPPTOML_NULL != pipeline_) {
+            // frees the ring for the producer
+            pipeline_->validated(str);
+        }
+        // only this loop stops at the end, the padded lexer stops at the zero after it
+        str = parse_expression<Padded>(str);
+        if(CPPTOML_NULL == str) {
+            return false;
+        }
+        const char* next = newline<Padded>(str);
+        if(str == next && str < end_) {
+            return false;
+        }
+        str = next;
+    }
+    if (str < end_) {
+        return false;
+    }
+    return true;
+}
+
+bool TomlParser::parse_parallel(const char* begin, const char* end, uint32_t threads)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(begin <= end);
+    kernels_ = current_kernels(false);
+    threads_ = (0 != (options_ & OptionInternKeys) || threads <= 0) ? 1 : threads;
+    uint64_t size = static_cast<uint64_t>(end - begin);
+    if(size / MinChunk < threads) {
+        threads = static_cast<uint32_t>(size / MinChunk);
+    }
+    if(threads <= 1 || 0 != (options_ & OptionInternKeys)) {
+        return parse_document(begin, end);
+    }
+    const char** bounds = reinterpret_cast<const char**>(allocator_(sizeof(const char*) * (threads + 1)));
+    uint32_t count = 0;
+    bounds[0] = begin;
+    for(uint32_t i = 1; i < threads; ++i) {
+        const char* point = split_point((std::max)(begin + size * i / threads, bounds[count]), end);
+        if(point < end) {
+            bounds[++count] = point;
+        }
+    }
+    bounds[++count] = end;
+    if(count <= 1) {
+        deallocator_(bounds);
+        return parse_document(begin, end);
+    }
+
+    // The caller parses the first chunk into this parser, the others go to their own parsers.
+    // A chunk which is not closed at its end fails, then the serial parse decides.
+    const TomlKernels* kernels = kernels_;
+    TomlParser* chunks = reinterpret_cast<TomlParser*>(allocator_(sizeof(TomlParser) * (count - 1)));
+    std::thread* workers = reinterpret_cast<std::thread*>(allocator_(sizeof(std::thread) * (count - 1)));
+    bool* results = reinterpret_cast<bool*>(allocator_(sizeof(bool) * (count - 1)));
+    for(uint32_t i = 0; i < (count - 1); ++i) {
+        new(&chunks[i]) TomlParser(allocator_, deallocator_);
+        new(&workers[i]) std::thread([results, chunks, begin, bounds, kernels, i]() {
+            results[i] = chunks[i].parse_chunk(begin, bounds[i + 1], bounds[i + 2], kernels);
+        });
+    }
+    begin_document(begin, bounds[1]);
+    bool result = parse_expressions(bom(begin_));
+    for(uint32_t i = 0; i < (count - 1); ++i) {
+        workers[i].join();
+        workers[i].~thread();
+        result = result && results[i];
+    }
+    if(result) {
+        // Chunks are moved behind this buffer in parallel, then linked in order.
+        uint32_t* bases = reinterpret_cast<uint32_t*>(allocator_(sizeof(uint32_t) * (count - 1)));
+        uint32_t nodes = size_;
+        for(uint32_t i = 0; i < (count - 1); ++i) {
+            bases[i] = nodes;
+            nodes += chunks[i].size_;
+        }
+        reserve(nodes);
+        for(uint32_t i = 1; i < (count - 1); ++i) {
+            new(&workers[i]) std::thread([this, chunks, bases, i]() {
+                move_chunk(chunks[i], bases[i], 0);
+            });
+        }
+        move_chunk(chunks[0], bases[0], 0);
+        for(uint32_t i = 1; i < (count - 1); ++i) {
+            workers[i].join();
+            workers[i].~thread();
+        }
+        size_ = nodes;
+        for(uint32_t i = 0; i < (count - 1) && result; ++i) {
+            result = merge_chunk(chunks[i], bases[i]);
+        }
+        deallocator_(bases);
+    }
+    for(uint32_t i = 0; i < (count - 1); ++i) {
+        chunks[i].~TomlParser();
+    }
+    deallocator_(results);
+    deallocator_(workers);
+    deallocator_(chunks);
+    deallocator_(bounds);
+    if(!result) {
+        return parse_document(begin, end);
+    }
+    end_ = end;
+    if(0 != (options_ & OptionValidate)) {
+        return validate();
+    }
+    return true;
+}
+
+bool TomlParser::parse_chunk(const char* document, const char* begin, const char* end, const TomlKernels* kernels)
+{
+    kernels_ = kernels;
+    begin_document(document, end);
+    headers_.record_ = true;
+    headers_.size_ = 0;
+    if(!parse_expressions(begin)) {
+        return false;
+    }
+    std::sort(headers_.tables_, headers_.tables_ + headers_.size_);
+    return true;
+}
+
+void TomlParser::move_chunk(const TomlParser& chunk, uint32_t base, uint64_t shift)
+{
+    // Links move by base, scalars and keys by shift when the chunk was parsed as a document of its own.
+    CPPTOML_ASSERT((base + chunk.size_) <= capacity_);
+    for(uint32_t i = 0; i < chunk.size_; ++i) {
+        TomlValue value = chunk.values_[i];
+        switch(static_cast<TomlType>(value.type_)) {
+        case TomlType::Table:
+        case TomlType::Array:
+            if(Invalid != value.start_) {
+                value.start_ += base;
+            }
+            break;
+        case TomlType::KeyValue:
+            value.start_ += base;
+            if(Invalid != value.size_) {
+                value.size_ += base;
+            }
+            break;
+        default:
+            value.start_ += shift;
+            break;
+        }
+        if(Invalid != value.next_) {
+            value.next_ += base;
+        }
+        values_[base + i] = value;
+    }
+}
+
+bool TomlParser::merge_chunk(const TomlParser& chunk, uint32_t base)
+{
+    if(!merge_table(0, base, chunk, base, 0)) {
+        return false;
+    }
+    // the last [[header]] of the chunk is the last so far, its array was continued by merge_table or moved as it is
+    const ArrayTableCache& cache = chunk.array_table_;
+    if(Invalid != cache.array_ && (cache.tail_ + base) != array_table_.tail_) {
+        array_table_ = {cache.key_, cache.size_, cache.array_ + base, cache.tail_ + base};
+    }
+    return true;
+}
+
+bool TomlParser::merge_table(uint32_t table, uint32_t source, const TomlParser& chunk, uint32_t base, int32_t depth)
+{
+    static constexpr uint64_t IndexedEntries = 16;
+    if(MaxNesting <= depth) {
+        return false;
+    }
+    // Entries of large tables, like the root of a document of sections, are indexed to keep merging linear.
+    uint32_t* slots = CPPTOML_NULL;
+    uint32_t mask = 0;
+    uint64_t count = values_[table].size_ + values_[source].size_;
+    if(IndexedEntries < count) {
+        uint64_t capacity = 64;
+        while(capacity < count * 2) {
+            capacity <<= 1;
+        }
+        slots = reinterpret_cast<uint32_t*>(allocator_(static_cast<size_t>(sizeof(uint32_t) * capacity)));
+        ::memset(slots, 0xFF, static_cast<size_t>(sizeof(uint32_t) * capacity));
+        mask = static_cast<uint32_t>(capacity - 1);
+    }
+    auto probe = [this, slots, mask](uint32_t keyvalue) {
+        const TomlValue& key = values_[values_[keyvalue].start_];
+        const char* s0 = begin_ + key.start_;
+        const char* e0 = s0 + key.size_;
+        uint32_t slot = key_hash(s0, e0) & mask;
+        while(Invalid != slots[slot]) {
+            const TomlValue& other = values_[values_[slots[slot]].start_];
+            const char* s1 = begin_ + other.start_;
+            if(TomlParser::strcmp(s0, e0, s1, s1 + other.size_)) {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    };
+
+    uint32_t tail = Invalid;
+    for(uint32_t node = static_cast<uint32_t>(values_[table].start_); Invalid != node; node = values_[node].next_) {
+        tail = node;
+        if(CPPTOML_NULL != slots) {
+            slots[probe(node)] = node;
+        }
+    }
+    bool result = true;
+    uint32_t node = static_cast<uint32_t>(values_[source].start_);
+    while(result && Invalid != node) {
+        uint32_t next = values_[node].next_;
+        uint32_t slot = 0;
+        uint32_t exist = Invalid;
+        if(CPPTOML_NULL != slots) {
+            slot = probe(node);
+            exist = slots[slot];
+        } else {
+            const TomlValue& key = values_[values_[node].start_];
+            exist = find_keyvalue(table, begin_ + key.start_, begin_ + key.start_ + key.size_);
+        }
+        if(Invalid == exist) {
+            values_[node].next_ = Invalid;
+            if(Invalid == tail) {
+                values_[table].start_ = node;
+            } else {
+                values_[tail].next_ = node;
+            }
+            values_[table].size_ += 1;
+            tail = node;
+            if(CPPTOML_NULL != slots) {
+                slots[slot] = node;
+            }
+            node = next;
+            continue;
+        }
+        // Entries of a chunk come from its headers, an implicit table or an array of tables.
+        uint32_t target = static_cast<uint32_t>(values_[exist].size_);
+        uint32_t value = static_cast<uint32_t>(values_[node].size_);
+        if(static_cast<uint32_t>(TomlType::Table) == values_[value].type_) {
+            if(chunk.defined(value - base)) {
+                // a [header] defines the table again, whose checks depend on the order
+                result = false;
+            } else if(static_cast<uint32_t>(TomlType::Table) == values_[target].type_) {
+                result = merge_table(target, value, chunk, base, depth + 1);
+            } else if(static_cast<uint32_t>(TomlType::Array) == values_[target].type_) {
+                uint32_t last = find_table(target);
+                result = Invalid != last && merge_table(last, value, chunk, base, depth + 1);
+            } else {
+                result = false;
+            }
+        } else if(static_cast<uint32_t>(TomlType::Array) == values_[value].type_
+                  && static_cast<uint32_t>(TomlType::Array) == values_[target].type_
+                  && (values_[target].size_ <= 0 || static_cast<uint32_t>(TomlType::Table) == values_[values_[target].start_].type_)) {
+            // [[header]]s of the chunk continue the array
+            uint32_t last = Invalid;
+            if(target == array_table_.array_) {
+                last = array_table_.tail_;
+            } else {
+                for(uint32_t i = static_cast<uint32_t>(values_[target].start_); Invalid != i; i = values_[i].next_) {
+                    last = i;
+                }
+            }
+            if(Invalid == last) {
+                values_[target].start_ = values_[value].start_;
+            } else {
+                values_[last].next_ = static_cast<uint32_t>(values_[value].start_);
+            }
+            values_[target].size_ += values_[value].size_;
+            if(value - base == chunk.array_table_.array_) {
+                array_table_ = {chunk.array_table_.key_, chunk.array_table_.size_, target, chunk.array_table_.tail_ + base};
+            } else if(target == array_table_.array_) {
+                array_table_.array_ = Invalid;
+            }
+        } else {
+            result = false;
+        }
+        node = next;
+    }
+    deallocator_(slots);
+    return result;
+}
+
+bool TomlParser::defined(uint32_t table) const
+{
+    return std::binary_search(headers_.tables_, headers_.tables_ + headers_.size_, table);
+}
+
+bool TomlParser::reparse_incremental(const char* begin, const char* end)
+{
+    static constexpr uint64_t SectionSize = 16 * 1024;     //!< the minimum size of a section
+    static constexpr uint64_t ForcedSize = 256 * 1024;     //!< a section is cut at the next header after this
+    static constexpr uint64_t Window = 64;                 //!< bytes from a header line which choose a cut
+    static constexpr uint32_t SectionMask = 3;
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(begin <= end);
+    kernels_ = current_kernels(false);
+    threads_ = 1;
+    if(0 != (options_ & OptionInternKeys)) {
+        clear_sections();
+        return parse_document(begin, end);
+    }
+
+    // Cuts are header lines which a chunk can begin with. A sub table or nested array of the last [[header]]
+    // is not, the chunk could not continue the array.
+    end_ = end;
+    const char* start = bom(begin);
+    uint32_t capacity = static_cast<uint32_t>(static_cast<uint64_t>(end - start) / SectionSize + 2);
+    const char** cuts = reinterpret_cast<const char**>(allocator_(sizeof(const char*) * capacity));
+    uint32_t count = 0;
+    cuts[count++] = start;
+    const char* array = CPPTOML_NULL;
+    uint64_t array_size = 0;
+    for(const char* str = start; str < end;) {
+        const char* line = reinterpret_cast<const char*>(::memchr(str, '\n', static_cast<size_t>(end - str)));
+        if(CPPTOML_NULL == line || end <= (line + 2)) {
+            break;
+        }
+        str = line + 1;
+        if('[' != str[0]) {
+            continue;
+        }
+        const char* key = CPPTOML_NULL;
+        uint64_t size = header_key(str, end, key);
+        bool same = size == array_size && (size <= 0 || 0 == ::memcmp(key, array, static_cast<size_t>(size)));
+        if('[' == str[1]) {
+            // [[key]] continues the array, [[key.sub]] does not
+            same = same && !((key + size) < end && ']' == key[size]);
+            array = key;
+            array_size = size;
+        }
+        uint64_t distance = static_cast<uint64_t>(str - cuts[count - 1]);
+        if(same || distance < SectionSize || (count + 1) >= capacity) {
+            continue;
+        }
+        const char* window = (Window < static_cast<uint64_t>(end - str)) ? str + Window : end;
+        if(ForcedSize <= distance || 0 == (key_hash(str, window) & SectionMask)) {
+            cuts[count++] = str;
+        }
+    }
+    cuts[count] = end;
+
+    // Old sections are found by hash, each is reused once.
+    Section* sections = reinterpret_cast<Section*>(allocator_(sizeof(Section) * count));
+    uint32_t* order = reinterpret_cast<uint32_t*>(allocator_(sizeof(uint32_t) * (sections_.size_ + 1)));
+    for(uint32_t i = 0; i < sections_.size_; ++i) {
+        order[i] = i;
+    }
+    const Section* old = sections_.sections_;
+    std::sort(order, order + sections_.size_, [old](uint32_t x, uint32_t y) {
+        return old[x].hash_ < old[y].hash_;
+    });
+    bool result = true;
+    uint32_t parsed = 0;
+    for(uint32_t i = 0; i < count; ++i) {
+        Section& section = sections[i];
+        section.hash_ = text_hash(cuts[i], cuts[i + 1]);
+        section.size_ = static_cast<uint64_t>(cuts[i + 1] - cuts[i]);
+        section.parser_ = CPPTOML_NULL;
+        uint32_t* found = std::lower_bound(order, order + sections_.size_, section.hash_, [old](uint32_t x, uint64_t hash) {
+            return old[x].hash_ < hash;
+        });
+        for(; found < (order + sections_.size_) && old[*found].hash_ == section.hash_; ++found) {
+            Section& reuse = sections_.sections_[*found];
+            if(CPPTOML_NULL != reuse.parser_ && reuse.size_ == section.size_) {
+                section.parser_ = reuse.parser_;
+                reuse.parser_ = CPPTOML_NULL;
+                break;
+            }
+        }
+        if(CPPTOML_NULL == section.parser_ && result) {
+            TomlParser* parser = new(allocator_(sizeof(TomlParser))) TomlParser(allocator_, deallocator_);
+            ++parsed;
+            if(parser->parse_chunk(cuts[i], cuts[i], cuts[i + 1], kernels_)) {
+                // frames are needed only while parsing
+                deallocator_(parser->frames_);
+                parser->frames_ = CPPTOML_NULL;
+                section.parser_ = parser;
+            } else {
+                parser->~TomlParser();
+                deallocator_(parser);
+                result = false;
+            }
+        }
+    }
+    deallocator_(order);
+    clear_sections();
+    sections_.sections_ = sections;
+    sections_.size_ = count;
+    sections_.parsed_ = parsed;
+
+    if(result) {
+        begin_document(begin, end);
+        uint32_t nodes = size_;
+        for(uint32_t i = 0; i < count; ++i) {
+            nodes += sections[i].parser_->size_;
+        }
+        reserve(nodes);
+        for(uint32_t i = 0; i < count && result; ++i) {
+            uint32_t base = size_;
+            move_chunk(*sections[i].parser_, base, static_cast<uint64_t>(cuts[i] - begin));
+            size_ += sections[i].parser_->size_;
+            result = merge_chunk(*sections[i].parser_, base);
+        }
+    }
+    deallocator_(cuts);
+    if(!result) {
+        return parse_document(begin, end);
+    }
+    if(0 != (options_ & OptionValidate)) {
+        return validate();
+    }
+    return true;
+}
+
+uint32_t TomlParser::reparsed_sections() const
+{
+    return sections_.parsed_;
+}
+
+uint32_t TomlParser::section_count() const
+{
+    return sections_.size_;
+}
+
+void TomlParser::clear_sections()
+{
+    for(uint32_t i = 0; i < sections_.size_; ++i) {
+        if(CPPTOML_NULL != sections_.sections_[i].parser_) {
+            sections_.sections_[i].parser_->~TomlParser();
+            deallocator_(sections_.sections_[i].parser_);
+        }
+    }
+    deallocator_(sections_.sections_);
+    sections_.sections_ = CPPTOML_NULL;
+    sections_.size_ = 0;
+    sections_.parsed_ = 0;
+}
+
+bool TomlParser::parse_append(const char* begin, const char* end, bool final)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(begin <= end);
+    kernels_ = current_kernels(false);
+    threads_ = 1;
+    // interned keys point into the buffer
+    bool resume = 0 < resume_ && 0 < size_ && resume_ <= static_cast<uint64_t>(end - begin)
+                  && (0 == (options_ & OptionInternKeys) || begin == begin_);
+    const char* str = resume ? begin + resume_ : begin;
+    const char* last = final ? end : complete_lines(str, end);
+    uint32_t first = 0;
+    if(resume) {
+        // every offset is from begin_, the state of the last line carries over
+        begin_ = begin;
+        end_ = last;
+        first = size_;
+    } else {
+        begin_document(begin, last);
+        str = bom(begin_);
+    }
+    if(!parse_expressions(str)) {
+        resume_ = 0;
+        return false;
+    }
+    // the last line of a final call may not end, the next text can not continue it
+    resume_ = final ? 0 : static_cast<uint64_t>(last - begin);
+    if(0 != (options_ & OptionValidate)) {
+        return validate_from(first);
+    }
+    return true;
+}
+
+uint64_t TomlParser::appended_size() const
+{
+    return resume_;
+}
+
+bool TomlParser::feed(const char* chunk, uint64_t size)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != chunk || size <= 0);
+    if(!stream_.open_) {
+        stream_.size_ = 0;
+        stream_.open_ = true;
+        stream_.failed_ = false;
+    }
+    if(stream_.failed_) {
+        return false;
+    }
+    if(stream_.capacity_ < (stream_.size_ + size)) {
+        // Grow by double, the parsed lines move with the text.
+        uint64_t capacity = (std::max)(stream_.capacity_ * 2, (std::max)(stream_.size_ + size, static_cast<uint64_t>(4096)));
+        char* text = reinterpret_cast<char*>(allocator_(static_cast<size_t>(capacity)));
+        if(CPPTOML_NULL == text) {
+            stream_.failed_ = true;
+            return false;
+        }
+        if(0 < stream_.size_) {
+            ::memcpy(text, stream_.text_, static_cast<size_t>(stream_.size_));
+        }
+        deallocator_(stream_.text_);
+        stream_.text_ = text;
+        stream_.capacity_ = capacity;
+    }
+    if(0 < size) {
+        ::memcpy(stream_.text_ + stream_.size_, chunk, static_cast<size_t>(size));
+        stream_.size_ += size;
+    }
+    if(!parse_append(stream_.text_, stream_.text_ + stream_.size_)) {
+        stream_.failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool TomlParser::finish()
+{
+    bool open = stream_.open_;
+    stream_.open_ = false;
+    if(open && stream_.failed_) {
+        return false;
+    }
+    const char* begin = (open && CPPTOML_NULL != stream_.text_) ? stream_.text_ : "";
+    const char* end = begin + (open ? stream_.size_ : 0);
+    if(!open || resume_ <= 0) {
+        kernels_ = current_kernels(false);
+        threads_ = 1;
+        return parse_document(begin, end);
+    }
+    // the last line has no newline, or does not close what it opens
+    return parse_append(begin, end, true);
+}
+
+bool TomlParser::parse_events(const char* begin, const char* end, TomlHandler& handler)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(begin <= end);
+    kernels_ = current_kernels(false);
+    threads_ = 1;
+    begin_document(begin, end);
+    // The tree parser checks keys of each expression first, the events of which follow.
+    bool check = 0 != (options_ & OptionCheckKeys);
+    const char* str = bom(begin_);
+    while(str < end_) {
+        if(check && CPPTOML_NULL == parse_expression(str)) {
+            return false;
+        }
+        str = event_expression(str, handler);
+        if(CPPTOML_NULL == str) {
+            return false;
+        }
+        const char* next = newline(str);
+        if(str == next && str < end_) {
+            return false;
+        }
+        str = next;
+    }
+    if(check && 0 != (options_ & OptionValidate)) {
+        return validate();
+    }
+    return true;
+}
+
+std::tuple<const char*, uint32_t> TomlParser::parse_array_parallel(const char* str, uint32_t enclosing)
+{
+    static constexpr uint64_t SliceSize = 256 * 1024;
+    uint32_t capacity = static_cast<uint32_t>(static_cast<uint64_t>(end_ - str) / SliceSize + 1);
+    const char** commas = reinterpret_cast<const char**>(allocator_(sizeof(const char*) * capacity));
+    uint32_t count = 0;
+    const char* close = array_commas(str, end_, SliceSize, commas, capacity, count);
+    if(CPPTOML_NULL == close || static_cast<uint64_t>(close - str) < MinChunk || count <= 0) {
+        deallocator_(commas);
+        return InvalidPair;
+    }
+
+    // Slices between the commas go to idle workers one by one, each worker builds elements in its own buffer.
+    // A slice which does not end at its comma fails, then the serial parse decides.
+    uint32_t slices = count + 1;
+    ArraySlice* slice = reinterpret_cast<ArraySlice*>(allocator_(sizeof(ArraySlice) * slices));
+    for(uint32_t i = 0; i < slices; ++i) {
+        slice[i].begin_ = (0 == i) ? str + 1 : commas[i - 1] + 1;
+        slice[i].end_ = (count == i) ? close : commas[i];
+        slice[i].result_ = false;
+    }
+    deallocator_(commas);
+    uint32_t threads = (std::min)(threads_, slices);
+    TomlParser* workers = reinterpret_cast<TomlParser*>(allocator_(sizeof(TomlParser) * threads));
+    std::thread* runners = reinterpret_cast<std::thread*>(allocator_(sizeof(std::thread) * threads));
+    std::atomic<uint32_t> next(0);
+    const TomlKernels* kernels = current_kernels(false);
+    auto work = [this, workers, slice, slices, kernels, close, enclosing, &next](uint32_t worker) {
+        TomlParser& parser = workers[worker];
+        parser.kernels_ = kernels;
+        parser.options_ = options_ & ~(OptionInternKeys | OptionLazy);
+        parser.begin_document(begin_, close);
+        for(uint32_t i = next.fetch_add(1); i < slices; i = next.fetch_add(1)) {
+            slice[i].worker_ = worker;
+            slice[i].result_ = parser.parse_slice(slice[i], (slices - 1) == i, enclosing + 1);
+        }
+    };
+    for(uint32_t i = 0; i < threads; ++i) {
+        new(&workers[i]) TomlParser(allocator_, deallocator_);
+    }
+    for(uint32_t i = 1; i < threads; ++i) {
+        new(&runners[i]) std::thread(work, i);
+    }
+    work(0);
+    for(uint32_t i = 1; i < threads; ++i) {
+        runners[i].join();
+        runners[i].~thread();
+    }
+
+    bool result = true;
+    TomlType kind = TomlType::Invalid;
+    for(uint32_t i = 0; i < slices && result; ++i) {
+        result = slice[i].result_;
+        if(TomlType::Invalid == slice[i].kind_) {
+            continue;
+        }
+        // arrays are homogeneous
+        if(TomlType::Invalid == kind) {
+            kind = slice[i].kind_;
+        } else if(kind != slice[i].kind_) {
+            result = false;
+        }
+    }
+    uint32_t array = Invalid;
+    if(result) {
+        array = add_array();
+        uint32_t* bases = reinterpret_cast<uint32_t*>(allocator_(sizeof(uint32_t) * threads));
+        uint32_t nodes = size_;
+        for(uint32_t i = 0; i < threads; ++i) {
+            bases[i] = nodes;
+            nodes += workers[i].size_;
+        }
+        reserve(nodes);
+        for(uint32_t i = 1; i < threads; ++i) {
+            new(&runners[i]) std::thread([this, workers, bases, i]() {
+                move_chunk(workers[i], bases[i], 0);
+            });
+        }
+        move_chunk(workers[0], bases[0], 0);
+        for(uint32_t i = 1; i < threads; ++i) {
+            runners[i].join();
+            runners[i].~thread();
+        }
+        size_ = nodes;
+        uint32_t tail = Invalid;
+        for(uint32_t i = 0; i < slices; ++i) {
+            if(Invalid == slice[i].first_) {
+                continue;
+            }
+            uint32_t base = bases[slice[i].worker_];
+            if(Invalid == tail) {
+                values_[array].start_ = slice[i].first_ + base;
+            } else {
+                values_[tail].next_ = slice[i].first_ + base;
+            }
+            values_[array].size_ += slice[i].size_;
+            tail = slice[i].last_ + base;
+        }
+        deallocator_(bases);
+    }
+    for(uint32_t i = 0; i < threads; ++i) {
+        workers[i].~TomlParser();
+    }
+    deallocator_(runners);
+    deallocator_(workers);
+    deallocator_(slice);
+    if(!result) {
+        return InvalidPair;
+    }
+    return {close + 1, array};
+}
+
+bool TomlParser::parse_slice(ArraySlice& slice, bool last, uint32_t enclosing)
+{
+    // the grammar of parse_value for arrays, a comma before the slice asks for a value
+    slice.first_ = Invalid;
+    slice.last_ = Invalid;
+    slice.size_ = 0;
+    slice.kind_ = TomlType::Invalid;
+    bool expect = true;
+    const char* str = slice.begin_;
+    for(;;) {
+        str = ws_comment_newline(str);
+        if(slice.end_ <= str) {
+            break;
+        }
+        if(!expect) {
+            if(',' != str[0]) {
+                return false;
+            }
+            expect = true;
+            ++str;
+            continue;
+        }
+        if(!value(str)) {
+            return false;
+        }
+        auto [n, v] = parse_value(str, enclosing);
+        if(CPPTOML_NULL == n) {
+            return false;
+        }
+        if(!same_kind(slice.kind_, values_[v].type_)) {
+            return false;
+        }
+        if(Invalid == slice.last_) {
+            slice.first_ = v;
+        } else {
+            values_[slice.last_].next_ = v;
+        }
+        slice.last_ = v;
+        slice.size_ += 1;
+        expect = false;
+        str = n;
+    }
+    // the comma after a slice needs a value before it
+    return str == slice.end_ && (last || !expect);
+}
+
+void TomlParser::set_options(uint32_t options)
+{
+    options_ = options;
+}
+
+uint32_t TomlParser::get_options() const
+{
+    return options_;
+}
+
+uint32_t TomlParser::intern(const char* begin, const char* end)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(begin <= end);
+    bool pin = keys_.pinned_ == keys_.size_;
+    uint32_t id = intern_key(begin, end, key_hash(begin, end));
+    if(pin) {
+        keys_.pinned_ = keys_.size_;
+    }
+    return id;
+}
+
+bool TomlParser::validate() const
+{
+    return validate_from(0);
+}
+
+bool TomlParser::validate_from(uint32_t first) const
+{
+    // Visit the node buffer in order, a container only checks its direct children.
+    for(uint32_t i = first; i < size_; ++i) {
+        switch(static_cast<TomlType>(values_[i].type_)) {
+        case TomlType::Array:
+            if(!validate_array(values_, i)) {
+                return false;
+            }
+            break;
+        case TomlType::KeyValue:
+            if(size_ <= values_[i].size_) {
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+TomlProxy TomlParser::root() const
+{
+    if(size_ <= 0) {
+        return {Invalid, CPPTOML_NULL, CPPTOML_NULL};
+    }
+    return {0, begin_, values_};
+}
+
+TomlDocument TomlParser::share()
+{
+    if(size_ <= 0) {
+        return TomlDocument();
+    }
+    if(CPPTOML_NULL != lazy_ && !expand_lazy()) {
+        return TomlDocument();
+    }
+    // the text follows the shared block in the same allocation
+    uint64_t length = static_cast<uint64_t>(end_ - begin_);
+    void* memory = allocator_(static_cast<size_t>(sizeof(TomlShared) + length));
+    if(CPPTOML_NULL == memory) {
+        return TomlDocument();
+    }
+    TomlShared* shared = new(memory) TomlShared(deallocator_, values_);
+    char* text = reinterpret_cast<char*>(shared + 1);
+    if(0 < length) {
+        ::memcpy(text, begin_, static_cast<size_t>(length));
+    }
+    shared->text_ = text;
+    values_ = CPPTOML_NULL;
+    capacity_ = 0;
+    size_ = 0;
+    release_file();
+    release_lazy();
+    return TomlDocument(shared);
+}
+
+template<bool Padded>
+int64_t TomlParser::next_symbol(const char*& str) const
+{
+    const uint8_t* u = reinterpret_cast<const uint8_t*>(str);
+    if(u[0] <= 0x7FU) {
+        str += 1;
+        return u[0];
+    }
+    if(0b1100'0000U == (u[0] & 0b1110'0000U)) {
+        if(!Padded && end_ <= (str + 1)) {
+            return -1;
+        }
+        if(0b1000'0000U != (u[1] & 0b1100'0000U)) {
+            return -1;
+        }
+        int64_t c = ((static_cast<int64_t>(u[0]) & 0b1'1111U) << 6)
+                    + (static_cast<int64_t>(u[1]) & 0b11'1111U);
+        if(c < 0x80) {
+            return -1;
+        }
+        str += 2;
+        return c;
+    }
+    if(0b1110'0000U == (u[0] & 0b1111'0000U)) {
+        if(!Padded && end_ <= (str + 2)) {
+            return -1;
+        }
+        if(0b1000'0000U != (u[1] & 0b1100'0000U)) {
+            return -1;
+        }
+        if(0b1000'0000U != (u[2] & 0b1100'0000U)) {
+            return -1;
+        }
+        int64_t c = ((static_cast<int64_t>(u[0]) & 0b1111U) << 12)
+                    + ((static_cast<int64_t>(u[1]) & 0b11'1111U) << 6)
+                    + ((static_cast<int64_t>(u[2]) & 0b11'1111U));
+        if(c < 0x800) {
+            return -1;
+        }
+        str += 3;
+        return c;
+    }
+    if(0b1111'0000U == (u[0] & 0b1111'1000U)) {
+        if(!Padded && end_ <= (str + 3)) {
+            return -1;
         }
         if(0b1000'0000U != (u[1] & 0b1100'0000U)) {
             return -1;
         }
-        if(0b1000'0000U != (u[2] & 0b1100'0000U)) {
-            return -1;
+        if(0b1000'0000U != (u[2] & 0b1100'0000U)) {
+            return -1;
+        }
+        if(0b1000'0000U != (u[3] & 0b1100'0000U)) {
+            return -1;
+        }
+        int64_t c = ((static_cast<int64_t>(u[0]) & 0b111U) << 18)
+                    + ((static_cast<int64_t>(u[1]) & 0b11'1111U) << 12)
+                    + ((static_cast<int64_t>(u[2]) & 0b11'1111U) << 6)
+                    + ((static_cast<int64_t>(u[3]) & 0b11'1111U));
+        if(c < 0x1'0000 || 0x10'FFFF < c) {
+            return -1;
+        }
+        str += 4;
+        return c;
+    }
+    return -1;
+}
+
+template<bool Padded>
+bool TomlParser::parse_unquated_key_char(const char*& str) const
+{
+    const char* next = str;
+    int64_t c = next_symbol<Padded>(next);
+    if('a' <= c && c <= 'z') {
+        str = next;
+        return true;
+    }
+    if('A' <= c && c <= 'Z') {
+        str = next;
+        return true;
+    }
+    if('0' <= c && c <= '9') {
+        str = next;
+        return true;
+    }
+    switch(c) {
+    case 0x2D:
+    case 0x5F:
+    case 0xB2:
+    case 0xB3:
+    case 0xB9:
+    case 0xBC:
+    case 0xBD:
+    case 0xBE:
+        str = next;
+        return true;
+    }
+    if(0xC0 <= c && c <= 0xD6) {
+        str = next;
+        return true;
+    }
+    if(0xD8 <= c && c <= 0xF6) {
+        str = next;
+        return true;
+    }
+    if(0xF8 <= c && c <= 0x37D) {
+        str = next;
+        return true;
+    }
+    if(0x37F <= c && c <= 0x1FFF) {
+        str = next;
+        return true;
+    }
+    if((0x200C <= c && c <= 0x200D) || (0x203F <= c && c <= 0x2040)) {
+        str = next;
+        return true;
+    }
+    if((0x2070 <= c && c <= 0x218F) || (0x2460 <= c && c <= 0x24FF)) {
+        str = next;
+        return true;
+    }
+    if((0x2C00 <= c && c <= 0x2FEF) || (0x3001 <= c && c <= 0xD7FF)) {
+        str = next;
+        return true;
+    }
+    if((0xF900 <= c && c <= 0xFDCF) || (0xFDF0 <= c && c <= 0xFFFD)) {
+        str = next;
+        return true;
+    }
+    if(0x10000 <= c && c <= 0xEFFFF) {
+        str = next;
+        return true;
+    }
+    return false;
+}
+
+template<bool Padded>
+bool TomlParser::basic_char(const char*& str) const
+{
+    switch(str[0]) {
+    case 0x09:
+    case 0x20:
+    case 0x21:
+        ++str;
+        return true;
+    case 0x5C: // espace
+        return escaped<Padded>(str);
+    }
+    if(0x23 <= str[0] && str[0] <= 0x7E) {
+        ++str;
+        return true;
+    }
+    const char* next = parse_non_ascii<Padded>(str);
+    if(CPPTOML_NULL != next && next != str) {
+        str = next;
+        return true;
+    }
+    return false;
+}
+
+template<bool Padded>
+bool TomlParser::literal_char(const char*& str) const
+{
+    switch(str[0]) {
+    case 0x09:
+    case 0x20:
+        ++str;
+        return true;
+    }
+    if(0x20 <= str[0] && str[0] <= 0x26) {
+        ++str;
+        return true;
+    }
+    if(0x28 <= str[0] && str[0] <= 0x7E) {
+        ++str;
+        return true;
+    }
+    const char* next = parse_non_ascii<Padded>(str);
+    if(CPPTOML_NULL != next && next != str) {
+        str = next;
+        return true;
+    }
+    return false;
+}
+
+template<bool Padded>
+bool TomlParser::escaped(const char*& str) const
+{
+    CPPTOML_ASSERT(0x5C == str[0]);
+    const char* next = str + 1;
+    if(!Padded && end_ <= next) {
+        return false;
+    }
+    switch(next[0]) {
+    case 0x22:
+    case 0x5C:
+    case 0x62:
+    case 0x65:
+    case 0x66:
+    case 0x6E:
+    case 0x72:
+    case 0x74:
+        str = next + 1;
+        return true;
+    case 0x55:
+    case 0x75: {
+        str = next + 1;
+        const char* digits = str;
+        bool result = 0x55 == next[0] ? parse_8hexdig<Padded>(str) : parse_4hexdig<Padded>(str);
+        if(!result) {
+            return false;
+        }
+        // only unicode scalar values
+        uint32_t c = 0;
+        for(; digits < str; ++digits) {
+            uint32_t d = static_cast<uint8_t>(digits[0]);
+            c = (c << 4) | (d <= '9' ? d - '0' : (d | 0x20U) - 'a' + 10);
+        }
+        return c < 0xD800 || (0xE000 <= c && c <= 0x10'FFFF);
+    }
+    //case 0x78:
+    //    str = next + 1;
+    //    return parse_2hexdig(str);
+    }
+    return false;
+}
+
+bool TomlParser::parse_2hexdig(const char*& str) const
+{
+    if(end_ <= (str + 1)) {
+        return false;
+    }
+    if(!hexgidit(str[0]) || !hexgidit(str[1])) {
+        return false;
+    }
+    str += 2;
+    return true;
+}
+
+template<bool Padded>
+bool TomlParser::parse_4hexdig(const char*& str) const
+{
+    if(!Padded && end_ <= (str + 3)) {
+        return false;
+    }
+    if(!hexgidit(str[0]) || !hexgidit(str[1]) || !hexgidit(str[2]) || !hexgidit(str[3])) {
+        return false;
+    }
+    str += 4;
+    return true;
+}
+
+template<bool Padded>
+bool TomlParser::parse_8hexdig(const char*& str) const
+{
+    if(!Padded && end_ <= (str + 7)) {
+        return false;
+    }
+    for(uint32_t i = 0; i < 8; ++i) {
+        if(!hexgidit(str[i])) {
+            return false;
+        }
+    }
+    str += 8;
+    return true;
+}
+
+bool TomlParser::hexgidit(char c)
+{
+    switch(c) {
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+    case 'A':
+    case 'B':
+    case 'C':
+    case 'D':
+    case 'E':
+    case 'F':
+    case 'a':
+    case 'b':
+    case 'c':
+    case 'd':
+    case 'e':
+    case 'f':
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool TomlParser::digit(char c)
+{
+    return '0' <= c && c <= '9';
+}
+
+template<bool Padded>
+uint64_t TomlParser::load_word(const char* str) const
+{
+    // Bytes past the end read as zero, which never match a pattern.
+    uint64_t word = 0;
+    if(Padded || 8 <= (end_ - str)) {
+        ::memcpy(&word, str, sizeof(uint64_t));
+    } else if(Padded || str < end_) {
+        ::memcpy(&word, str, static_cast<size_t>(end_ - str));
+    }
+    return word;
+}
+
+const char* TomlParser::bom(const char* str) const
+{
+    std::ptrdiff_t size = std::distance(str, end_);
+    if(3 <= size) {
+        if(0xEF == str[0] && 0xBB == str[1] && 0xBF == str[2]) {
+            str += 3;
+        }
+    }
+    return str;
+}
+
+template<bool Padded>
+const char* TomlParser::newline(const char* str) const
+{
+    while(Padded || str < end_) {
+        switch(str[0]) {
+        case 0x0A:
+        case 0x0D:
+            ++str;
+            break;
+        default:
+            return str;
+        }
+    }
+    return str;
+}
+
+const char* TomlParser::whitespace(const char* str) const
+{
+    return kernels_->whitespace_(str, end_);
+}
+
+template<bool Padded>
+const char* TomlParser::comment(const char* str) const
+{
+    if((!Padded && end_ <= str) || '#' != str[0]) {
+        return str;
+    }
+    ++str;
+    while(Padded || str < end_) {
+        // non-eol
+        str = kernels_->non_eol_(str, end_);
+        if(!Padded && end_ <= str) {
+            break;
+        }
+        // non-ascii
+        const char* next = parse_non_ascii<Padded>(str);
+        if(CPPTOML_NULL == next) {
+            return CPPTOML_NULL;
+        }
+        if(next == str) {
+            break;
+        }
+        str = next;
+    }
+    return str;
+}
+
+template<bool Padded>
+const char* TomlParser::ws_comment_newline(const char* str) const
+{
+    while(Padded || str < end_) {
+        switch(str[0]) {
+        case 0x09:
+        case 0x20:
+            str = whitespace(str);
+            break;
+        case 0x0A:
+        case 0x0D:
+            str = newline<Padded>(str);
+            break;
+        case 0x23:
+            str = comment<Padded>(str);
+            break;
+        default:
+            return str;
+        }
+    }
+    return str;
+}
+
+template<bool Padded>
+const char* TomlParser::parse_non_ascii(const char* str) const
+{
+    if(CPPTOML_NULL != pipeline_) {
+        // a run of non-ascii bytes of a validated block consists of whole characters
+        const char* validated = pipeline_->validated(str);
+        if(str < validated && 0x80U <= static_cast<uint8_t>(str[0])) {
+            const char* next = str + 1;
+            while(next < validated && 0x80U <= static_cast<uint8_t>(next[0])) {
+                ++next;
+            }
+            return next;
+        }
+    }
+    const char* next = str;
+    int64_t c = next_symbol<Padded>(next);
+    if(c < 0) {
+        return CPPTOML_NULL;
+    }
+    if(0x80 <= c && c <= 0xD7FF) {
+        return next;
+    }
+    if(0xE000 <= c && c <= 0x10FFFF) {
+        return next;
+    }
+    return str;
+}
+
+template<bool Padded>
+const char* TomlParser::parse_expression(const char* str)
+{
+    std::tuple<const char*, uint32_t> pair;
+    str = whitespace(str);
+    if(!Padded && end_ <= str) {
+        return str;
+    }
+    switch(str[0]) {
+    case '"': // quated-key
+        pair = parse_keyvalue<Padded>(str);
+        break;
+    case '\'': // quated-key
+        pair = parse_keyvalue<Padded>(str);
+        break;
+    case '[': // table
+        pair = parse_table<Padded>(str);
+        break;
+    case '#':
+        str = comment<Padded>(str);
+        pair = {str, Invalid};
+        break;
+    default: {
+        const char* next = str;
+        if(!parse_unquated_key_char<Padded>(next)) {
+            return str;
+        }
+        pair = parse_keyvalue<Padded>(str);
+    } break;
+    }
+    if(CPPTOML_NULL == std::get<0>(pair)) {
+        return CPPTOML_NULL;
+    }
+    str = std::get<0>(pair);
+    str = whitespace(str);
+    str = comment<Padded>(str);
+    return str;
+}
+
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_keyvalue(const char* str)
+{
+    std::tuple<const char*, uint32_t, uint32_t> keyvalue = parse_key<Padded>(str, current_, KeyPlace::KeyValue);
+    if(CPPTOML_NULL == std::get<0>(keyvalue) || (!Padded && end_ <= std::get<0>(keyvalue))) {
+        return InvalidPair;
+    }
+    str = std::get<0>(keyvalue);
+    if(0x3D != str[0]) {
+        return InvalidPair;
+    }
+    str = whitespace(str + 1);
+    if(!Padded && end_ <= str) {
+        return InvalidPair;
+    }
+    std::tuple<const char*, uint32_t> value = parse_value<Padded>(str);
+    if(CPPTOML_NULL == std::get<0>(value)) {
+        return InvalidPair;
+    }
+    values_[std::get<1>(keyvalue)].size_ = std::get<1>(value);
+    append(std::get<2>(keyvalue), std::get<1>(keyvalue));
+    return {std::get<0>(value), std::get<1>(keyvalue)};
+}
+
+template<bool Padded>
+bool TomlParser::keyvalue(const char* str) const
+{
+    if(!Padded && end_ <= str) {
+        return false;
+    }
+    switch(str[0]) {
+    case '"':
+    case '\'':
+        return true;
+    default: {
+        const char* next = str;
+        if(parse_unquated_key_char<Padded>(next)) {
+            return true;
+        }
+    } break;
+    }
+    return false;
+}
+
+template<bool Padded>
+std::tuple<const char*, uint32_t, uint32_t> TomlParser::parse_key(const char* str, uint32_t current, KeyPlace place)
+{
+    // Sibling sections share long prefixes, the leading segments which match the last key resume from its tables.
+    PathCache& path = (KeyPlace::KeyValue == place) ? key_path_ : header_path_;
+    if(path.start_ != current) {
+        path.start_ = current;
+        path.size_ = 0;
+    }
+    uint32_t depth = 0;
+    bool record = true;
+    for(;;) {
+        const char* begin = str;
+        switch(str[0]) {
+        case '"': // quated-key
+            str = parse_basic_string<Padded>(str);
+            break;
+        case '\'': // quated-key
+            str = parse_literal_string<Padded>(str);
+            break;
+        default:
+            const char* next = str;
+            if(!parse_unquated_key_char<Padded>(next)) {
+                return InvalidTuple;
+            }
+            str = parse_unquated_key<Padded>(str);
+            break;
+        }
+        if(CPPTOML_NULL == str) {
+            return InvalidTuple;
+        }
+        const char* end = str;
+        str = whitespace(str);
+        if(!Padded && end_ <= str) {
+            return InvalidTuple;
+        }
+        if(str[0] != '.') {
+            uint32_t id = Invalid;
+            uint32_t exist = Invalid;
+            if(0 != (options_ & OptionInternKeys)) {
+                id = intern_key(begin, end, key_hash(begin, end));
+                exist = find_keyvalue(current, id);
+            } else {
+                exist = find_keyvalue(current, begin, end);
+            }
+            if(Invalid != exist) {
+                switch(place) {
+                case KeyPlace::Table: {
+                    uint64_t table = values_[exist].size_;
+                    if(static_cast<uint32_t>(TomlType::Table) != values_[table].type_) {
+                        return InvalidTuple;
+                    }
+                    if(!has_child_table(static_cast<uint32_t>(table))) {
+                        return InvalidTuple;
+                    }
+                    return {str, exist, current};
+                }
+                case KeyPlace::ArrayTable: {
+                    uint32_t array = static_cast<uint32_t>(values_[exist].size_);
+                    if(static_cast<uint32_t>(TomlType::Array) != values_[array].type_) {
+                        return InvalidTuple;
+                    }
+                    return {str, exist, current};
+                }
+                default:
+                    // A key/value pair never redefines a key, even a table made by a header or a dotted key.
+                    return InvalidTuple;
+                }
+            }
+            uint32_t keyvalue = add_keyvalue(begin, end, id);
+            return {str, keyvalue, current};
+        }
+        uint32_t size = static_cast<uint32_t>(end - begin);
+        uint32_t hash = key_hash(begin, end);
+        if(depth < path.size_) {
+            const PathSegment& segment = path.segments_[depth];
+            if(hash == segment.hash_ && size == segment.size_ && 0 == ::memcmp(begin_ + segment.key_, begin, size)) {
+                current = segment.table_;
+                ++depth;
+                str = whitespace(str + 1);
+                if(!Padded && end_ <= str) {
+                    return InvalidTuple;
+                }
+                continue;
+            }
+            path.size_ = depth;
+        }
+        uint32_t id = Invalid;
+        uint32_t exist = Invalid;
+        if(0 != (options_ & OptionInternKeys)) {
+            id = intern_key(begin, end, hash);
+            exist = find_keyvalue(current, id);
+        } else {
+            exist = find_keyvalue(current, begin, end);
+        }
+        if(Invalid != exist) {
+            current = static_cast<uint32_t>(values_[exist].size_);
+            if(Invalid == current) {
+                return InvalidTuple;
+            }
+            if (static_cast<uint32_t>(TomlType::Table) == values_[current].type_) {
+            } else if(static_cast<uint32_t>(TomlType::Array) == values_[current].type_) {
+                uint32_t table = Invalid;
+                if(values_[current].size_ <= 0) {
+                    table = add_table();
+                    append(current, table);
+                } else {
+                    table = find_table(current);
+                    if(Invalid == table) {
+                        table = add_table();
+                        append(current, table);
+                    }
+                }
+                if(Invalid == table) {
+                    return InvalidTuple;
+                }
+                current = table;
+                // The last table of an array moves with every [[header]], nothing below it is remembered.
+                record = false;
+            } else {
+                return InvalidTuple;
+            }
+        } else {
+            uint32_t keyvalue = add_keyvalue(begin, end, id);
+            if(KeyPlace::ArrayTable == place) {
+                //uint32_t array = add_array();
+                //values_[keyvalue].size_ = array;
+                //append(current, keyvalue);
+
+                uint32_t table = add_table();
+                values_[keyvalue].size_ = table;
+                append(current, keyvalue);
+                current = table;
+
+            } else {
+                uint32_t table = add_table();
+                values_[keyvalue].size_ = table;
+                append(current, keyvalue);
+                current = table;
+            }
+        }
+        if(record && depth < PathDepth) {
+            path.segments_[depth] = {static_cast<uint64_t>(begin - begin_), size, hash, current};
+            path.size_ = depth + 1;
+        }
+        ++depth;
+        str = whitespace(str + 1);
+        if(!Padded && end_ <= str) {
+            return InvalidTuple;
+        }
+    }
+}
+
+template<bool Padded>
+const char* TomlParser::parse_unquated_key(const char* str) const
+{
+    while(Padded || str < end_) {
+        if(!parse_unquated_key_char<Padded>(str)) {
+            return str;
+        }
+    }
+    return str;
+}
+
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_value(const char* str, uint32_t enclosing)
+{
+    if(CPPTOML_NULL != lazy_ && ('[' == str[0] || '{' == str[0])) {
+        // only the brackets are matched, resolve parses the value when a proxy reaches it
+        uint32_t count = 0;
+        const char* close = array_commas(str, end_, ~0ULL, CPPTOML_NULL, 0, count);
+        if(CPPTOML_NULL == close) {
+            return InvalidPair;
+        }
+        uint32_t value = add();
+        values_[value] = {static_cast<uint64_t>(str - begin_), reinterpret_cast<uintptr_t>(lazy_), Invalid, DeferredType};
+        lazy_->size_ = static_cast<uint64_t>(end_ - begin_);
+        return {close + 1, value};
+    }
+    // Arrays and inline tables push a frame instead of recursing, so the depth is bounded by MaxNesting.
+    // A value in a slice of parse_array_parallel starts below the frames of the values around it.
+    if(1 < threads_ && '[' == str[0] && MinChunk <= static_cast<uint64_t>(end_ - str)) {
+        auto [n, v] = parse_array_parallel(str, enclosing);
+        if(CPPTOML_NULL != n) {
+            return {n, v};
+        }
+    }
+    uint32_t depth = enclosing;
+    for(;;) {
+        uint32_t completed = Invalid;
+        if('[' == str[0] || '{' == str[0]) {
+            if(static_cast<uint32_t>(MaxNesting) <= depth) {
+                return InvalidPair;
+            }
+            Frame& frame = frames_[depth];
+            ++depth;
+            frame.node_ = '[' == str[0] ? add_array() : add_table();
+            frame.keyvalue_ = Invalid;
+            frame.parent_ = Invalid;
+            frame.tail_ = Invalid;
+            frame.kind_ = TomlType::Invalid;
+            frame.expect_ = true;
+            ++str;
+        } else {
+            auto [n, v] = parse_scalar<Padded>(str);
+            if(CPPTOML_NULL == n) {
+                return InvalidPair;
+            }
+            str = n;
+            completed = v;
+        }
+
+        // Hand completed values to the enclosing frame, until one asks for the next value.
+        for(;;) {
+            if(Invalid != completed) {
+                if(depth <= enclosing) {
+                    return {str, completed};
+                }
+                Frame& frame = frames_[depth - 1];
+                if(static_cast<uint32_t>(TomlType::Array) == values_[frame.node_].type_) {
+                    // arrays are homogeneous
+                    TomlType kind = value_kind(values_[completed].type_);
+                    if(TomlType::Invalid == frame.kind_) {
+                        frame.kind_ = kind;
+                    } else if(frame.kind_ != kind) {
+                        return InvalidPair;
+                    }
+                    // the tail is kept, so appending does not walk long arrays
+                    if(Invalid == frame.tail_) {
+                        values_[frame.node_].start_ = completed;
+                    } else {
+                        values_[frame.tail_].next_ = completed;
+                    }
+                    values_[frame.node_].size_ += 1;
+                    frame.tail_ = completed;
+                } else {
+                    values_[frame.keyvalue_].size_ = completed;
+                    append(frame.parent_, frame.keyvalue_);
+                }
+                completed = Invalid;
+            }
+            Frame& frame = frames_[depth - 1];
+            if(static_cast<uint32_t>(TomlType::Array) == values_[frame.node_].type_) {
+                str = ws_comment_newline<Padded>(str);
+                if(!Padded && end_ <= str) {
+                    return InvalidPair;
+                }
+                if(']' == str[0]) {
+                    completed = frame.node_;
+                    --depth;
+                    ++str;
+                    continue;
+                }
+                if(frame.expect_ && value<Padded>(str)) {
+                    frame.expect_ = false;
+                    break;
+                }
+            } else {
+                str = whitespace(str);
+                if(!Padded && end_ <= str) {
+                    return InvalidPair;
+                }
+                if('}' == str[0]) {
+                    completed = frame.node_;
+                    --depth;
+                    ++str;
+                    continue;
+                }
+                if(frame.expect_ && keyvalue<Padded>(str)) {
+                    auto [n, keyvalue, parent] = parse_key<Padded>(str, frame.node_, KeyPlace::KeyValue);
+                    if(CPPTOML_NULL == n || end_ <= n || 0x3D != n[0]) {
+                        return InvalidPair;
+                    }
+                    str = whitespace(n + 1);
+                    if(!Padded && end_ <= str) {
+                        return InvalidPair;
+                    }
+                    frame.keyvalue_ = keyvalue;
+                    frame.parent_ = parent;
+                    frame.expect_ = false;
+                    break;
+                }
+            }
+            if(frame.expect_ || ',' != str[0]) {
+                return InvalidPair;
+            }
+            frame.expect_ = true;
+            ++str;
+        }
+    }
+}
+
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_scalar(const char* str)
+{
+    const char* next = CPPTOML_NULL;
+    TomlType type = TomlType::Invalid;
+    switch(str[0]) {
+    case '"':
+        type = TomlType::String;
+        if((Padded || (str + 2) < end_) && '"' == str[1] && '"' == str[2]) {
+            next = parse_ml_basic_string<Padded>(str);
+        } else {
+            next = parse_basic_string<Padded>(str);
+        }
+        break;
+    case '\'':
+        type = TomlType::String;
+        if((Padded || (str + 2) < end_) && '\'' == str[1] && '\'' == str[2]) {
+            next = parse_ml_literal_string<Padded>(str);
+        } else {
+            next = parse_literal_string<Padded>(str);
+        }
+        break;
+#ifdef CPPTOML_TABLE_LEXER
+    default:
+        return lex_scalar<Padded>(str);
+#else
+    case 't':
+        type = TomlType::True;
+        next = parse_true<Padded>(str);
+        break;
+    case 'f':
+        type = TomlType::False;
+        next = parse_false<Padded>(str);
+        break;
+    case 'i':
+        return parse_inf<Padded>(str);
+    case 'n':
+        return parse_nan<Padded>(str);
+    default:
+        if(('0' <= str[0] && str[0] <= '9') || '-' == str[0] || '+' == str[0]) {
+            auto [n, v] = parse_number<Padded>(str);
+            if(CPPTOML_NULL != n) {
+                return {n, v};
+            }
+        }
+        break;
+#endif
+    }
+    if(CPPTOML_NULL != next) {
+        uint32_t value = add_value(type, str, next);
+        return {next, value};
+    }
+    return InvalidPair;
+}
+
+#ifdef CPPTOML_TABLE_LEXER
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::lex_scalar(const char* str)
+{
+    // Run the automaton as far as it goes. A valid scalar is always followed by a delimiter,
+    // so the only token which has to give back a character is a date followed by a space.
+    const char* begin = str;
+    uint32_t state = StateStart;
+    while(Padded || str < end_) {
+        uint32_t next = scalar_table.next_[state][scalar_table.classes_[static_cast<uint8_t>(str[0])]];
+        if(StateError == next) {
+            break;
+        }
+        state = next;
+        ++str;
+    }
+    if(StateDateSpace == state) {
+        state = StateDate;
+        --str;
+    }
+    TomlType type = scalar_table.accept_[state];
+    switch(type) {
+    case TomlType::Invalid:
+        return InvalidPair;
+    case TomlType::Integer:
+        if(!integer_in_range(begin, str)) {
+            return InvalidPair;
+        }
+        break;
+    case TomlType::Hex:
+    case TomlType::Oct:
+    case TomlType::Bin:
+        if(!radix_in_range(begin + 2, str, type)) {
+            return InvalidPair;
+        }
+        break;
+    case TomlType::DateTime:
+        if(!valid_datetime(begin, str)) {
+            return InvalidPair;
+        }
+        break;
+    default:
+        break;
+    }
+    uint32_t value = add_value(type, begin, str);
+    return {str, value};
+}
+#endif
+
+template<bool Padded>
+bool TomlParser::value(const char* str) const
+{
+    if(!Padded && end_ <= str) {
+        return false;
+    }
+    switch(str[0]) {
+    case '"':
+    case '\'':
+    case 't':
+    case 'f':
+    case 'i':
+    case 'n':
+    case '[':
+    case '{':
+    case '+':
+    case '-':
+        return true;
+    default:
+        if('0' <= str[0] && str[0] <= '9') {
+            return true;
+        }
+        break;
+    }
+    return false;
+}
+
+template<bool Padded>
+const char* TomlParser::parse_basic_string(const char* str)
+{
+    CPPTOML_ASSERT('"' == str[0]);
+    ++str;
+    while(Padded || str < end_) {
+        str = kernels_->basic_(str, end_);
+        if(!Padded && end_ <= str) {
+            break;
+        }
+        if('"' == str[0]) {
+            return str + 1;
+        }
+        if(basic_char<Padded>(str)) {
+            continue;
+        }
+        break;
+    }
+    return CPPTOML_NULL;
+}
+
+template<bool Padded>
+const char* TomlParser::parse_literal_string(const char* str)
+{
+    CPPTOML_ASSERT('\'' == str[0]);
+    ++str;
+    while(Padded || str < end_) {
+        str = kernels_->literal_(str, end_);
+        if(!Padded && end_ <= str) {
+            break;
+        }
+        if('\'' == str[0]) {
+            return str + 1;
+        }
+        if(literal_char<Padded>(str)) {
+            continue;
+        }
+        break;
+    }
+    return CPPTOML_NULL;
+}
+
+template<bool Padded>
+const char* TomlParser::parse_ml_basic_string(const char* str)
+{
+    CPPTOML_ASSERT('"' == str[0] && '"' == str[1] && '"' == str[2]);
+    str += 3;
+    str = newline<Padded>(str);
+
+    for(;;) {
+        const char* next = parse_mlb_content<Padded>(str);
+        if(next == str) {
+            break;
+        }
+        str = next;
+    }
+
+    while(Padded || str < end_) {
+        if(!parse_mlb_quotes<Padded>(str)) {
+            break;
+        }
+        while(Padded || str < end_) {
+            const char* next = parse_mlb_content<Padded>(str);
+            if(next == str) {
+                break;
+            }
+            str = next;
+        }
+    }
+    parse_mlb_quotes<Padded>(str);
+    if(!Padded && end_ <= (str + 2)) {
+        return CPPTOML_NULL;
+    }
+    if('"' == str[0] && '"' == str[1] && '"' == str[2]) {
+        return str + 3;
+    }
+    return CPPTOML_NULL;
+}
+
+template<bool Padded>
+const char* TomlParser::parse_mlb_content(const char* str)
+{
+    if(!Padded && end_ <= str) {
+        return str;
+    }
+    switch(str[0]) {
+    case 0x0A:
+    case 0x0D:
+        return newline<Padded>(str);
+    case 0x5C: // escape
+        return parse_mlb_escaped_nl<Padded>(str);
+    default: {
+        const char* next = kernels_->basic_(str, end_);
+        if(next != str) {
+            return next;
+        }
+        if(basic_char<Padded>(str)) {
+            return str;
+        }
+    } break;
+    }
+    return str;
+}
+
+template<bool Padded>
+const char* TomlParser::parse_mlb_escaped_nl(const char* str)
+{
+    CPPTOML_ASSERT(0x5C == str[0]);
+    str = whitespace(str + 1);
+    str = newline<Padded>(str);
+    while(Padded || str < end_) {
+        switch(str[0]) {
+        case 0x0A:
+        case 0x0D:
+            str = newline<Padded>(str);
+            break;
+        case 0x09:
+        case 0x20:
+            str = whitespace(str);
+            break;
+        default:
+            return str;
+        }
+    }
+    return str;
+}
+
+template<bool Padded>
+bool TomlParser::parse_mlb_quotes(const char*& str)
+{
+    const char* next = str;
+    uint32_t count = 0;
+    while(Padded || next < end_) {
+        if('"' == next[0]) {
+            ++count;
+            ++next;
+            continue;
+        }
+        break;
+    }
+    switch(count) {
+    case 0:
+        return false;
+    case 1:
+        return false;
+    case 2:
+        str += 2;
+        return true;
+    case 3:
+        return false;
+    case 4:
+        return false;
+    default:
+        next = str;
+        while(5 <= count) {
+            count -= 2;
+            next += 2;
         }
-        if(0b1000'0000U != (u[3] & 0b1100'0000U)) {
-            return -1;
+        if(3 == count || 0 == count) {
+            str = next;
+            return true;
         }
-        return ((static_cast<int64_t>(u[0]) & 0b111U) << 18)
-               + ((static_cast<int64_t>(u[1]) & 0b11'1111U) << 12)
-               + ((static_cast<int64_t>(u[2]) & 0b11'1111U) << 6)
-               + ((static_cast<int64_t>(u[3]) & 0b11'1111U));
+        return false;
     }
-    return -1;
 }
 
-bool TomlParser::parse_unquated_key_char(const char*& str) const
+template<bool Padded>
+const char* TomlParser::parse_ml_literal_string(const char* str)
 {
-    const char* next = str;
-    int64_t c = next_symbol(next);
-    if('a' <= c && c <= 'z') {
-        str = next;
-        return true;
-    }
-    if('A' <= c && c <= 'Z') {
+    CPPTOML_ASSERT('\'' == str[0] && '\'' == str[1] && '\'' == str[2]);
+    str += 3;
+    str = newline<Padded>(str);
+
+    for(;;) {
+        const char* next = parse_mll_content<Padded>(str);
+        if(next == str) {
+            break;
+        }
         str = next;
-        return true;
     }
-    if('0' <= c && c <= '9') {
-        str = next;
-        return true;
+
+    while(Padded || str < end_) {
+        if(!parse_mll_quotes<Padded>(str)) {
+            break;
+        }
+        while(Padded || str < end_) {
+            const char* next = parse_mll_content<Padded>(str);
+            if(next == str) {
+                break;
+            }
+            str = next;
+        }
     }
-    switch(c) {
-    case 0x2D:
-    case 0x5F:
-    case 0xB2:
-    case 0xB3:
-    case 0xB9:
-    case 0xBC:
-    case 0xBD:
-    case 0xBE:
-        str = next;
-        return true;
+    parse_mll_quotes<Padded>(str);
+    if(!Padded && end_ <= (str + 2)) {
+        return CPPTOML_NULL;
     }
-    if(0xC0 <= c && c <= 0xD6) {
-        str = next;
-        return true;
+    if('\'' == str[0] && '\'' == str[1] && '\'' == str[2]) {
+        return str + 3;
     }
-    if(0xD8 <= c && c <= 0xF6) {
-        str = next;
-        return true;
+    return CPPTOML_NULL;
+}
+
+template<bool Padded>
+const char* TomlParser::parse_mll_content(const char* str)
+{
+    if(!Padded && end_ <= str) {
+        return str;
     }
-    if(0xF8 <= c && c <= 0x37D) {
-        str = next;
-        return true;
+    switch(str[0]) {
+    case 0x0A:
+    case 0x0D:
+        return newline<Padded>(str);
+    default: {
+        const char* next = kernels_->literal_(str, end_);
+        if(next != str) {
+            return next;
+        }
+        if(literal_char<Padded>(str)) {
+            return str;
+        }
+    } break;
     }
-    if(0x37F <= c && c <= 0x1FFF) {
-        str = next;
-        return true;
+    return str;
+}
+
+template<bool Padded>
+bool TomlParser::parse_mll_quotes(const char*& str)
+{
+    const char* next = str;
+    uint32_t count = 0;
+    while(Padded || next < end_) {
+        if('\'' == next[0]) {
+            ++count;
+            ++next;
+            continue;
+        }
+        break;
     }
-    if((0x200C <= c && c <= 0x200D) || (0x203F <= c && c <= 0x2040)) {
-        str = next;
+    switch(count) {
+    case 0:
+        return false;
+    case 1:
+        str += 1;
         return true;
-    }
-    if((0x2070 <= c && c <= 0x218F) || (0x2460 <= c && c <= 0x24FF)) {
-        str = next;
+    case 2:
+        str += 2;
         return true;
-    }
-    if((0x2C00 <= c && c <= 0x2FEF) || (0x3001 <= c && c <= 0xD7FF)) {
-        str = next;
+    case 3:
+        return false;
+    case 4:
+        str += 1;
         return true;
+    default:
+        next = str;
+        while(5 <= count) {
+            count -= 2;
+            next += 2;
+        }
+        if(3 == count || 0 == count) {
+            str = next;
+            return true;
+        }
+        return false;
     }
-    if((0xF900 <= c && c <= 0xFDCF) || (0xFDF0 <= c && c <= 0xFFFD)) {
-        str = next;
-        return true;
+}
+
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_table(const char* str)
+{
+    CPPTOML_ASSERT('[' == str[0]);
+    if(!Padded && end_ <= (str + 1)) {
+        return InvalidPair;
     }
-    if(0x10000 <= c && c <= 0xEFFFF) {
-        str = next;
-        return true;
+    current_ = 0;
+    if(str[1] == '[') {
+        return parse_array_table<Padded>(str);
+    } else {
+        return parse_std_table<Padded>(str);
     }
-    return false;
 }
 
-bool TomlParser::basic_char(const char*& str) const
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_std_table(const char* str)
 {
-    switch(str[0]) {
-    case 0x09:
-    case 0x20:
-    case 0x21:
-        ++str;
-        return true;
-    case 0x5C: // espace
-        return escaped(str);
+    CPPTOML_ASSERT('[' == str[0]);
+    str = whitespace(str + 1);
+    if(!Padded && end_ <= str) {
+        return InvalidPair;
     }
-    if(0x23 <= str[0] && str[0] <= 0x7E) {
-        ++str;
-        return true;
+    std::tuple<const char*, uint32_t, uint32_t> keyvalue = parse_key<Padded>(str, current_, KeyPlace::Table);
+    str = std::get<0>(keyvalue);
+    if(CPPTOML_NULL == str) {
+        return InvalidPair;
     }
-    const char* next = parse_non_ascii(str);
-    if(CPPTOML_NULL != next && next != str) {
-        str = next;
-        return true;
+    str = whitespace(str);
+    if((!Padded && end_ <= str) || str[0] != ']') {
+        return InvalidPair;
     }
-    return false;
+    // A table made by a longer header keeps its children when it is defined later.
+    uint32_t table = static_cast<uint32_t>(values_[std::get<1>(keyvalue)].size_);
+    if(Invalid == table) {
+        table = add_table();
+        values_[std::get<1>(keyvalue)].size_ = table;
+        append(std::get<2>(keyvalue), std::get<1>(keyvalue));
+    }
+    if(headers_.record_) {
+        if(headers_.capacity_ <= headers_.size_) {
+            uint32_t capacity = (0 < headers_.capacity_) ? headers_.capacity_ * 2 : 64;
+            uint32_t* tables = reinterpret_cast<uint32_t*>(allocator_(sizeof(uint32_t) * capacity));
+            if(0 < headers_.size_) {
+                ::memcpy(tables, headers_.tables_, sizeof(uint32_t) * headers_.size_);
+            }
+            deallocator_(headers_.tables_);
+            headers_.tables_ = tables;
+            headers_.capacity_ = capacity;
+        }
+        headers_.tables_[headers_.size_++] = table;
+    }
+    current_ = table;
+    return {str + 1, table};
 }
 
-bool TomlParser::literal_char(const char*& str) const
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_array_table(const char* str)
 {
-    switch(str[0]) {
-    case 0x09:
-    case 0x20:
-        ++str;
-        return true;
+    CPPTOML_ASSERT('[' == str[0] && '[' == str[1]);
+    str = whitespace(str + 2);
+    if(!Padded && end_ <= str) {
+        return InvalidPair;
     }
-    if(0x20 <= str[0] && str[0] <= 0x26) {
-        ++str;
-        return true;
+    // The same bytes as the last [[header]] resolve to the same array,
+    // only another [[header]] can add a table on the way to it and that one replaces the cache.
+    if(Invalid != array_table_.array_ && array_table_.size_ <= static_cast<uint64_t>(end_ - str)
+       && 0 == ::memcmp(str, begin_ + array_table_.key_, static_cast<size_t>(array_table_.size_))) {
+        const char* next = whitespace(str + array_table_.size_);
+        if((Padded || (next + 1) < end_) && ']' == next[0] && ']' == next[1]) {
+            uint32_t table = add_table();
+            values_[array_table_.tail_].next_ = table;
+            values_[array_table_.array_].size_ += 1;
+            array_table_.tail_ = table;
+            current_ = table;
+            return {next + 2, current_};
+        }
     }
-    if(0x28 <= str[0] && str[0] <= 0x7E) {
-        ++str;
-        return true;
+    const char* key = str;
+    std::tuple<const char*, uint32_t, uint32_t> keyvalue = parse_key<Padded>(str, current_, KeyPlace::ArrayTable);
+    str = std::get<0>(keyvalue);
+    if(CPPTOML_NULL == str) {
+        return InvalidPair;
     }
-    const char* next = parse_non_ascii(str);
-    if(CPPTOML_NULL != next && next != str) {
-        str = next;
-        return true;
+    uint64_t key_size = static_cast<uint64_t>(str - key);
+    str = whitespace(str);
+    if((!Padded && end_ <= (str + 1)) || (str[0] != ']' || str[1] != ']')) {
+        return InvalidPair;
     }
-    return false;
+    CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::KeyValue) == values_[std::get<1>(keyvalue)].type_);
+    uint32_t array = static_cast < uint32_t>(values_[std::get<1>(keyvalue)].size_);
+    if(Invalid == array) {
+        array = add_array();
+        values_[std::get<1>(keyvalue)].size_ = array;
+        append(std::get<2>(keyvalue), std::get<1>(keyvalue));
+    }
+    CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::Array) == values_[array].type_);
+    // a static array can not be extended by tables
+    if(0 < values_[array].size_ && static_cast<uint32_t>(TomlType::Table) != values_[values_[array].start_].type_) {
+        return InvalidPair;
+    }
+    uint32_t table = add_table();
+    if(array == array_table_.array_) {
+        values_[array_table_.tail_].next_ = table;
+        values_[array].size_ += 1;
+    } else {
+        append(array, table);
+    }
+    array_table_.key_ = static_cast<uint64_t>(key - begin_);
+    array_table_.size_ = key_size;
+    array_table_.array_ = array;
+    array_table_.tail_ = table;
+    current_ = table;
+    return {str + 2, current_};
 }
 
-bool TomlParser::escaped(const char*& str) const
+const char* TomlParser::event_expression(const char* str, TomlHandler& handler)
 {
-    CPPTOML_ASSERT(0x5C == str[0]);
-    const char* next = str + 1;
-    if(end_ <= next) {
-        return false;
-    }
-    switch(next[0]) {
-    case 0x22:
-    case 0x5C:
-    case 0x62:
-    case 0x65:
-    case 0x66:
-    case 0x6E:
-    case 0x72:
-    case 0x74:
-        str = next + 1;
-        return true;
-    case 0x55:
-        str = next + 1;
-        return parse_8hexdig(str);
-    case 0x75:
-        str = next + 1;
-        return parse_4hexdig(str);
-    //case 0x78:
-    //    str = next + 1;
-    //    return parse_2hexdig(str);
+    str = whitespace(str);
+    switch(str[0]) {
+    case '[':
+        str = event_table(str, handler);
+        break;
+    case '#':
+        str = comment(str);
+        break;
+    default: {
+        const char* next = str;
+        if('"' != str[0] && '\'' != str[0] && !parse_unquated_key_char(next)) {
+            return str;
+        }
+        str = event_key(str);
+        if(CPPTOML_NULL == str || end_ <= str || 0x3D != str[0]) {
+            return CPPTOML_NULL;
+        }
+        if(!handler.on_key(spans_.spans_, spans_.size_)) {
+            return CPPTOML_NULL;
+        }
+        str = whitespace(str + 1);
+        if(end_ <= str) {
+            return CPPTOML_NULL;
+        }
+        str = event_value(str, handler);
+    } break;
     }
-    return false;
+    if(CPPTOML_NULL == str) {
+        return CPPTOML_NULL;
+    }
+    str = whitespace(str);
+    str = comment(str);
+    return str;
 }
 
-bool TomlParser::parse_2hexdig(const char*& str) const
+const char* TomlParser::event_table(const char* str, TomlHandler& handler)
 {
+    CPPTOML_ASSERT('[' == str[0]);
     if(end_ <= (str + 1)) {
-        return false;
+        return CPPTOML_NULL;
     }
-    if(!hexgidit(str[0]) || !hexgidit(str[1])) {
-        return false;
+    bool array = '[' == str[1];
+    str = whitespace(str + (array ? 2 : 1));
+    if(end_ <= str) {
+        return CPPTOML_NULL;
     }
-    str += 2;
-    return true;
+    str = event_key(str);
+    if(CPPTOML_NULL == str) {
+        return CPPTOML_NULL;
+    }
+    if(array) {
+        if(end_ <= (str + 1) || ']' != str[0] || ']' != str[1]) {
+            return CPPTOML_NULL;
+        }
+        str += 2;
+    } else {
+        if(end_ <= str || ']' != str[0]) {
+            return CPPTOML_NULL;
+        }
+        str += 1;
+    }
+    return handler.on_table_header(spans_.spans_, spans_.size_, array) ? str : CPPTOML_NULL;
 }
 
-bool TomlParser::parse_4hexdig(const char*& str) const
+const char* TomlParser::event_key(const char* str)
 {
-    if(end_ <= (str + 3)) {
-        return false;
-    }
-    if(!hexgidit(str[0]) || !hexgidit(str[1]) || !hexgidit(str[2]) || !hexgidit(str[3])) {
-        return false;
+    // the segments of parse_key, which are not resolved to tables
+    spans_.size_ = 0;
+    for(;;) {
+        const char* begin = str;
+        switch(str[0]) {
+        case '"': // quated-key
+            str = parse_basic_string(str);
+            break;
+        case '\'': // quated-key
+            str = parse_literal_string(str);
+            break;
+        default:
+            const char* next = str;
+            if(!parse_unquated_key_char(next)) {
+                return CPPTOML_NULL;
+            }
+            str = parse_unquated_key(str);
+            break;
+        }
+        if(CPPTOML_NULL == str) {
+            return CPPTOML_NULL;
+        }
+        if(spans_.capacity_ <= spans_.size_) {
+            uint32_t capacity = (0 < spans_.capacity_) ? spans_.capacity_ * 2 : 16;
+            TomlSpan* spans = reinterpret_cast<TomlSpan*>(allocator_(sizeof(TomlSpan) * capacity));
+            if(0 < spans_.size_) {
+                ::memcpy(spans, spans_.spans_, sizeof(TomlSpan) * spans_.size_);
+            }
+            deallocator_(spans_.spans_);
+            spans_.spans_ = spans;
+            spans_.capacity_ = capacity;
+        }
+        spans_.spans_[spans_.size_++] = {begin, str};
+        str = whitespace(str);
+        if(end_ <= str) {
+            return CPPTOML_NULL;
+        }
+        if('.' != str[0]) {
+            return str;
+        }
+        str = whitespace(str + 1);
+        if(end_ <= str) {
+            return CPPTOML_NULL;
+        }
     }
-    str += 4;
-    return true;
 }
 
-bool TomlParser::parse_8hexdig(const char*& str) const
+const char* TomlParser::event_value(const char* str, TomlHandler& handler)
 {
-    if(end_ <= (str + 7)) {
-        return false;
-    }
-    for(uint32_t i = 0; i < 8; ++i) {
-        if(!hexgidit(str[i])) {
-            return false;
+    // The loop of parse_value, a frame remembers only its kind.
+    struct EventFrame
+    {
+        bool array_;
+        bool expect_;
+        TomlType kind_; //!< kind of the values of an array
+    };
+    EventFrame frames[MaxNesting];
+    uint32_t depth = 0;
+    for(;;) {
+        TomlType completed = TomlType::Invalid;
+        if('[' == str[0] || '{' == str[0]) {
+            if(static_cast<uint32_t>(MaxNesting) <= depth) {
+                return CPPTOML_NULL;
+            }
+            bool array = '[' == str[0];
+            frames[depth] = {array, true, TomlType::Invalid};
+            ++depth;
+            if(!(array ? handler.on_array_begin() : handler.on_inline_table_begin())) {
+                return CPPTOML_NULL;
+            }
+            ++str;
+        } else {
+            // the scalar node is taken back at once
+            uint32_t size = size_;
+            auto [n, v] = parse_scalar(str);
+            if(CPPTOML_NULL == n) {
+                return CPPTOML_NULL;
+            }
+            completed = static_cast<TomlType>(values_[v].type_);
+            size_ = size;
+            if(!handler.on_value(completed, {str, n})) {
+                return CPPTOML_NULL;
+            }
+            str = n;
+        }
+
+        for(;;) {
+            if(TomlType::Invalid != completed) {
+                if(depth <= 0) {
+                    return str;
+                }
+                EventFrame& frame = frames[depth - 1];
+                if(frame.array_ && !same_kind(frame.kind_, static_cast<uint32_t>(completed))) {
+                    return CPPTOML_NULL;
+                }
+                completed = TomlType::Invalid;
+            }
+            EventFrame& frame = frames[depth - 1];
+            str = event_element(str, frame.array_, frame.expect_);
+            if(CPPTOML_NULL == str) {
+                return CPPTOML_NULL;
+            }
+            if(']' == str[0] || '}' == str[0]) {
+                completed = frame.array_ ? TomlType::Array : TomlType::Table;
+                --depth;
+                ++str;
+                if(!(frame.array_ ? handler.on_array_end() : handler.on_inline_table_end())) {
+                    return CPPTOML_NULL;
+                }
+                continue;
+            }
+            if(frame.array_) {
+                break;
+            }
+            const char* n = event_key(str);
+            if(CPPTOML_NULL == n || end_ <= n || 0x3D != n[0]) {
+                return CPPTOML_NULL;
+            }
+            if(!handler.on_key(spans_.spans_, spans_.size_)) {
+                return CPPTOML_NULL;
+            }
+            str = whitespace(n + 1);
+            if(end_ <= str) {
+                return CPPTOML_NULL;
+            }
+            break;
         }
     }
-    str += 8;
-    return true;
 }
 
-bool TomlParser::hexgidit(char c)
+const char* TomlParser::event_element(const char* str, bool array, bool& expect)
 {
-    switch(c) {
-    case '0':
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-    case '8':
-    case '9':
-    case 'A':
-    case 'B':
-    case 'C':
-    case 'D':
-    case 'E':
-    case 'F':
-        return true;
-    default:
-        return false;
+    // separators up to the next element, a value or a key, or to the closing bracket
+    for(;;) {
+        str = array ? ws_comment_newline(str) : whitespace(str);
+        if(end_ <= str) {
+            return CPPTOML_NULL;
+        }
+        if((array ? ']' : '}') == str[0]) {
+            return str;
+        }
+        if(expect && (array ? value(str) : keyvalue(str))) {
+            expect = false;
+            return str;
+        }
+        if(expect || ',' != str[0]) {
+            return CPPTOML_NULL;
+        }
+        expect = true;
+        ++str;
     }
 }
 
-bool TomlParser::digit(char c)
+template<bool Padded>
+const char* TomlParser::parse_true(const char* str)
 {
-    return '0' <= c && c <= '9';
+    CPPTOML_ASSERT('t' == str[0]);
+    return match(load_word<Padded>(str), PatternTrue) ? str + 4 : CPPTOML_NULL;
 }
 
-const char* TomlParser::bom(const char* str) const
+template<bool Padded>
+const char* TomlParser::parse_false(const char* str)
 {
-    std::ptrdiff_t size = std::distance(str, end_);
-    if(3 <= size) {
-        if(0xEF == str[0] && 0xBB == str[1] && 0xBF == str[2]) {
-            str += 3;
+    CPPTOML_ASSERT('f' == str[0]);
+    return match(load_word<Padded>(str), PatternFalse) ? str + 5 : CPPTOML_NULL;
+}
+
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_number(const char* str)
+{
+    CPPTOML_ASSERT(str < end_);
+    const char* begin = str;
+    bool sign = false;
+    if('-' == str[0] || '+' == str[0]) {
+        sign = true;
+        ++str;
+        if(!Padded && end_ <= str) {
+            return InvalidPair;
         }
     }
-    return str;
+    switch(str[0]) {
+    case 'i':
+        return parse_inf<Padded>(begin);
+    case 'n':
+        return parse_nan<Padded>(begin);
+    case '0':
+        if(!sign && (Padded || (str + 1) < end_)) {
+            switch(str[1]) {
+            case 'x':
+                return parse_radix<Padded>(str, TomlType::Hex);
+            case 'o':
+                return parse_radix<Padded>(str, TomlType::Oct);
+            case 'b':
+                return parse_radix<Padded>(str, TomlType::Bin);
+            }
+        }
+        break;
+    default:
+        if(!digit(str[0])) {
+            return InvalidPair;
+        }
+        break;
+    }
+
+    // integer part, which turns to a date-time, or continues to a float
+    const char* next = parse_zero_prefixable_int<Padded>(str);
+    if(CPPTOML_NULL == next) {
+        return InvalidPair;
+    }
+    if((Padded || next < end_) && ('-' == next[0] || ':' == next[0])) {
+        return parse_datetime<Padded>(begin);
+    }
+    if('0' == str[0] && 1 < (next - str)) {
+        return InvalidPair;
+    }
+    TomlType type = TomlType::Integer;
+    if((Padded || next < end_) && '.' == next[0]) {
+        next = parse_zero_prefixable_int<Padded>(next + 1);
+        if(CPPTOML_NULL == next) {
+            return InvalidPair;
+        }
+        type = TomlType::Float;
+    }
+    if((Padded || next < end_) && ('e' == next[0] || 'E' == next[0])) {
+        ++next;
+        if((Padded || next < end_) && ('-' == next[0] || '+' == next[0])) {
+            ++next;
+        }
+        next = parse_zero_prefixable_int<Padded>(next);
+        if(CPPTOML_NULL == next) {
+            return InvalidPair;
+        }
+        type = TomlType::Float;
+    }
+    if(TomlType::Integer == type && !integer_in_range(begin, next)) {
+        return InvalidPair;
+    }
+    uint32_t value = add_value(type, begin, next);
+    return {next, value};
 }
 
-const char* TomlParser::newline(const char* str) const
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_radix(const char* str, TomlType type)
 {
-    while(str < end_) {
-        switch(str[0]) {
-        case 0x0A:
-        case 0x0D:
-            ++str;
+    CPPTOML_ASSERT('0' == str[0]);
+    const char* begin = str;
+    str += 2;
+    uint32_t rank = 0;
+    bool sep = false;
+    while(Padded || str < end_) {
+        bool valid = false;
+        switch(type) {
+        case TomlType::Hex:
+            valid = hexgidit(str[0]);
+            break;
+        case TomlType::Oct:
+            valid = '0' <= str[0] && str[0] <= '7';
             break;
         default:
-            return str;
+            valid = '0' == str[0] || '1' == str[0];
+            break;
+        }
+        if(valid) {
+            ++rank;
+            ++str;
+            sep = false;
+            continue;
+        }
+        if('_' == str[0]) {
+            if(rank <= 0 || sep) {
+                return InvalidPair;
+            }
+            ++str;
+            sep = true;
+            continue;
         }
+        break;
     }
-    return str;
+    if(sep) {
+        return InvalidPair;
+    }
+    if(rank <= 0 || !radix_in_range(begin + 2, str, type)) {
+        return InvalidPair;
+    }
+    uint32_t value = add_value(type, begin, str);
+    return {str, value};
 }
 
-const char* TomlParser::whitespace(const char* str) const
+template<bool Padded>
+const char* TomlParser::parse_zero_prefixable_int(const char* str)
 {
-    while(str < end_) {
-        switch(str[0]) {
-        case 0x09:
-        case 0x20:
+    uint32_t rank = 0;
+    bool sep = false;
+    while(Padded || str < end_) {
+        if(digit(str[0])) {
+            const char* next = kernels_->digits_(str, end_);
+            rank += static_cast<uint32_t>(next - str);
+            str = next;
+            sep = false;
+            continue;
+        }
+        if('_' == str[0]) {
+            if(rank <= 0 || sep) {
+                return CPPTOML_NULL;
+            }
             ++str;
-            break;
-        default:
-            return str;
+            sep = true;
+            continue;
         }
+        break;
+    }
+    if(sep) {
+        return CPPTOML_NULL;
+    }
+    if(rank <= 0) {
+        return CPPTOML_NULL;
     }
     return str;
 }
 
-const char* TomlParser::comment(const char* str) const
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_inf(const char* str)
 {
-    if(end_ <= str || '#' != str[0]) {
-        return str;
+    const char* begin = str;
+    if('-' == str[0] || '+' == str[0]) {
+        ++str;
     }
-    ++str;
-    while(str < end_) {
-        // non-eol
-        if(0x09 == str[0] || (0x20 <= str[0] && str[0] <= 0x7E)) {
-            ++str;
-            continue;
-        }
-        // non-ascii
-        const char* next = parse_non_ascii(str);
-        if(CPPTOML_NULL == next) {
-            return CPPTOML_NULL;
-        }
-        if(next == str) {
-            break;
-        }
-        str = next;
+    if(!match(load_word<Padded>(str), PatternInf)) {
+        return InvalidPair;
     }
-    return str;
+    str += 3;
+    uint32_t value = add_value(TomlType::Inf, begin, str);
+    return {str, value};
 }
 
-const char* TomlParser::ws_comment_newline(const char* str) const
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_nan(const char* str)
 {
-    while(str < end_) {
-        switch(str[0]) {
-        case 0x09:
-        case 0x20:
-            str = whitespace(str);
-            break;
-        case 0x0A:
-        case 0x0D:
-            str = newline(str);
-            break;
-        case 0x23:
-            str = comment(str);
-            break;
-        default:
-            return str;
-        }
+    const char* begin = str;
+    if('-' == str[0] || '+' == str[0]) {
+        ++str;
     }
-    return str;
+    if(!match(load_word<Padded>(str), PatternNaN)) {
+        return InvalidPair;
+    }
+    str += 3;
+    uint32_t value = add_value(TomlType::NaN, begin, str);
+    return {str, value};
 }
 
-const char* TomlParser::parse_non_ascii(const char* str) const
+template<bool Padded>
+std::tuple<const char*, uint32_t> TomlParser::parse_datetime(const char* str)
 {
-    const char* next = str;
-    int64_t c = next_symbol(next);
-    if(c < 0) {
-        return CPPTOML_NULL;
+    const char* begin = str;
+    if(!Padded && end_ <= (str + 2)) {
+        return InvalidPair;
     }
-    if(0x80 <= c && c <= 0xD7FF) {
-        return next;
+    if(':' == str[2]) {
+        str = parse_partial_time<Padded>(str);
+    } else {
+        str = parse_fulldate<Padded>(str);
+        // a time follows only after its delimiter, a date can end an element of an array before another time
+        if(CPPTOML_NULL != str && (Padded || (str + 3) < end_) && ('T' == str[0] || 't' == str[0] || ' ' == str[0]) && ':' == str[3]) {
+            str = parse_partial_time<Padded>(str + 1);
+            if(CPPTOML_NULL != str) {
+                if((Padded || str < end_) && ('z' == str[0] || 'Z' == str[0])) {
+                    ++str;
+                } else if((Padded || (str + 3) < end_) && (':' == str[2] || ':' == str[3])) {
+                    str = parse_timeoffset<Padded>(str);
+                }
+            }
+        }
     }
-    if(0xE000 <= c && c <= 0x10FFFF) {
-        return next;
+    if(CPPTOML_NULL == str || !valid_datetime(begin, str)) {
+        return InvalidPair;
     }
-    return str;
+    uint32_t value = add_value(TomlType::DateTime, begin, str);
+    return {str, value};
 }
 
-const char* TomlParser::parse_expression(const char* str)
+template<bool Padded>
+const char* TomlParser::parse_fulldate(const char* str)
 {
-    std::tuple<const char*, uint32_t> pair;
-    str = whitespace(str);
-    switch(str[0]) {
-    case '"': // quated-key
-        pair = parse_keyvalue(str);
-        break;
-    case '\'': // quated-key
-        pair = parse_keyvalue(str);
-        break;
-    case '[': // table
-        pair = parse_table(str);
-        break;
-    case '#':
-        str = comment(str);
-        pair = {str, Invalid};
-        break;
-    default: {
-        const char* next = str;
-        if(!parse_unquated_key_char(next)) {
-            return str;
-        }
-        pair = parse_keyvalue(str);
-    } break;
-    }
-    if(CPPTOML_NULL == std::get<0>(pair)) {
+    if(!match(load_word<Padded>(str), PatternDate) || !match(load_word<Padded>(str + 8), PatternDay)) {
         return CPPTOML_NULL;
     }
-    str = std::get<0>(pair);
-    str = whitespace(str);
-    str = comment(str);
-    return str;
+    return str + 10;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_keyvalue(const char* str)
+template<bool Padded>
+const char* TomlParser::parse_partial_time(const char* str)
 {
-    std::tuple<const char*, uint32_t, uint32_t> keyvalue = parse_key(str, current_, KeyPlace::KeyValue);
-    if(CPPTOML_NULL == std::get<0>(keyvalue) || end_ <= std::get<0>(keyvalue)) {
-        return InvalidPair;
-    }
-    str = std::get<0>(keyvalue);
-    if(0x3D != str[0]) {
-        return InvalidPair;
-    }
-    str = whitespace(str + 1);
-    if(end_ <= str) {
-        return InvalidPair;
+    if(!match(load_word<Padded>(str), PatternTime)) {
+        return CPPTOML_NULL;
     }
-    std::tuple<const char*, uint32_t> value = parse_value(str);
-    if(CPPTOML_NULL == std::get<0>(value)) {
-        return InvalidPair;
+    str += 8;
+    if((!Padded && end_ <= str) || '.' != str[0]) {
+        return str;
     }
-    values_[std::get<1>(keyvalue)].size_ = std::get<1>(value);
-    append(std::get<2>(keyvalue), std::get<1>(keyvalue));
-    return {std::get<0>(value), std::get<1>(keyvalue)};
+    ++str;
+    const char* fraction = str;
+    str = kernels_->digits_(str, end_);
+    return (fraction < str) ? str : CPPTOML_NULL;
 }
 
-bool TomlParser::keyvalue(const char* str) const
+template<bool Padded>
+const char* TomlParser::parse_timeoffset(const char* str)
 {
-    if(end_ <= str) {
-        return false;
+    if('-' == str[0] || '+' == str[0]) {
+        ++str;
     }
-    switch(str[0]) {
-    case '"':
-    case '\'':
-        return true;
-    default: {
-        const char* next = str;
-        if(parse_unquated_key_char(next)) {
-            return true;
-        }
-    } break;
+    if(!match(load_word<Padded>(str), PatternOffset)) {
+        return CPPTOML_NULL;
     }
-    return false;
+    return str + 5;
 }
 
-std::tuple<const char*, uint32_t, uint32_t> TomlParser::parse_key(const char* str, uint32_t current, KeyPlace place)
+bool TomlParser::strcmp(const char* s0, const char* e0, const char* s1, const char* e1)
 {
-    for(;;) {
-        const char* begin = str;
-        switch(str[0]) {
-        case '"': // quated-key
-            str = parse_basic_string(str);
-            break;
-        case '\'': // quated-key
-            str = parse_literal_string(str);
-            break;
-        default:
-            const char* next = str;
-            if(!parse_unquated_key_char(next)) {
-                return InvalidTuple;
-            }
-            str = parse_unquated_key(str);
-            break;
-        }
-        const char* end = str;
-        uint32_t exist = find_keyvalue(current, begin, end);
-        str = whitespace(str);
-        if(end_ <= str) {
-            return InvalidTuple;
-        }
-        if(str[0] != '.') {
-            if(Invalid != exist) {
-                switch(place) {
-                case KeyPlace::KeyValue: {
-                    uint64_t table = values_[exist].size_;
-                    if(static_cast<uint32_t>(TomlType::Table) != values_[table].type_) {
-                        return InvalidTuple;
-                    }
-                    // if (!has_child_table(table)) {
-                    //     return InvalidTuple;
-                    // }
-                    return {str, exist, current};
-                }
-                case KeyPlace::Table: {
-                    uint64_t table = values_[exist].size_;
-                    if(static_cast<uint32_t>(TomlType::Table) != values_[table].type_) {
-                        return InvalidTuple;
-                    }
-                    if(!has_child_table(static_cast<uint32_t>(table))) {
-                        return InvalidTuple;
-                    }
-                    return {str, exist, current};
-                }
-                case KeyPlace::ArrayTable: {
-                    uint32_t array = static_cast<uint32_t>(values_[exist].size_);
-                    if(static_cast<uint32_t>(TomlType::Array) != values_[array].type_) {
-                        return InvalidTuple;
-                    }
-                    return {str, exist, current};
-                }
-                default:
-                    return InvalidTuple;
-                }
-            }
-            uint32_t keyvalue = add_keyvalue(begin, end);
-            return {str, keyvalue, current};
+    while(s0 < e0 && s1 < e1) {
+        if(s0[0] != s1[0]) {
+            return false;
         }
-        if(Invalid != exist) {
-            current = static_cast<uint32_t>(values_[exist].size_);
-            if(Invalid == current) {
-                return InvalidTuple;
-            }
-            if (static_cast<uint32_t>(TomlType::Table) == values_[current].type_) {
-            } else if(static_cast<uint32_t>(TomlType::Array) == values_[current].type_) {
-                uint32_t table = Invalid;
-                if(values_[current].size_ <= 0) {
-                    table = add_table();
-                    append(current, table);
-                } else {
-                    table = find_table(current);
-                    if(Invalid == table) {
-                        table = add_table();
-                        append(current, table);
-                    }
-                }
-                if(Invalid == table) {
-                    return InvalidTuple;
-                }
-                current = table;
-            } else {
-                return InvalidTuple;
-            }
-        } else {
-            uint32_t keyvalue = add_keyvalue(begin, end);
-            if(KeyPlace::ArrayTable == place) {
-                //uint32_t array = add_array();
-                //values_[keyvalue].size_ = array;
-                //append(current, keyvalue);
-
-                uint32_t table = add_table();
-                values_[keyvalue].size_ = table;
-                append(current, keyvalue);
-                current = table;
+        ++s0;
+        ++s1;
+    }
+    return e0<=s0 && e1<=s1;
+}
 
-            } else {
-                uint32_t table = add_table();
-                values_[keyvalue].size_ = table;
-                append(current, keyvalue);
-                current = table;
-            }
-        }
-        str = whitespace(str + 1);
-        if(end_ <= str) {
-            return InvalidTuple;
+uint32_t TomlParser::find_keyvalue(uint32_t table, const char* begin, const char* end)
+{
+    CPPTOML_ASSERT(Invalid != table);
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(CPPTOML_NULL != end);
+    if(IndexedChildren < values_[table].size_) {
+        return find_entry(table, begin, end, key_hash(begin, end), Invalid);
+    }
+    uint32_t node = static_cast<uint32_t>(values_[table].start_);
+    while(Invalid != node) {
+        CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::KeyValue) == values_[node].type_);
+        uint64_t key = values_[node].start_;
+        const char* s1 = begin_ + values_[key].start_;
+        const char* e1 = s1 + values_[key].size_;
+        if(TomlParser::strcmp(begin, end, s1, e1)) {
+            return node;
         }
+        node = values_[node].next_;
     }
+    return Invalid;
 }
 
-const char* TomlParser::parse_unquated_key(const char* str) const
+uint32_t TomlParser::find_keyvalue(uint32_t table, uint32_t key)
 {
-    while(str < end_) {
-        if(!parse_unquated_key_char(str)) {
-            return str;
+    CPPTOML_ASSERT(Invalid != table);
+    CPPTOML_ASSERT(Invalid != key);
+    if(IndexedChildren < values_[table].size_) {
+        const InternKey& interned = keys_.keys_[key];
+        return find_entry(table, interned.key_, interned.key_ + interned.size_, interned.hash_, key);
+    }
+    uint32_t node = static_cast<uint32_t>(values_[table].start_);
+    while(Invalid != node) {
+        CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::KeyValue) == values_[node].type_);
+        if(key == values_[values_[node].start_].next_) {
+            return node;
         }
+        node = values_[node].next_;
     }
-    return str;
+    return Invalid;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_value(const char* str)
+uint32_t TomlParser::find_entry(uint32_t table, const char* begin, const char* end, uint32_t hash, uint32_t key)
 {
-    const char* next = CPPTOML_NULL;
-    TomlType type = TomlType::Invalid;
-    switch(str[0]) {
-    case '"':
-        type = TomlType::String;
-        if((str + 2) < end_ && '"' == str[1] && '"' == str[2]) {
-            next = parse_ml_basic_string(str);
-        } else {
-            next = parse_basic_string(str);
-        }
-        break;
-    case '\'':
-        type = TomlType::String;
-        if((str + 2) < end_ && '\'' == str[1] && '\'' == str[2]) {
-            next = parse_ml_literal_string(str);
-        } else {
-            next = parse_literal_string(str);
-        }
-        break;
-    case 't':
-        type = TomlType::True;
-        next = parse_true(str);
-        break;
-    case 'f':
-        type = TomlType::False;
-        next = parse_false(str);
-        break;
-    case '[':
-        return parse_array(str);
-    case '{':
-        return parse_inline_table(str);
-    default:
-        if(('0' <= str[0] && str[0] <= '9') || '-' == str[0] || '+' == str[0]) {
-            auto [n, v] = parse_number(str);
-            if(CPPTOML_NULL != n) {
-                return {n, v};
+    // the pairs appended since the last call go into the index first
+    last_child(table);
+    uint32_t mask = entries_.capacity_ - 1;
+    uint32_t slot = (hash ^ (table * 0x9E3779B1U)) & mask;
+    while(Invalid != entries_.slots_[slot].table_) {
+        const KeyEntry& entry = entries_.slots_[slot];
+        if(table == entry.table_) {
+            const TomlValue& other = values_[values_[entry.keyvalue_].start_];
+            if(Invalid != key) {
+                if(key == other.next_) {
+                    return entry.keyvalue_;
+                }
+            } else if(TomlParser::strcmp(begin, end, begin_ + other.start_, begin_ + other.start_ + other.size_)) {
+                return entry.keyvalue_;
             }
         }
-        break;
-    }
-    if(CPPTOML_NULL != next) {
-        uint32_t value = add_value(type, str, next);
-        return {next, value};
+        slot = (slot + 1) & mask;
     }
-    return InvalidPair;
+    return Invalid;
 }
 
-bool TomlParser::value(const char* str) const
+void TomlParser::add_entry(uint32_t table, uint32_t keyvalue)
 {
-    if(end_ <= str) {
-        return false;
-    }
-    switch(str[0]) {
-    case '"':
-    case '\'':
-    case 't':
-    case 'f':
-    case '[':
-    case '{':
-        return true;
-    default:
-        if('0' <= str[0] && str[0] <= '9') {
-            return true;
+    CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::KeyValue) == values_[keyvalue].type_);
+    if(entries_.capacity_ <= entries_.size_ * 2) {
+        uint32_t capacity = (0 < entries_.capacity_) ? entries_.capacity_ * 2 : 256;
+        KeyEntry* slots = reinterpret_cast<KeyEntry*>(allocator_(sizeof(KeyEntry) * capacity));
+        ::memset(slots, 0xFF, sizeof(KeyEntry) * capacity);
+        KeyEntry* old = entries_.slots_;
+        uint32_t count = entries_.capacity_;
+        entries_.slots_ = slots;
+        entries_.capacity_ = capacity;
+        entries_.size_ = 0;
+        for(uint32_t i = 0; i < count; ++i) {
+            if(Invalid != old[i].table_) {
+                add_entry(old[i].table_, old[i].keyvalue_);
+            }
         }
-        break;
+        deallocator_(old);
     }
-    return false;
+    const TomlValue& key = values_[values_[keyvalue].start_];
+    const char* begin = begin_ + key.start_;
+    uint32_t mask = entries_.capacity_ - 1;
+    uint32_t slot = (key_hash(begin, begin + key.size_) ^ (table * 0x9E3779B1U)) & mask;
+    while(Invalid != entries_.slots_[slot].table_) {
+        slot = (slot + 1) & mask;
+    }
+    entries_.slots_[slot] = {table, keyvalue};
+    ++entries_.size_;
 }
 
-const char* TomlParser::parse_basic_string(const char* str)
+uint32_t TomlParser::intern_key(const char* begin, const char* end, uint32_t hash)
 {
-    CPPTOML_ASSERT('"' == str[0]);
-    ++str;
-    while(str < end_) {
-        if('"' == str[0]) {
-            return str + 1;
+    uint32_t size = static_cast<uint32_t>(end - begin);
+    uint32_t mask = keys_.capacity_ * 2 - 1;
+    uint32_t slot = hash & mask;
+    if(0 < keys_.capacity_) {
+        for(;;) {
+            uint32_t id = keys_.slots_[slot];
+            if(Invalid == id) {
+                break;
+            }
+            const InternKey& key = keys_.keys_[id];
+            if(hash == key.hash_ && size == key.size_ && 0 == ::memcmp(key.key_, begin, size)) {
+                return id;
+            }
+            slot = (slot + 1) & mask;
         }
-        if(basic_char(str)) {
-            continue;
+    }
+    if(keys_.capacity_ <= keys_.size_) {
+        uint32_t capacity = (0 < keys_.capacity_) ? keys_.capacity_ * 2 : 64;
+        InternKey* keys = reinterpret_cast<InternKey*>(allocator_(sizeof(InternKey) * capacity));
+        if(0 < keys_.size_) {
+            ::memcpy(keys, keys_.keys_, sizeof(InternKey) * keys_.size_);
+        }
+        deallocator_(keys_.keys_);
+        deallocator_(keys_.slots_);
+        keys_.keys_ = keys;
+        keys_.slots_ = reinterpret_cast<uint32_t*>(allocator_(sizeof(uint32_t) * capacity * 2));
+        ::memset(keys_.slots_, 0xFF, sizeof(uint32_t) * capacity * 2);
+        keys_.capacity_ = capacity;
+        uint32_t count = keys_.size_;
+        keys_.size_ = 0;
+        for(uint32_t i = 0; i < count; ++i) {
+            intern_key(keys_.keys_[i].key_, keys_.keys_[i].key_ + keys_.keys_[i].size_, keys_.keys_[i].hash_);
+        }
+        mask = capacity * 2 - 1;
+        slot = hash & mask;
+        while(Invalid != keys_.slots_[slot]) {
+            slot = (slot + 1) & mask;
         }
-        break;
     }
-    return CPPTOML_NULL;
+    uint32_t id = keys_.size_;
+    keys_.keys_[id] = {begin, size, hash};
+    keys_.slots_[slot] = id;
+    ++keys_.size_;
+    return id;
 }
 
-const char* TomlParser::parse_literal_string(const char* str)
+void TomlParser::reset_keys()
 {
-    CPPTOML_ASSERT('\'' == str[0]);
-    ++str;
-    while(str < end_) {
-        if('\'' == str[0]) {
-            return str + 1;
-        }
-        if(literal_char(str)) {
-            continue;
-        }
-        break;
+    if(keys_.pinned_ == keys_.size_) {
+        return;
+    }
+    // Keys of the last document point into its bytes, only the pinned keys are inserted again.
+    ::memset(keys_.slots_, 0xFF, sizeof(uint32_t) * keys_.capacity_ * 2);
+    uint32_t count = keys_.pinned_;
+    keys_.size_ = 0;
+    for(uint32_t i = 0; i < count; ++i) {
+        intern_key(keys_.keys_[i].key_, keys_.keys_[i].key_ + keys_.keys_[i].size_, keys_.keys_[i].hash_);
     }
-    return CPPTOML_NULL;
 }
 
-const char* TomlParser::parse_ml_basic_string(const char* str)
+uint32_t TomlParser::find_table(uint32_t array)
 {
-    CPPTOML_ASSERT('"' == str[0] && '"' == str[1] && '"' == str[2]);
-    str += 3;
-    str = newline(str);
-
-    for(;;) {
-        const char* next = parse_mlb_content(str);
-        if(next == str) {
-            break;
+    CPPTOML_ASSERT(Invalid != array);
+    if(array == array_table_.array_) {
+        return array_table_.tail_;
+    }
+    uint32_t tail = last_child(array);
+    if(Invalid == tail || static_cast<uint32_t>(TomlType::Table) == values_[tail].type_) {
+        return tail;
+    }
+    // the last table in an array of values
+    uint32_t table = Invalid;
+    for(uint32_t node = static_cast<uint32_t>(values_[array].start_); Invalid != node; node = values_[node].next_) {
+        if(static_cast<uint32_t>(TomlType::Table) == values_[node].type_) {
+            table = node;
         }
-        str = next;
     }
+    return table;
+}
 
-    while(str < end_) {
-        if(!parse_mlb_quotes(str)) {
-            break;
+uint32_t TomlParser::last_child(uint32_t parent)
+{
+    CPPTOML_ASSERT(Invalid != parent);
+    uint32_t node = static_cast<uint32_t>(values_[parent].start_);
+    if(Invalid == node || values_[parent].size_ <= IndexedChildren) {
+        while(Invalid != node && Invalid != values_[node].next_) {
+            node = values_[node].next_;
         }
-        while(str < end_) {
-            const char* next = parse_mlb_content(str);
-            if(next == str) {
-                break;
+        return node;
+    }
+    // Children are only appended, the walk goes on from where the last call stopped.
+    if(tails_.capacity_ <= tails_.size_ * 2) {
+        uint32_t capacity = (0 < tails_.capacity_) ? tails_.capacity_ * 2 : 64;
+        ChildTail* slots = reinterpret_cast<ChildTail*>(allocator_(sizeof(ChildTail) * capacity));
+        ::memset(slots, 0xFF, sizeof(ChildTail) * capacity);
+        for(uint32_t i = 0; i < tails_.capacity_; ++i) {
+            if(Invalid != tails_.slots_[i].parent_) {
+                uint32_t slot = (tails_.slots_[i].parent_ * 0x9E3779B1U) & (capacity - 1);
+                while(Invalid != slots[slot].parent_) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                slots[slot] = tails_.slots_[i];
             }
-            str = next;
+        }
+        deallocator_(tails_.slots_);
+        tails_.slots_ = slots;
+        tails_.capacity_ = capacity;
+    }
+    uint32_t mask = tails_.capacity_ - 1;
+    uint32_t slot = (parent * 0x9E3779B1U) & mask;
+    while(Invalid != tails_.slots_[slot].parent_ && parent != tails_.slots_[slot].parent_) {
+        slot = (slot + 1) & mask;
+    }
+    ChildTail& tail = tails_.slots_[slot];
+    bool table = static_cast<uint32_t>(TomlType::Table) == values_[parent].type_;
+    if(Invalid == tail.parent_) {
+        tail = {parent, node};
+        ++tails_.size_;
+        if(table) {
+            add_entry(parent, node);
         }
     }
-    parse_mlb_quotes(str);
-    if(end_ <= (str + 2)) {
-        return CPPTOML_NULL;
-    }
-    if('"' == str[0] && '"' == str[1] && '"' == str[2]) {
-        return str + 3;
+    while(Invalid != values_[tail.tail_].next_) {
+        tail.tail_ = values_[tail.tail_].next_;
+        if(table) {
+            add_entry(parent, tail.tail_);
+        }
     }
-    return CPPTOML_NULL;
+    return tail.tail_;
 }
 
-const char* TomlParser::parse_mlb_content(const char* str)
+bool TomlParser::has_child_table(uint32_t table) const
 {
-    switch(str[0]) {
-    case 0x0A:
-    case 0x0D:
-        return newline(str);
-    case 0x5C: // escape
-        return parse_mlb_escaped_nl(str);
-    default:
-        if(basic_char(str)) {
-            return str;
+    CPPTOML_ASSERT(Invalid != table);
+    if(Invalid == values_[table].start_) {
+        return false;
+    }
+    uint32_t node = static_cast<uint32_t>(values_[table].start_);
+    while(Invalid != node) {
+        CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::KeyValue) == values_[node].type_);
+        if (static_cast<uint32_t>(TomlType::Table) == values_[values_[node].size_].type_) {
+            return true;
         }
-        break;
+        node = values_[node].next_;
     }
-    return str;
+    return false;
 }
 
-const char* TomlParser::parse_mlb_escaped_nl(const char* str)
+void TomlParser::clear()
 {
-    CPPTOML_ASSERT(0x5C == str[0]);
-    str = whitespace(str + 1);
-    str = newline(str);
-    while(str < end_) {
-        switch(str[0]) {
-        case 0x0A:
-        case 0x0D:
-            str = newline(str);
-            break;
-        case 0x09:
-        case 0x20:
-            str = whitespace(str);
-            break;
-        default:
-            return str;
-        }
+    current_ = 0;
+}
+
+uint32_t TomlParser::add()
+{
+    if(capacity_ <= size_) {
+        // Grow by half, large documents copy the buffer a logarithmic number of times.
+        uint32_t expand = capacity_ >> 1;
+        reserve(capacity_ + (Expand < expand ? expand : Expand));
     }
-    return str;
+    uint32_t current = size_;
+    ++size_;
+    return current;
 }
 
-bool TomlParser::parse_mlb_quotes(const char*& str)
+void TomlParser::reserve(uint32_t capacity)
 {
-    const char* next = str;
-    uint32_t count = 0;
-    while(next < end_) {
-        if('"' == next[0]) {
-            ++count;
-            ++next;
-            continue;
-        }
-        break;
+    if(capacity <= capacity_) {
+        return;
     }
-    switch(count) {
-    case 0:
-        return false;
-    case 1:
-        return false;
-    case 2:
-        str += 2;
-        return true;
-    case 3:
-        return false;
-    case 4:
-        return false;
-    default:
-        next = str;
-        while(5 <= count) {
-            count -= 2;
-            next += 2;
-        }
-        if(3 == count || 0 == count) {
-            str = next;
-            return true;
-        }
-        return false;
+    TomlValue* values = reinterpret_cast<TomlValue*>(allocator_(sizeof(TomlValue) * capacity));
+    if(0 < size_) {
+        ::memcpy(values, values_, sizeof(TomlValue) * size_);
+    }
+    deallocator_(values_);
+    capacity_ = capacity;
+    values_ = values;
+}
+
+uint32_t TomlParser::add_keyvalue(const char* str, const char* end, uint32_t id)
+{
+    uint32_t key = add_value(TomlType::Key, str, end);
+    values_[key].next_ = id;
+    uint32_t value = add();
+    values_[value].start_ = key;
+    values_[value].size_ = Invalid;
+    values_[value].next_ = Invalid;
+    values_[value].type_ = static_cast<uint32_t>(TomlType::KeyValue);
+    return value;
+}
+
+uint32_t TomlParser::add_value(TomlType type, const char* str, const char* end)
+{
+    uint32_t value = add();
+    values_[value].start_ = static_cast<uint64_t>(str - begin_);
+    values_[value].size_ = static_cast<uint64_t>(end - str);
+    values_[value].next_ = Invalid;
+    values_[value].type_ = static_cast<uint32_t>(type);
+    return value;
+}
+
+uint32_t TomlParser::add_table()
+{
+    uint32_t value = add();
+    values_[value].start_ = Invalid;
+    values_[value].size_ = 0;
+    values_[value].next_ = Invalid;
+    values_[value].type_ = static_cast<uint32_t>(TomlType::Table);
+    return value;
+}
+
+uint32_t TomlParser::add_array()
+{
+    uint32_t value = add();
+    values_[value].start_ = Invalid;
+    values_[value].size_ = 0;
+    values_[value].next_ = Invalid;
+    values_[value].type_ = static_cast<uint32_t>(TomlType::Array);
+    return value;
+}
+
+void TomlParser::append(uint32_t parent, uint32_t value)
+{
+    uint32_t tail = last_child(parent);
+    values_[parent].size_ += 1;
+    if(Invalid == tail) {
+        values_[parent].start_ = value;
+    } else {
+        values_[tail].next_ = value;
     }
 }
 
-const char* TomlParser::parse_ml_literal_string(const char* str)
+//--- TomlDocument
+//---------------------------------------
+TomlDocument::TomlDocument()
+    : shared_(CPPTOML_NULL)
+{
+}
+
+TomlDocument::TomlDocument(TomlShared* shared)
+    : shared_(shared)
 {
-    CPPTOML_ASSERT('\'' == str[0] && '\'' == str[1] && '\'' == str[2]);
-    str += 3;
-    str = newline(str);
+}
 
-    for(;;) {
-        const char* next = parse_mll_content(str);
-        if(next == str) {
-            break;
-        }
-        str = next;
+TomlDocument::TomlDocument(const TomlDocument& other)
+    : shared_(other.shared_)
+{
+    if(CPPTOML_NULL != shared_) {
+        shared_->references_.fetch_add(1, std::memory_order_relaxed);
     }
+}
 
-    while(str < end_) {
-        if(!parse_mll_quotes(str)) {
-            break;
-        }
-        while(str < end_) {
-            const char* next = parse_mll_content(str);
-            if(next == str) {
-                break;
-            }
-            str = next;
-        }
-    }
-    parse_mll_quotes(str);
-    if(end_ <= (str + 2)) {
-        return CPPTOML_NULL;
-    }
-    if('\'' == str[0] && '\'' == str[1] && '\'' == str[2]) {
-        return str + 3;
-    }
-    return CPPTOML_NULL;
+TomlDocument::TomlDocument(TomlDocument&& other)
+    : shared_(other.shared_)
+{
+    other.shared_ = CPPTOML_NULL;
 }
 
-const char* TomlParser::parse_mll_content(const char* str)
+TomlDocument::~TomlDocument()
 {
-    switch(str[0]) {
-    case 0x0A:
-    case 0x0D:
-        return newline(str);
-    default:
-        if(literal_char(str)) {
-            return str;
-        }
-        break;
-    }
-    return str;
+    release();
 }
 
-bool TomlParser::parse_mll_quotes(const char*& str)
+TomlDocument& TomlDocument::operator=(const TomlDocument& other)
 {
-    const char* next = str;
-    uint32_t count = 0;
-    while(next < end_) {
-        if('\'' == next[0]) {
-            ++count;
-            ++next;
-            continue;
-        }
-        break;
-    }
-    switch(count) {
-    case 0:
-        return false;
-    case 1:
-        str += 1;
-        return true;
-    case 2:
-        str += 2;
-        return true;
-    case 3:
-        return false;
-    case 4:
-        str += 1;
-        return true;
-    default:
-        next = str;
-        while(5 <= count) {
-            count -= 2;
-            next += 2;
-        }
-        if(3 == count || 0 == count) {
-            str = next;
-            return true;
+    if(shared_ != other.shared_) {
+        if(CPPTOML_NULL != other.shared_) {
+            other.shared_->references_.fetch_add(1, std::memory_order_relaxed);
         }
-        return false;
+        release();
+        shared_ = other.shared_;
     }
+    return *this;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_table(const char* str)
+TomlDocument& TomlDocument::operator=(TomlDocument&& other)
 {
-    CPPTOML_ASSERT('[' == str[0]);
-    if(end_ <= (str + 1)) {
-        return InvalidPair;
-    }
-    current_ = 0;
-    if(str[1] == '[') {
-        return parse_array_table(str);
-    } else {
-        return parse_std_table(str);
+    if(this != &other) {
+        release();
+        shared_ = other.shared_;
+        other.shared_ = CPPTOML_NULL;
     }
+    return *this;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_std_table(const char* str)
+TomlDocument::operator bool() const
 {
-    CPPTOML_ASSERT('[' == str[0]);
-    str = whitespace(str + 1);
-    if(end_ <= str) {
-        return InvalidPair;
+    return CPPTOML_NULL != shared_;
+}
+
+TomlProxy TomlDocument::root() const
+{
+    if(CPPTOML_NULL == shared_) {
+        return {TomlParser::Invalid, CPPTOML_NULL, CPPTOML_NULL};
     }
-    std::tuple<const char*, uint32_t, uint32_t> keyvalue = parse_key(str, current_, KeyPlace::Table);
-    str = std::get<0>(keyvalue);
-    if(CPPTOML_NULL == str) {
-        return InvalidPair;
+    return {0, shared_->text_, shared_->values_};
+}
+
+uint32_t TomlDocument::use_count() const
+{
+    return (CPPTOML_NULL != shared_) ? shared_->references_.load(std::memory_order_relaxed) : 0;
+}
+
+void TomlDocument::release()
+{
+    if(CPPTOML_NULL == shared_) {
+        return;
     }
-    str = whitespace(str);
-    if(end_ <= str || str[0] != ']') {
-        return InvalidPair;
+    // the last handle sees every write of the others before freeing
+    if(1 == shared_->references_.fetch_sub(1, std::memory_order_acq_rel)) {
+        CPPTOML_FREE_TYPE deallocator = shared_->deallocator_;
+        deallocator(shared_->values_);
+        shared_->~TomlShared();
+        deallocator(shared_);
     }
-    uint32_t table = add_table();
-    values_[std::get<1>(keyvalue)].size_ = table;
-    append(std::get<2>(keyvalue), std::get<1>(keyvalue));
-    current_ = table;
-    return {str + 1, table};
+    shared_ = CPPTOML_NULL;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_array_table(const char* str)
+//--- TomlConfigHandle
+//---------------------------------------
+/**
+ * @brief Published and retired documents of a TomlConfigHandle
+ */
+struct TomlReload
 {
-    CPPTOML_ASSERT('[' == str[0] && '[' == str[1]);
-    str = whitespace(str + 2);
-    if(end_ <= str) {
-        return InvalidPair;
+    static constexpr uint64_t Idle = ~0ULL; //!< a reader out of any epoch
+
+    /**
+     * @brief A reader slot, one cache line each so readers do not share lines
+     */
+    struct Reader
+    {
+        std::atomic<uint64_t> epoch_;
+        std::atomic<bool> used_;
+        char padding_[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<bool>)];
+    };
+
+    /**
+     * @brief A document replaced in epoch_, which readers of that epoch or before may still see
+     */
+    struct Retired
+    {
+        TomlDocument* document_;
+        uint64_t epoch_;
+        Retired* next_;
+    };
+
+    std::atomic<TomlDocument*> current_;
+    std::atomic<uint64_t> epoch_;
+    std::atomic<uint64_t> version_;
+    Reader readers_[TomlConfigHandle::MaxReaders];
+    std::mutex writer_; //!< reloads of the watcher and of the user
+    Retired* retired_;
+    char* path_;
+    std::thread watcher_;
+    std::atomic<bool> stop_;
+    int wake_; //!< an eventfd which stops the watcher
+
+    TomlReload()
+        : current_(CPPTOML_NULL)
+        , epoch_(0)
+        , version_(0)
+        , retired_(CPPTOML_NULL)
+        , path_(CPPTOML_NULL)
+        , stop_(false)
+        , wake_(-1)
+    {
+        for(uint32_t i = 0; i < TomlConfigHandle::MaxReaders; ++i) {
+            readers_[i].epoch_.store(Idle, std::memory_order_relaxed);
+            readers_[i].used_.store(false, std::memory_order_relaxed);
+        }
     }
-    std::tuple<const char*, uint32_t, uint32_t> keyvalue = parse_key(str, current_, KeyPlace::ArrayTable);
-    str = std::get<0>(keyvalue);
-    if(CPPTOML_NULL == str) {
-        return InvalidPair;
+};
+
+TomlConfigHandle::TomlConfigHandle(CPPTOML_MALLOC_TYPE allocator, CPPTOML_FREE_TYPE deallocator)
+    : allocator_(allocator)
+    , deallocator_(deallocator)
+    , state_(CPPTOML_NULL)
+{
+    if(CPPTOML_NULL == allocator_ || CPPTOML_NULL == deallocator_) {
+        allocator_ = ::malloc;
+        deallocator_ = ::free;
     }
-    str = whitespace(str);
-    if(end_ <= (str + 1) || (str[0] != ']' || str[1] != ']')) {
-        return InvalidPair;
+}
+
+TomlConfigHandle::~TomlConfigHandle()
+{
+    close();
+}
+
+bool TomlConfigHandle::open(const char* path)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != path);
+    close();
+    state_ = new(allocator_(sizeof(TomlReload))) TomlReload();
+    size_t length = ::strlen(path);
+    state_->path_ = reinterpret_cast<char*>(allocator_(length + 1));
+    ::memcpy(state_->path_, path, length + 1);
+    if(!reload()) {
+        close();
+        return false;
     }
-    CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::KeyValue) == values_[std::get<1>(keyvalue)].type_);
-    uint32_t array = static_cast < uint32_t>(values_[std::get<1>(keyvalue)].size_);
-    if(Invalid == array) {
-        array = add_array();
-        values_[std::get<1>(keyvalue)].size_ = array;
-        append(std::get<2>(keyvalue), std::get<1>(keyvalue));
+#ifdef __linux__
+    state_->wake_ = ::eventfd(0, EFD_CLOEXEC);
+    if(0 <= state_->wake_) {
+        state_->watcher_ = std::thread([this]() {
+            watch();
+        });
     }
-    CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::Array) == values_[array].type_);
-    uint32_t table = add_table();
-    append(array, table);
-    current_ = table;
-    return {str + 2, current_};
+#endif
+    return true;
 }
 
-const char* TomlParser::parse_true(const char* str)
+void TomlConfigHandle::close()
 {
-    CPPTOML_ASSERT('t' == str[0]);
-    if(end_ <= (str + 3)) {
-        return CPPTOML_NULL;
+    if(CPPTOML_NULL == state_) {
+        return;
     }
-    if('r' == str[1] && 'u' == str[2] && 'e' == str[3]) {
-        return str + 4;
+#ifdef __linux__
+    if(state_->watcher_.joinable()) {
+        state_->stop_.store(true, std::memory_order_release);
+        // without the wake up, the watcher sees stop_ at its next period
+        uint64_t one = 1;
+        bool woken = 0 < ::write(state_->wake_, &one, sizeof(one));
+        static_cast<void>(woken);
+        state_->watcher_.join();
     }
-    return CPPTOML_NULL;
+    if(0 <= state_->wake_) {
+        ::close(state_->wake_);
+    }
+#endif
+    for(TomlReload::Retired* retired = state_->retired_; CPPTOML_NULL != retired;) {
+        TomlReload::Retired* next = retired->next_;
+        retired->document_->~TomlDocument();
+        deallocator_(retired->document_);
+        deallocator_(retired);
+        retired = next;
+    }
+    TomlDocument* current = state_->current_.load(std::memory_order_acquire);
+    if(CPPTOML_NULL != current) {
+        current->~TomlDocument();
+        deallocator_(current);
+    }
+    deallocator_(state_->path_);
+    state_->~TomlReload();
+    deallocator_(state_);
+    state_ = CPPTOML_NULL;
 }
 
-const char* TomlParser::parse_false(const char* str)
+bool TomlConfigHandle::reload()
 {
-    if(end_ <= (str + 4)) {
-        return CPPTOML_NULL;
+    if(CPPTOML_NULL == state_) {
+        return false;
     }
-    if('a' == str[1] && 'l' == str[2] && 's' == str[3] && 'e' == str[4]) {
-        return str + 5;
+    std::lock_guard<std::mutex> lock(state_->writer_);
+    FILE* file = ::fopen(state_->path_, "rb");
+    if(CPPTOML_NULL == file) {
+        return false;
     }
-    return CPPTOML_NULL;
+    TomlParser parser(allocator_, deallocator_);
+    long size = (0 == ::fseek(file, 0, SEEK_END)) ? ::ftell(file) : -1;
+    char* buffer = (0 <= size && 0 == ::fseek(file, 0, SEEK_SET)) ? parser.allocate_padded(static_cast<uint64_t>(size)) : CPPTOML_NULL;
+    bool result = CPPTOML_NULL != buffer && (size <= 0 || 1 == ::fread(buffer, static_cast<size_t>(size), 1, file));
+    ::fclose(file);
+    result = result && parser.parse_padded(buffer, buffer + size);
+    if(result) {
+        // the document keeps its own copy of the text
+        publish(new(allocator_(sizeof(TomlDocument))) TomlDocument(parser.share()));
+    }
+    parser.deallocate_padded(buffer);
+    return result;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_array(const char* str)
+uint64_t TomlConfigHandle::version() const
 {
-    CPPTOML_ASSERT('[' == str[0]);
-    ++str;
-
-    uint32_t array = add_array();
+    return (CPPTOML_NULL != state_) ? state_->version_.load(std::memory_order_acquire) : 0;
+}
 
-    bool sep = false;
-    while(str < end_) {
-        str = ws_comment_newline(str);
-        if(value(str)) {
-            auto [n, v] = parse_value(str);
-            if(CPPTOML_NULL == n) {
-                return InvalidPair;
-            } else {
-                append(array, v);
-            }
-            str = n;
-            sep = false;
-        }
-        str = ws_comment_newline(str);
-        if(end_ <= str) {
-            break;
-        }
-        if(']' == str[0]) {
-            return {str + 1, array};
-        }
-        if(',' == str[0]) {
-            if(sep) {
-                return InvalidPair;
-            }
-            ++str;
-            sep = true;
-            continue;
+uint32_t TomlConfigHandle::attach()
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != state_);
+    for(uint32_t i = 0; i < MaxReaders; ++i) {
+        bool used = false;
+        if(state_->readers_[i].used_.compare_exchange_strong(used, true, std::memory_order_acq_rel)) {
+            return i;
         }
-        break;
     }
-    return InvalidPair;
+    return TomlParser::Invalid;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_inline_table(const char* str)
+void TomlConfigHandle::detach(uint32_t reader)
 {
-    CPPTOML_ASSERT('{' == str[0]);
-    uint32_t previous = current_;
-    uint32_t table = add_table();
-    current_ = table;
-    str = whitespace(str + 1);
-    while(str < end_) {
-        if(keyvalue(str)) {
-            auto [n, v] = parse_keyvalue(str);
-            if(CPPTOML_NULL == n) {
-                return InvalidPair;
-            }
-            append(table, v);
-            str = n;
-        }
-        str = whitespace(str);
-        if(end_ <= str) {
-            break;
-        }
-        if('}' == str[0]) {
-            current_ = previous;
-            return {str + 1, table};
-        }
-        if(',' == str[0]) {
-            str = whitespace(str + 1);
-            continue;
-        }
-        break;
-    }
-    return InvalidPair;
+    CPPTOML_ASSERT(CPPTOML_NULL != state_ && reader < MaxReaders);
+    state_->readers_[reader].epoch_.store(TomlReload::Idle, std::memory_order_release);
+    state_->readers_[reader].used_.store(false, std::memory_order_release);
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_number(const char* str)
+const TomlDocument* TomlConfigHandle::enter(uint32_t reader) const
 {
-    switch(number_type(str)) {
-    case TomlType::Integer:
-        return parse_integer(str);
-    case TomlType::Hex:
-        return parse_hex(str);
-    case TomlType::Oct:
-        return parse_oct(str);
-    case TomlType::Bin:
-        return parse_bin(str);
-    case TomlType::Float:
-        return parse_float(str);
-    case TomlType::Inf:
-        return parse_inf(str);
-    case TomlType::NaN:
-        return parse_nan(str);
-    case TomlType::DateTime:
-        return parse_datetime(str);
-    default:
-        return InvalidPair;
-    }
+    CPPTOML_ASSERT(CPPTOML_NULL != state_ && reader < MaxReaders);
+    // The epoch is announced before the load, so a writer which retires the loaded document sees the announcement.
+    state_->readers_[reader].epoch_.store(state_->epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    return state_->current_.load(std::memory_order_seq_cst);
 }
 
-TomlType TomlParser::number_type(const char* str)
+void TomlConfigHandle::leave(uint32_t reader) const
 {
-    CPPTOML_ASSERT(str < end_);
-    bool sign = false;
-    if('-' == str[0] || '+' == str[0]) {
-        sign = true;
-        ++str;
-        if(end_ <= str) {
-            return TomlType::Invalid;
-        }
-    }
-    switch(str[0]) {
-    case '0':
-        if((str + 1) < end_) {
-            switch(str[1]) {
-            case 'x':
-                return !sign ? TomlType::Hex : TomlType::Invalid;
-            case 'o':
-                return !sign ? TomlType::Oct : TomlType::Invalid;
-            case 'b':
-                return !sign ? TomlType::Bin : TomlType::Invalid;
-            }
-        }
-        break;
-    case 'i':
-        return TomlType::Inf;
-    case 'n':
-        return TomlType::NaN;
-    case '_':
-        return TomlType::Invalid;
-    default:
-        if(!digit(str[0])) {
-            return TomlType::Invalid;
-        }
-        break;
-    }
-    uint32_t rank = 0;
-    bool exp = false;
-    while(str < end_) {
-        switch(str[0]) {
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-            ++rank;
-            break;
-        case '_':
-            break;
-        case '.':
-            return 0 < rank ? TomlType::Float : TomlType::Invalid;
-        case '-':
-            return exp ? TomlType::Float : TomlType::DateTime;
-        case '+':
-            return exp ? TomlType::Float : TomlType::Invalid;
-        case 'e':
-        case 'E':
-            exp = true;
-            rank = 0;
-            break;
-        case 't':
-        case 'T':
-        case 'Z':
-        case ':':
-            return TomlType::DateTime;
-        default:
-            if(exp) {
-                return 0 < rank ? TomlType::Float : TomlType::Invalid;
-            } else {
-                return TomlType::Integer;
-            }
+    CPPTOML_ASSERT(CPPTOML_NULL != state_ && reader < MaxReaders);
+    state_->readers_[reader].epoch_.store(TomlReload::Idle, std::memory_order_release);
+}
+
+void TomlConfigHandle::publish(TomlDocument* document)
+{
+    TomlDocument* old = state_->current_.exchange(document, std::memory_order_seq_cst);
+    if(CPPTOML_NULL != old) {
+        // readers which loaded the old document entered in this epoch or before
+        TomlReload::Retired* retired = reinterpret_cast<TomlReload::Retired*>(allocator_(sizeof(TomlReload::Retired)));
+        retired->document_ = old;
+        retired->epoch_ = state_->epoch_.fetch_add(1, std::memory_order_seq_cst);
+        retired->next_ = state_->retired_;
+        state_->retired_ = retired;
+    }
+    state_->version_.fetch_add(1, std::memory_order_release);
+    reclaim();
+}
+
+void TomlConfigHandle::reclaim()
+{
+    uint64_t oldest = TomlReload::Idle;
+    for(uint32_t i = 0; i < MaxReaders; ++i) {
+        uint64_t epoch = state_->readers_[i].epoch_.load(std::memory_order_seq_cst);
+        oldest = (epoch < oldest) ? epoch : oldest;
+    }
+    TomlReload::Retired** link = &state_->retired_;
+    while(CPPTOML_NULL != *link) {
+        TomlReload::Retired* retired = *link;
+        if(retired->epoch_ < oldest) {
+            *link = retired->next_;
+            retired->document_->~TomlDocument();
+            deallocator_(retired->document_);
+            deallocator_(retired);
+        } else {
+            link = &retired->next_;
         }
-        ++str;
     }
-    return 0 < rank ? TomlType::Integer : TomlType::Invalid;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_integer(const char* str)
+void TomlConfigHandle::watch()
 {
-    CPPTOML_ASSERT(str < end_);
-    bool top_zero = false;
-    uint32_t rank = 0;
-    bool sign = false;
-    bool sep = false;
-    bool loop = true;
-    const char* begin = str;
-    while(str < end_ && loop) {
-        switch(str[0]) {
-        case '0':
-            if(rank <= 0) {
-                top_zero = true;
-            }
-            [[fallthrough]];
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-            ++rank;
-            ++str;
-            sep = false;
-            break;
-        case '_':
-            if(rank <= 0 || sep) {
-                return InvalidPair;
-            }
-            ++str;
-            sep = true;
-            break;
-        case '-':
-        case '+':
-            if(0 < rank) {
-                return InvalidPair;
-            }
-            if(sign) {
-                return InvalidPair;
+#ifdef __linux__
+    // Editors often replace a file by renaming, so the directory is watched for the name.
+    const char* path = state_->path_;
+    const char* slash = ::strrchr(path, '/');
+    const char* name = (CPPTOML_NULL != slash) ? slash + 1 : path;
+    size_t length = (CPPTOML_NULL != slash) ? static_cast<size_t>(slash - path) : 1;
+    char* directory = reinterpret_cast<char*>(allocator_(length + 2));
+    ::memcpy(directory, (CPPTOML_NULL != slash) ? path : ".", length);
+    directory[length] = '\0';
+    if(CPPTOML_NULL != slash && length <= 0) {
+        directory[0] = '/';
+        directory[1] = '\0';
+    }
+    int notify = ::inotify_init1(IN_CLOEXEC);
+    bool watching = 0 <= notify && 0 <= ::inotify_add_watch(notify, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+    deallocator_(directory);
+    static constexpr int Period = 100; //!< milliseconds between reclaims while nothing changes
+    alignas(inotify_event) char events[4096];
+    while(watching && !state_->stop_.load(std::memory_order_acquire)) {
+        pollfd fds[2] = {{notify, POLLIN, 0}, {state_->wake_, POLLIN, 0}};
+        if(::poll(fds, 2, Period) < 0) {
+            // a signal interrupts the wait, only other errors stop watching
+            if(EINTR == errno) {
+                continue;
             }
-            sign = true;
-            ++str;
             break;
-        default:
-            loop = false;
+        }
+        if(0 != (fds[1].revents & POLLIN)) {
             break;
         }
+        bool changed = false;
+        if(0 != (fds[0].revents & POLLIN)) {
+            ssize_t size = ::read(notify, events, sizeof(events));
+            for(ssize_t i = 0; i < size;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(events + i);
+                changed = changed || (0 < event->len && 0 == ::strcmp(event->name, name));
+                i += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            }
+        }
+        if(!changed || !reload()) {
+            std::lock_guard<std::mutex> lock(state_->writer_);
+            reclaim();
+        }
     }
-    if(sep) {
-        return InvalidPair;
-    }
-    if(rank <= 0) {
-        return InvalidPair;
-    }
-    if(top_zero && 1 < rank) {
-        return InvalidPair;
+    if(0 <= notify) {
+        ::close(notify);
     }
-    uint32_t value = add_value(TomlType::Integer, begin, str);
-    return {str, value};
+#endif
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_hex(const char* str)
+//--- TomlBatch
+//---------------------------------------
+TomlBatch::TomlBatch(CPPTOML_MALLOC_TYPE allocator, CPPTOML_FREE_TYPE deallocator)
+    : allocator_(allocator)
+    , deallocator_(deallocator)
+    , options_(0)
+    , size_(0)
+    , parsers_(CPPTOML_NULL)
+    , buffers_(CPPTOML_NULL)
+    , sizes_(CPPTOML_NULL)
+    , shared_(CPPTOML_NULL)
 {
-    CPPTOML_ASSERT(str < end_);
-    if(end_ <= (str + 1) || '0' != str[0] || 'x' != str[1]) {
-        return InvalidPair;
-    }
-    const char* begin = str;
-    str += 2;
-    uint32_t rank = 0;
-    bool sep = false;
-    while(str < end_) {
-        if(hexgidit(str[0])) {
-            ++rank;
-            ++str;
-            sep = false;
-            continue;
-        }
-        if('_' == str[0]) {
-            if(rank <= 0 || sep) {
-                return InvalidPair;
-            }
-            ++str;
-            sep = true;
-            continue;
-        }
-        break;
-    }
-    if(sep) {
-        return InvalidPair;
-    }
-    if(rank <= 0) {
-        return InvalidPair;
+    if(CPPTOML_NULL == allocator_ || CPPTOML_NULL == deallocator_) {
+        allocator_ = ::malloc;
+        deallocator_ = ::free;
     }
-    uint32_t value = add_value(TomlType::Hex, begin, str);
-    return {str, value};
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_oct(const char* str)
+TomlBatch::~TomlBatch()
 {
-    CPPTOML_ASSERT(str < end_);
-    if(end_ <= (str + 1) || '0' != str[0] || 'o' != str[1]) {
-        return InvalidPair;
+    clear();
+}
+
+bool TomlBatch::parse_batch(const char* const* paths, uint32_t count, TomlStatus* results, uint32_t threads)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != paths || count <= 0);
+    clear();
+    if(count <= 0) {
+        return true;
     }
-    const char* begin = str;
-    str += 2;
-    uint32_t rank = 0;
-    bool sep = false;
-    while(str < end_) {
-        if('0' <= str[0] && str[0] <= '7') {
-            ++rank;
-            ++str;
-            sep = false;
-            continue;
+    parsers_ = reinterpret_cast<TomlParser*>(allocator_(sizeof(TomlParser) * count));
+    buffers_ = reinterpret_cast<char**>(allocator_(sizeof(char*) * count));
+    for(uint32_t i = 0; i < count; ++i) {
+        new(&parsers_[i]) TomlParser(allocator_, deallocator_);
+        parsers_[i].set_options(options_ & ~OptionShareBuffer);
+        buffers_[i] = CPPTOML_NULL;
+    }
+    size_ = count;
+    if(0 != (options_ & OptionShareBuffer)) {
+        // sizes are known in advance, so every file is read into its own place of one buffer
+        sizes_ = reinterpret_cast<uint64_t*>(allocator_(sizeof(uint64_t) * count));
+        uint64_t total = 0;
+        for(uint32_t i = 0; i < count; ++i) {
+            sizes_[i] = file_size(paths[i]);
+            if(TomlParser::Invalid != sizes_[i]) {
+                total += sizes_[i] + TomlParser::Padding;
+            }
         }
-        if('_' == str[0]) {
-            if(rank <= 0 || sep) {
-                return InvalidPair;
+        shared_ = reinterpret_cast<char*>(allocator_(static_cast<size_t>(total)));
+        total = 0;
+        for(uint32_t i = 0; i < count; ++i) {
+            if(CPPTOML_NULL != shared_ && TomlParser::Invalid != sizes_[i]) {
+                buffers_[i] = shared_ + total;
+                ::memset(buffers_[i] + sizes_[i], 0, TomlParser::Padding);
+                total += sizes_[i] + TomlParser::Padding;
             }
-            ++str;
-            sep = true;
-            continue;
         }
-        break;
-    }
-    if(sep) {
-        return InvalidPair;
-    }
-    if(rank <= 0) {
-        return InvalidPair;
     }
-    uint32_t value = add_value(TomlType::Oct, begin, str);
-    return {str, value};
+
+    if(count < threads) {
+        threads = count;
+    }
+    if(threads <= 0) {
+        threads = 1;
+    }
+    std::atomic<uint32_t> next(0);
+    std::atomic<uint32_t> failures(0);
+    auto work = [this, paths, count, results, &next, &failures]() {
+        for(uint32_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            TomlStatus status = parse_file(i, paths[i]);
+            if(CPPTOML_NULL != results) {
+                results[i] = status;
+            }
+            if(TomlStatus::Success != status) {
+                failures.fetch_add(1);
+            }
+        }
+    };
+    std::thread* workers = reinterpret_cast<std::thread*>(allocator_(sizeof(std::thread) * threads));
+    for(uint32_t i = 1; i < threads; ++i) {
+        new(&workers[i]) std::thread(work);
+    }
+    work();
+    for(uint32_t i = 1; i < threads; ++i) {
+        workers[i].join();
+        workers[i].~thread();
+    }
+    deallocator_(workers);
+    return failures.load() <= 0;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_bin(const char* str)
+void TomlBatch::set_options(uint32_t options)
 {
-    CPPTOML_ASSERT(str < end_);
-    if(end_ <= (str + 1) || '0' != str[0] || 'b' != str[1]) {
-        return InvalidPair;
-    }
-    const char* begin = str;
-    str += 2;
-    uint32_t rank = 0;
-    bool sep = false;
-    while(str < end_) {
-        if('0' <= str[0] && str[0] <= '1') {
-            ++rank;
-            ++str;
-            sep = false;
-            continue;
-        }
-        if('_' == str[0]) {
-            if(rank <= 0 || sep) {
-                return InvalidPair;
-            }
-            ++str;
-            sep = true;
-            continue;
+    options_ = options;
+}
+
+uint32_t TomlBatch::get_options() const
+{
+    return options_;
+}
+
+uint32_t TomlBatch::size() const
+{
+    return size_;
+}
+
+const TomlParser& TomlBatch::document(uint32_t index) const
+{
+    CPPTOML_ASSERT(index < size_);
+    return parsers_[index];
+}
+
+void TomlBatch::clear()
+{
+    for(uint32_t i = 0; i < size_; ++i) {
+        parsers_[i].~TomlParser();
+        if(CPPTOML_NULL == sizes_) {
+            deallocator_(buffers_[i]);
         }
-        break;
     }
-    if(sep) {
-        return InvalidPair;
+    deallocator_(shared_);
+    deallocator_(sizes_);
+    deallocator_(buffers_);
+    deallocator_(parsers_);
+    size_ = 0;
+    parsers_ = CPPTOML_NULL;
+    buffers_ = CPPTOML_NULL;
+    sizes_ = CPPTOML_NULL;
+    shared_ = CPPTOML_NULL;
+}
+
+uint64_t TomlBatch::file_size(const char* path) const
+{
+    FILE* file = ::fopen(path, "rb");
+    if(CPPTOML_NULL == file) {
+        return TomlParser::Invalid;
     }
-    if(rank <= 0) {
-        return InvalidPair;
+    long size = (0 == ::fseek(file, 0, SEEK_END)) ? ::ftell(file) : -1;
+    ::fclose(file);
+    return (size < 0) ? TomlParser::Invalid : static_cast<uint64_t>(size);
+}
+
+TomlStatus TomlBatch::parse_file(uint32_t index, const char* path)
+{
+    if(CPPTOML_NULL == sizes_) {
+        return parsers_[index].parse_file(path);
+    }
+    FILE* file = ::fopen(path, "rb");
+    if(CPPTOML_NULL == file) {
+        return TomlStatus::FileError;
+    }
+    long size = (0 == ::fseek(file, 0, SEEK_END)) ? ::ftell(file) : -1;
+    // the file changed since its size was taken
+    bool result = 0 <= size && 0 == ::fseek(file, 0, SEEK_SET) && static_cast<uint64_t>(size) == sizes_[index];
+    char* buffer = buffers_[index];
+    result = result && CPPTOML_NULL != buffer && (size <= 0 || 1 == ::fread(buffer, static_cast<size_t>(size), 1, file));
+    ::fclose(file);
+    if(!result) {
+        return TomlStatus::FileError;
+    }
+    return parsers_[index].parse_padded(buffer, buffer + size) ? TomlStatus::Success : TomlStatus::ParseError;
+}
+
+//--- TomlReader
+//---------------------------------------
+TomlReader::iterator::iterator(TomlReader* reader)
+    : reader_(reader)
+{
+}
+
+const TomlEvent& TomlReader::iterator::operator*() const
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != reader_);
+    return reader_->event_;
+}
+
+const TomlEvent* TomlReader::iterator::operator->() const
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != reader_);
+    return &reader_->event_;
+}
+
+TomlReader::iterator& TomlReader::iterator::operator++()
+{
+    if(CPPTOML_NULL != reader_ && !reader_->next()) {
+        reader_ = CPPTOML_NULL;
     }
-    uint32_t value = add_value(TomlType::Bin, begin, str);
-    return {str, value};
+    return *this;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_float(const char* str)
+bool TomlReader::iterator::operator==(const iterator& other) const
 {
-    auto [n, v] = parse_integer(str);
-    if(CPPTOML_NULL == n || end_ <= n) {
-        return InvalidPair;
+    return reader_ == other.reader_;
+}
+
+bool TomlReader::iterator::operator!=(const iterator& other) const
+{
+    return reader_ != other.reader_;
+}
+
+TomlReader::TomlReader(CPPTOML_MALLOC_TYPE allocator, CPPTOML_FREE_TYPE deallocator)
+    : parser_(allocator, deallocator)
+    , str_(CPPTOML_NULL)
+    , state_(ReaderState::End)
+    , after_(false)
+    , failed_(false)
+    , event_{TomlEventType::Value, TomlType::Invalid, {CPPTOML_NULL, CPPTOML_NULL}}
+    , frames_(CPPTOML_NULL)
+    , depth_(0)
+    , path_(CPPTOML_NULL)
+    , path_size_(0)
+    , path_capacity_(0)
+    , mark_(TomlParser::Invalid)
+    , restore_(TomlParser::Invalid)
+{
+}
+
+TomlReader::~TomlReader()
+{
+    parser_.deallocator_(path_);
+    parser_.deallocator_(frames_);
+}
+
+void TomlReader::open(const char* begin, const char* end)
+{
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(begin <= end);
+    parser_.kernels_ = current_kernels(false);
+    parser_.threads_ = 1;
+    parser_.begin_document(begin, end);
+    if(CPPTOML_NULL == frames_) {
+        frames_ = reinterpret_cast<ReaderFrame*>(parser_.allocator_(sizeof(ReaderFrame) * TomlParser::MaxNesting));
+    }
+    str_ = parser_.bom(parser_.begin_);
+    state_ = ReaderState::Expression;
+    after_ = false;
+    failed_ = false;
+    event_ = {TomlEventType::Value, TomlType::Invalid, {CPPTOML_NULL, CPPTOML_NULL}};
+    depth_ = 0;
+    path_size_ = 0;
+    mark_ = TomlParser::Invalid;
+    restore_ = TomlParser::Invalid;
+}
+
+bool TomlReader::next()
+{
+    if(failed_ || ReaderState::End == state_) {
+        return false;
     }
-    switch(n[0]) {
-    case '.':
-        n = parse_frac(n);
-        break;
-    case 'e':
-    case 'E':
-        n = parse_exp(n);
-        break;
+    // the path of the last event stays until the next one
+    if(TomlParser::Invalid != restore_) {
+        path_size_ = restore_;
+        restore_ = TomlParser::Invalid;
+    }
+    switch(state_) {
+    case ReaderState::Expression:
+        return read_expression();
+    case ReaderState::Value:
+        return read_value();
+    case ReaderState::Container:
+        return read_container();
     default:
-        break;
-    }
-    if(CPPTOML_NULL == n) {
-        return InvalidPair;
+        return false;
     }
-    values_[v].type_ = static_cast<uint32_t>(TomlType::Float);
-    values_[v].size_ = static_cast<uint64_t>(n - str);
-    return {n, v};
 }
 
-const char* TomlParser::parse_frac(const char* str)
+bool TomlReader::skip_value()
 {
-    CPPTOML_ASSERT('.' == str[0]);
-    ++str;
-    str = parse_zero_prefixable_int(str);
-    if(str == CPPTOML_NULL) {
-        return CPPTOML_NULL;
+    if(failed_) {
+        return false;
     }
-    if(str < end_ && ('e' == str[0] || 'E' == str[0])) {
-        return parse_exp(str);
+    if(ReaderState::Value == state_) {
+        // the value of the last key
+        const char* str = str_;
+        uint32_t restore = mark_;
+        mark_ = TomlParser::Invalid;
+        TomlType type = TomlType::Invalid;
+        if('[' == str[0] || '{' == str[0]) {
+            uint32_t count = 0;
+            const char* close = array_commas(str, parser_.end_, ~0ULL, CPPTOML_NULL, 0, count);
+            if(CPPTOML_NULL == close) {
+                return fail();
+            }
+            type = ('[' == str[0]) ? TomlType::Array : TomlType::Table;
+            str_ = close + 1;
+        } else {
+            uint32_t size = parser_.size_;
+            auto [n, v] = parser_.parse_scalar(str);
+            if(CPPTOML_NULL == n) {
+                return fail();
+            }
+            type = static_cast<TomlType>(parser_.values_[v].type_);
+            parser_.size_ = size;
+            str_ = n;
+        }
+        path_size_ = restore;
+        return complete(type) || fail();
+    }
+    if(ReaderState::Container == state_
+       && (TomlEventType::ArrayBegin == event_.type_ || TomlEventType::InlineTableBegin == event_.type_)) {
+        // the rest of the container which has just begun
+        const ReaderFrame& frame = frames_[depth_ - 1];
+        uint32_t count = 0;
+        const char* close = array_commas(frame.open_, parser_.end_, ~0ULL, CPPTOML_NULL, 0, count);
+        if(CPPTOML_NULL == close) {
+            return fail();
+        }
+        str_ = close + 1;
+        path_size_ = frame.restore_;
+        --depth_;
+        return complete(frame.array_ ? TomlType::Array : TomlType::Table) || fail();
     }
-    return str;
+    return false;
 }
 
-const char* TomlParser::parse_exp(const char* str)
+bool TomlReader::failed() const
 {
-    CPPTOML_ASSERT('e' == str[0] || 'E' == str[0]);
-    ++str;
-    if(end_ <= str) {
-        return CPPTOML_NULL;
-    }
-    if('-' == str[0] || '+' == str[0]) {
-        ++str;
-    }
-    return parse_zero_prefixable_int(str);
+    return failed_;
 }
 
-const char* TomlParser::parse_zero_prefixable_int(const char* str)
+const TomlEvent& TomlReader::event() const
 {
-    uint32_t rank = 0;
-    bool sep = false;
-    while(str < end_) {
-        if(digit(str[0])) {
-            ++rank;
-            ++str;
-            sep = false;
-            continue;
+    return event_;
+}
+
+const TomlSpan* TomlReader::path() const
+{
+    return path_;
+}
+
+uint32_t TomlReader::path_size() const
+{
+    return path_size_;
+}
+
+TomlReader::iterator TomlReader::begin()
+{
+    return iterator(next() ? this : CPPTOML_NULL);
+}
+
+TomlReader::iterator TomlReader::end()
+{
+    return iterator(CPPTOML_NULL);
+}
+
+bool TomlReader::read_expression()
+{
+    const char* str = str_;
+    // blank lines and comments, a finished expression needs its newline
+    for(;;) {
+        str = parser_.whitespace(str);
+        str = parser_.comment(str);
+        if(CPPTOML_NULL == str) {
+            return fail();
         }
-        if('_' == str[0]) {
-            if(rank <= 0 || sep) {
-                return CPPTOML_NULL;
+        const char* next = parser_.newline(str);
+        if(str == next && str < parser_.end_) {
+            if(after_) {
+                return fail();
             }
-            ++str;
-            sep = true;
-            continue;
+            break;
         }
-        break;
-    }
-    if(sep) {
-        return CPPTOML_NULL;
-    }
-    if(rank <= 0) {
-        return CPPTOML_NULL;
+        after_ = false;
+        if(parser_.end_ <= next) {
+            str_ = next;
+            state_ = ReaderState::End;
+            return false;
+        }
+        str = next;
     }
-    return str;
-}
 
-std::tuple<const char*, uint32_t> TomlParser::parse_inf(const char* str)
-{
-    const char* begin = str;
-    if('-' == str[0] || '+' == str[0]) {
-        ++str;
+    if('[' == str[0]) {
+        if(parser_.end_ <= (str + 1)) {
+            return fail();
+        }
+        bool array = '[' == str[1];
+        str = parser_.whitespace(str + (array ? 2 : 1));
+        if(parser_.end_ <= str) {
+            return fail();
+        }
+        str = parser_.event_key(str);
+        if(CPPTOML_NULL == str) {
+            return fail();
+        }
+        if(array) {
+            if(parser_.end_ <= (str + 1) || ']' != str[0] || ']' != str[1]) {
+                return fail();
+            }
+            str += 2;
+        } else {
+            if(parser_.end_ <= str || ']' != str[0]) {
+                return fail();
+            }
+            str += 1;
+        }
+        const TomlSpan* spans = parser_.spans_.spans_;
+        uint32_t size = parser_.spans_.size_;
+        path_size_ = 0;
+        push_path(spans, size);
+        event_ = {array ? TomlEventType::ArrayTableHeader : TomlEventType::TableHeader, TomlType::Invalid, {spans[0].begin_, spans[size - 1].end_}};
+        str_ = str;
+        after_ = true;
+        return true;
     }
-    if(end_ <= (str + 2) || 'i' != str[0] || 'n' != str[1] || 'f' != str[2]) {
-        return InvalidPair;
+    const char* next = str;
+    if('"' != str[0] && '\'' != str[0] && !parser_.parse_unquated_key_char(next)) {
+        return fail();
     }
-    str += 3;
-    uint32_t value = add_value(TomlType::Inf, begin, str);
-    return {str, value};
+    return read_key(str);
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_nan(const char* str)
+bool TomlReader::read_key(const char* str)
 {
-    const char* begin = str;
-    if('-' == str[0] || '+' == str[0]) {
-        ++str;
-    }
-    if(end_ <= (str + 2) || 'n' != str[0] || 'a' != str[1] || 'n' != str[2]) {
-        return InvalidPair;
-    }
-    str += 3;
-    uint32_t value = add_value(TomlType::Inf, begin, str);
-    return {str, value};
+    str = parser_.event_key(str);
+    if(CPPTOML_NULL == str || parser_.end_ <= str || 0x3D != str[0]) {
+        return fail();
+    }
+    const TomlSpan* spans = parser_.spans_.spans_;
+    uint32_t size = parser_.spans_.size_;
+    mark_ = path_size_;
+    push_path(spans, size);
+    event_ = {TomlEventType::Key, TomlType::Invalid, {spans[0].begin_, spans[size - 1].end_}};
+    str = parser_.whitespace(str + 1);
+    if(parser_.end_ <= str) {
+        return fail();
+    }
+    str_ = str;
+    state_ = ReaderState::Value;
+    return true;
 }
 
-std::tuple<const char*, uint32_t> TomlParser::parse_datetime(const char* str)
+bool TomlReader::read_value()
 {
-    const char* begin = str;
-    if(end_ <= (str + 2)) {
-        return InvalidPair;
-    }
-    if(':' == str[2]) {
-        const char* n = parse_partial_time(str);
-        if(CPPTOML_NULL == n) {
-            return InvalidPair;
+    const char* str = str_;
+    uint32_t restore = (TomlParser::Invalid != mark_) ? mark_ : path_size_;
+    mark_ = TomlParser::Invalid;
+    if('[' == str[0] || '{' == str[0]) {
+        if(static_cast<uint32_t>(TomlParser::MaxNesting) <= depth_) {
+            return fail();
         }
-        uint32_t v = add_value(TomlType::DateTime, begin, n);
-        return {n, v};
+        bool array = '[' == str[0];
+        frames_[depth_] = {str, restore, TomlType::Invalid, array, true};
+        ++depth_;
+        event_ = {array ? TomlEventType::ArrayBegin : TomlEventType::InlineTableBegin, array ? TomlType::Array : TomlType::Table, {str, str + 1}};
+        str_ = str + 1;
+        state_ = ReaderState::Container;
+        return true;
     }
+    // the scalar node is taken back at once
+    uint32_t size = parser_.size_;
+    auto [n, v] = parser_.parse_scalar(str);
+    if(CPPTOML_NULL == n) {
+        return fail();
+    }
+    TomlType type = static_cast<TomlType>(parser_.values_[v].type_);
+    parser_.size_ = size;
+    event_ = {TomlEventType::Value, type, {str, n}};
+    str_ = n;
+    restore_ = restore;
+    return complete(type) || fail();
+}
 
-    str = parse_fulldate(str);
-    if(CPPTOML_NULL == str) {
-        return InvalidPair;
-    }
-    if(end_ <= (str + 3) || ':' != str[3]) {
-        uint32_t v = add_value(TomlType::DateTime, begin, str);
-        return {str, v};
-    }
-    if('T' != str[0] && 't' != str[0] && ' ' != str[0]) {
-        return InvalidPair;
-    }
-    str = parse_partial_time(str + 1);
+bool TomlReader::read_container()
+{
+    // one step of the inner loop of TomlParser::event_value
+    ReaderFrame& frame = frames_[depth_ - 1];
+    const char* str = parser_.event_element(str_, frame.array_, frame.expect_);
     if(CPPTOML_NULL == str) {
-        return InvalidPair;
-    }
-    if((str + 1) < end_ && ('z' == str[0] || 'Z' == str[0])) {
-        uint32_t v = add_value(TomlType::DateTime, begin, str + 1);
-        return {str + 1, v};
+        return fail();
     }
-    if(end_ <= (str + 3) || (':' != str[2] && ':' != str[3])) {
-        uint32_t v = add_value(TomlType::DateTime, begin, str);
-        return {str, v};
+    if(']' == str[0] || '}' == str[0]) {
+        TomlType type = frame.array_ ? TomlType::Array : TomlType::Table;
+        --depth_;
+        event_ = {frame.array_ ? TomlEventType::ArrayEnd : TomlEventType::InlineTableEnd, type, {str, str + 1}};
+        str_ = str + 1;
+        restore_ = frame.restore_;
+        return complete(type) || fail();
     }
-    str = parse_timeoffset(str);
-    if(CPPTOML_NULL == str) {
-        return InvalidPair;
+    if(frame.array_) {
+        str_ = str;
+        return read_value();
     }
-    uint32_t v = add_value(TomlType::DateTime, begin, str);
-    return {str, v};
+    return read_key(str);
 }
 
-const char* TomlParser::parse_fulldate(const char* str)
+bool TomlReader::complete(TomlType type)
 {
-    if(end_ <= (str + 9)) {
-        return CPPTOML_NULL;
-    }
-    if(!digit(str[0]) || !digit(str[1]) || !digit(str[2]) || !digit(str[3])) {
-        return CPPTOML_NULL;
-    }
-    if('-' != str[4]) {
-        return CPPTOML_NULL;
-    }
-    if(!digit(str[5]) || !digit(str[6])) {
-        return CPPTOML_NULL;
-    }
-    if('-' != str[7]) {
-        return CPPTOML_NULL;
+    if(depth_ <= 0) {
+        state_ = ReaderState::Expression;
+        after_ = true;
+        return true;
     }
-    if(!digit(str[8]) || !digit(str[9])) {
-        return CPPTOML_NULL;
+    ReaderFrame& frame = frames_[depth_ - 1];
+    if(frame.array_ && !same_kind(frame.kind_, static_cast<uint32_t>(type))) {
+        return false;
     }
-    return str + 10;
+    state_ = ReaderState::Container;
+    return true;
 }
 
-const char* TomlParser::parse_partial_time(const char* str)
+bool TomlReader::fail()
 {
-    if(end_ <= (str + 4)) {
-        return CPPTOML_NULL;
-    }
-    if(!digit(str[0]) || !digit(str[1])) {
-        return CPPTOML_NULL;
-    }
-    if(':' != str[2]) {
-        return CPPTOML_NULL;
-    }
-    if(!digit(str[3]) || !digit(str[4])) {
-        return CPPTOML_NULL;
-    }
-    str += 5;
-    if(end_ <= str || ':' != str[0]) {
-        return CPPTOML_NULL;
-    }
-    if(end_ <= (str + 2)) {
-        return CPPTOML_NULL;
-    }
-    if(!digit(str[1]) || !digit(str[2])) {
-        return CPPTOML_NULL;
-    }
-    str += 3;
-    if(end_ <= str || '.' != str[0]) {
-        return str;
-    }
-    ++str;
-    uint32_t count = 0;
-    while(str < end_) {
-        if(!digit(str[0])) {
-            break;
+    failed_ = true;
+    state_ = ReaderState::End;
+    return false;
+}
+
+void TomlReader::push_path(const TomlSpan* spans, uint32_t size)
+{
+    if(path_capacity_ < (path_size_ + size)) {
+        uint32_t capacity = (0 < path_capacity_) ? path_capacity_ : 16;
+        while(capacity < (path_size_ + size)) {
+            capacity <<= 1;
         }
-        ++count;
-        ++str;
+        TomlSpan* path = reinterpret_cast<TomlSpan*>(parser_.allocator_(sizeof(TomlSpan) * capacity));
+        if(0 < path_size_) {
+            ::memcpy(path, path_, sizeof(TomlSpan) * path_size_);
+        }
+        parser_.deallocator_(path_);
+        path_ = path;
+        path_capacity_ = capacity;
     }
-    return (0 < count) ? str : CPPTOML_NULL;
+    ::memcpy(path_ + path_size_, spans, sizeof(TomlSpan) * size);
+    path_size_ += size;
 }
 
-const char* TomlParser::parse_timeoffset(const char* str)
+//--- TomlRecordReader
+//---------------------------------------
+namespace
 {
-    if('-' == str[0] || '+' == str[0]) {
-        ++str;
-    }
-    if(end_ <= (str + 4)) {
-        return CPPTOML_NULL;
-    }
-    if(!digit(str[0]) || !digit(str[1])) {
-        return CPPTOML_NULL;
-    }
-    if(':' != str[2]) {
-        return CPPTOML_NULL;
+    enum class HeaderKind
+    {
+        Other,
+        Record, //!< [[name]]
+        Member, //!< a sub table or a nested array of tables of name
+    };
+
+    /**
+     * @brief Kind of the header at a line for the records of name
+     */
+    HeaderKind header_kind(const char* line, const char* end, const char* name, uint64_t size)
+    {
+        while(line < end && (' ' == line[0] || '\t' == line[0])) {
+            ++line;
+        }
+        if(end <= line || '[' != line[0]) {
+            return HeaderKind::Other;
+        }
+        const char* key = CPPTOML_NULL;
+        if(size != header_key(line, end, key) || 0 != ::memcmp(key, name, static_cast<size_t>(size))) {
+            return HeaderKind::Other;
+        }
+        const char* str = key + size;
+        while(str < end && (' ' == str[0] || '\t' == str[0])) {
+            ++str;
+        }
+        if(str < end && '.' == str[0]) {
+            return HeaderKind::Member;
+        }
+        bool array = (line + 1) < end && '[' == line[1];
+        return (array && str < end && ']' == str[0]) ? HeaderKind::Record : HeaderKind::Other;
     }
-    if(!digit(str[3]) || !digit(str[4])) {
-        return CPPTOML_NULL;
+
+    /**
+     * @brief The end of the section at str, a record ends at a header which is not its member, the text between records at the next header of name
+     */
+    const char* section_end(const char* str, const char* end, const char* name, uint64_t size, bool record)
+    {
+        for(;;) {
+            str = complete_lines(str, end, true);
+            if(end <= str) {
+                return end;
+            }
+            HeaderKind kind = header_kind(str, end, name, size);
+            if(record ? HeaderKind::Member != kind : HeaderKind::Other != kind) {
+                return str;
+            }
+        }
     }
-    return str + 5;
-}
 
-bool TomlParser::strcmp(const char* s0, const char* e0, const char* s1, const char* e1)
-{
-    while(s0 < e0 && s1 < e1) {
-        if(s0[0] != s1[0]) {
-            return false;
+    /**
+     * @brief Bounded queue of the sections of parse_records, filled by the calling thread and taken by the workers
+     */
+    struct RecordQueue
+    {
+        static constexpr uint32_t Capacity = 256;
+
+        struct Entry
+        {
+            const char* begin_;
+            const char* end_;
+            uint64_t index_;
+            bool record_;
+        };
+
+        Entry entries_[Capacity];
+        uint64_t head_;
+        uint64_t tail_;
+        bool closed_; //!< no more entries come
+        bool stop_;   //!< a worker stops every thread
+        std::mutex mutex_;
+        std::condition_variable pushed_; //!< an entry, the end or a stop comes
+        std::condition_variable popped_; //!< room or a stop comes
+        std::atomic<bool> failed_;       //!< a section has an error
+
+        RecordQueue()
+            : head_(0)
+            , tail_(0)
+            , closed_(false)
+            , stop_(false)
+            , failed_(false)
+        {
         }
-        ++s0;
-        ++s1;
+
+        bool push(const Entry& entry)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            popped_.wait(lock, [this]() { return stop_ || (head_ - tail_) < Capacity; });
+            if(stop_) {
+                return false;
+            }
+            entries_[head_ % Capacity] = entry;
+            ++head_;
+            lock.unlock();
+            pushed_.notify_one();
+            return true;
+        }
+
+        bool pop(Entry& entry)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            pushed_.wait(lock, [this]() { return stop_ || closed_ || tail_ < head_; });
+            if(stop_ || head_ <= tail_) {
+                return false;
+            }
+            entry = entries_[tail_ % Capacity];
+            ++tail_;
+            lock.unlock();
+            popped_.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                closed_ = true;
+            }
+            pushed_.notify_all();
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            pushed_.notify_all();
+            popped_.notify_all();
+        }
+    };
+
+    /**
+     * @brief The table of the record in a document parsed from its section
+     */
+    TomlProxy record_table(const TomlParser& parser)
+    {
+        return parser.root().begin().value().begin();
     }
-    return e0<=s0 && e1<=s1;
+} // namespace
+
+TomlRecordHandler::~TomlRecordHandler()
+{
 }
 
-uint32_t TomlParser::find_keyvalue(uint32_t table, const char* begin, const char* end) const
+TomlRecordReader::TomlRecordReader(CPPTOML_MALLOC_TYPE allocator, CPPTOML_FREE_TYPE deallocator)
+    : allocator_(allocator)
+    , deallocator_(deallocator)
+    , parser_(allocator, deallocator)
+    , str_(CPPTOML_NULL)
+    , end_(CPPTOML_NULL)
+    , name_(CPPTOML_NULL)
+    , name_size_(0)
+    , count_(0)
+    , failed_(false)
+    , detached_(false)
 {
-    CPPTOML_ASSERT(Invalid != table);
-    CPPTOML_ASSERT(CPPTOML_NULL != begin);
-    CPPTOML_ASSERT(CPPTOML_NULL != end);
-    uint32_t node = static_cast<uint32_t>(values_[table].start_);
-    while(Invalid != node) {
-        CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::KeyValue) == values_[node].type_);
-        uint64_t key = values_[node].start_;
-        const char* s1 = begin_ + values_[key].start_;
-        const char* e1 = s1 + values_[key].size_;
-        if(TomlParser::strcmp(begin, end, s1, e1)) {
-            return node;
-        }
-        node = values_[node].next_;
+    if(CPPTOML_NULL == allocator_ || CPPTOML_NULL == deallocator_) {
+        allocator_ = ::malloc;
+        deallocator_ = ::free;
     }
-    return Invalid;
 }
 
-uint32_t TomlParser::find_table(uint32_t array) const
+TomlRecordReader::~TomlRecordReader()
 {
-    CPPTOML_ASSERT(Invalid != array);
-    uint32_t node = static_cast<uint32_t>(values_[array].start_);
-    if (Invalid == node) {
-        return Invalid;
-    }
-    return find_table_node(node);
 }
 
-uint32_t TomlParser::find_table_node(uint32_t node) const
+void TomlRecordReader::open(const char* begin, const char* end, const char* name)
 {
-    CPPTOML_ASSERT(Invalid != node);
-    if (Invalid == values_[node].next_) {
-        return static_cast<uint32_t>(TomlType::Table) == values_[node].type_? node : Invalid;
-    }
-    uint32_t next = find_table_node(values_[node].next_);
-    if (Invalid == next) {
-        return static_cast<uint32_t>(TomlType::Table) == values_[node].type_ ? node : Invalid; 
-    } else {
-        return next;
+    CPPTOML_ASSERT(CPPTOML_NULL != begin);
+    CPPTOML_ASSERT(begin <= end);
+    CPPTOML_ASSERT(CPPTOML_NULL != name);
+    str_ = begin;
+    if(3 <= (end - begin) && 0xEF == static_cast<uint8_t>(begin[0]) && 0xBB == static_cast<uint8_t>(begin[1]) && 0xBF == static_cast<uint8_t>(begin[2])) {
+        str_ += 3;
     }
+    end_ = end;
+    name_ = name;
+    name_size_ = ::strlen(name);
+    count_ = 0;
+    failed_ = false;
+    detached_ = false;
 }
 
-bool TomlParser::has_child_table(uint32_t table) const
+bool TomlRecordReader::next()
 {
-    CPPTOML_ASSERT(Invalid != table);
-    if(Invalid == values_[table].start_) {
-        return false;
-    }
-    uint32_t node = static_cast<uint32_t>(values_[table].start_);
-    while(Invalid != node) {
-        CPPTOML_ASSERT(static_cast<uint32_t>(TomlType::KeyValue) == values_[node].type_);
-        if (static_cast<uint32_t>(TomlType::Table) == values_[values_[node].size_].type_) {
+    const char* begin = CPPTOML_NULL;
+    const char* end = CPPTOML_NULL;
+    bool record = false;
+    while(!failed_ && next_section(begin, end, record)) {
+        if(!parser_.parse(begin, end)) {
+            failed_ = true;
+            return false;
+        }
+        if(record) {
+            ++count_;
             return true;
         }
-        node = values_[node].next_;
     }
     return false;
 }
 
-void TomlParser::clear()
+TomlProxy TomlRecordReader::record() const
 {
-    current_ = 0;
+    CPPTOML_ASSERT(0 < count_);
+    return record_table(parser_);
 }
 
-uint32_t TomlParser::add()
+uint64_t TomlRecordReader::count() const
 {
-    if(capacity_ <= size_) {
-        uint32_t capacity = capacity_ + Expand;
-        TomlValue* values = reinterpret_cast<TomlValue*>(allocator_(sizeof(TomlValue) * capacity));
-        if(0 < capacity_) {
-            ::memcpy(values, values_, sizeof(TomlValue) * capacity_);
-        }
-        deallocator_(values_);
-        capacity_ = capacity;
-        values_ = values;
-    }
-    uint32_t current = size_;
-    ++size_;
-    return current;
+    return count_;
 }
 
-uint32_t TomlParser::add_keyvalue(const char* str, const char* end)
+bool TomlRecordReader::failed() const
 {
-    uint32_t key = add_value(TomlType::Key, str, end);
-    uint32_t value = add();
-    values_[value].start_ = key;
-    values_[value].size_ = Invalid;
-    values_[value].next_ = Invalid;
-    values_[value].type_ = static_cast<uint32_t>(TomlType::KeyValue);
-    return value;
+    return failed_;
 }
 
-uint32_t TomlParser::add_value(TomlType type, const char* str, const char* end)
+bool TomlRecordReader::parse_records(const char* begin, const char* end, const char* name, uint32_t threads, TomlRecordHandler& handler)
 {
-    uint32_t value = add();
-    values_[value].start_ = static_cast<uint64_t>(str - begin_);
-    values_[value].size_ = static_cast<uint64_t>(end - str);
-    values_[value].next_ = Invalid;
-    values_[value].type_ = static_cast<uint32_t>(type);
-    return value;
+    open(begin, end, name);
+    if(threads <= 1) {
+        while(next()) {
+            if(!handler.on_record(0, count_ - 1, record())) {
+                return false;
+            }
+        }
+        return !failed_;
+    }
+
+    // The calling thread only finds sections, which costs far less than parsing them.
+    RecordQueue* queue = new(allocator_(sizeof(RecordQueue))) RecordQueue();
+    TomlParser* parsers = reinterpret_cast<TomlParser*>(allocator_(sizeof(TomlParser) * threads));
+    std::thread* workers = reinterpret_cast<std::thread*>(allocator_(sizeof(std::thread) * threads));
+    auto work = [queue, parsers, &handler](uint32_t thread) {
+        RecordQueue::Entry entry;
+        while(queue->pop(entry)) {
+            TomlParser& parser = parsers[thread];
+            if(!parser.parse(entry.begin_, entry.end_)) {
+                queue->failed_.store(true, std::memory_order_relaxed);
+                queue->stop();
+                return;
+            }
+            if(entry.record_ && !handler.on_record(thread, entry.index_, record_table(parser))) {
+                queue->stop();
+                return;
+            }
+        }
+    };
+    for(uint32_t i = 0; i < threads; ++i) {
+        new(&parsers[i]) TomlParser(allocator_, deallocator_);
+        parsers[i].set_options(parser_.get_options());
+        new(&workers[i]) std::thread(work, i);
+    }
+    const char* first = CPPTOML_NULL;
+    const char* last = CPPTOML_NULL;
+    bool record = false;
+    while(next_section(first, last, record)) {
+        if(!queue->push({first, last, count_, record})) {
+            break;
+        }
+        count_ += record ? 1 : 0;
+    }
+    queue->close();
+    for(uint32_t i = 0; i < threads; ++i) {
+        workers[i].join();
+        workers[i].~thread();
+        parsers[i].~TomlParser();
+    }
+    failed_ = failed_ || queue->failed_.load();
+    bool result = !failed_ && !queue->stop_;
+    queue->~RecordQueue();
+    deallocator_(workers);
+    deallocator_(parsers);
+    deallocator_(queue);
+    return result;
 }
 
-uint32_t TomlParser::add_table()
+void TomlRecordReader::set_options(uint32_t options)
 {
-    uint32_t value = add();
-    values_[value].start_ = Invalid;
-    values_[value].size_ = 0;
-    values_[value].next_ = Invalid;
-    values_[value].type_ = static_cast<uint32_t>(TomlType::Table);
-    return value;
+    parser_.set_options(options);
 }
 
-uint32_t TomlParser::add_array()
+uint32_t TomlRecordReader::get_options() const
 {
-    uint32_t value = add();
-    values_[value].start_ = Invalid;
-    values_[value].size_ = 0;
-    values_[value].next_ = Invalid;
-    values_[value].type_ = static_cast<uint32_t>(TomlType::Array);
-    return value;
+    return parser_.get_options();
 }
 
-void TomlParser::append(uint32_t parent, uint32_t value)
+bool TomlRecordReader::next_section(const char*& begin, const char*& end, bool& record)
 {
-    values_[parent].size_ += 1;
-    if(Invalid == values_[parent].start_ || value == values_[parent].start_) {
-        values_[parent].start_ = value;
-        return;
+    if(end_ <= str_) {
+        return false;
     }
-    uint32_t node = static_cast<uint32_t>(values_[parent].start_);
-    for (;;) {
-        if (node == value) {
-            return;
-        }
-        if (Invalid == values_[node].next_) {
-            values_[node].next_ = value;
-            return;
-        }
-        node = values_[node].next_;
+    begin = str_;
+    HeaderKind kind = header_kind(str_, end_, name_, name_size_);
+    // a member after another table belongs to the record before, which is already read, a record after one makes name a table
+    if((HeaderKind::Member == kind && 0 < count_) || (HeaderKind::Record == kind && detached_)) {
+        failed_ = true;
+        return false;
     }
+    detached_ = detached_ || HeaderKind::Member == kind;
+    record = HeaderKind::Record == kind;
+    str_ = section_end(str_, end_, name_, name_size_, record);
+    end = str_;
+    return true;
 }
 } // namespace cpptoml
@@ -78,6 +78,41 @@ typedef void* (*CPPTOML_MALLOC_TYPE)(size_t);
 typedef void (*CPPTOML_FREE_TYPE)(void*);
 
 class TomlParser;
+class TomlDocument;
+class TomlReader;
+struct TomlKernels;
+struct TomlPipeline;
+struct TomlShared;
+struct TomlLazy;
+struct TomlReload;
+
+/**
+ * @brief Instruction set tier of the lexer kernels
+ */
+enum class TomlISA : uint32_t
+{
+    Scalar = 0,
+    SWAR,
+    SSE2,
+    SSE42,
+    AVX2,
+    AVX512BW,
+    Auto,
+};
+
+/**
+ * @brief Select the tier of the lexer kernels (whitespace, strings, comments, digits)
+ *
+ * The tier is detected at the first parse. The environment variable `CPPTOML_ISA` (scalar, swar, sse2, sse42, avx2, avx512bw) forces a tier at that time.
+ * @param [in] isa ... the requested tier, `Auto` selects the best one the CPU supports
+ * @return the selected tier, which falls back to a lower one if the CPU doesn't support the request
+ */
+TomlISA set_isa(TomlISA isa);
+
+/**
+ * @return the current tier of the lexer kernels
+ */
+TomlISA get_isa();
 
 /**
  * @brief Toml Type
@@ -109,10 +144,64 @@ struct TomlValue
 {
     uint64_t start_; //!< the start position of element
     uint64_t size_;  //!< the size of element
-    uint32_t next_;  //!< the next element of aggregations
+    uint32_t next_;  //!< the next element of aggregations, or the ID of a key interned with OptionInternKeys
     uint32_t type_;  //!< the type of element
 };
 
+/**
+ * @brief Text of a key or a value in the document, strings keep their quotes and escapes
+ */
+struct TomlSpan
+{
+    const char* begin_;
+    const char* end_;
+};
+
+/**
+ * @brief Paths of tables and keys which TomlParser::parse(begin, end, filter) builds nodes for
+ * @details A path is dotted keys as written in the document, like "metrics.port" or "servers.\"a.b\"".
+ */
+struct TomlFilter
+{
+    const char* const* paths_;
+    uint32_t size_;
+    bool trusted_; //!< the document is valid and defines nothing twice, parsing stops once every path has been read
+};
+
+/**
+ * @brief Receives the events of TomlParser::parse_events in document order, an event which returns false stops parsing
+ */
+class TomlHandler
+{
+public:
+    virtual ~TomlHandler();
+
+    /**
+     * @brief A [header] or [[header]]
+     * @param [in] path ... segments of the dotted key
+     * @param [in] size ... the number of segments
+     * @param [in] array ... true for [[header]]
+     */
+    virtual bool on_table_header(const TomlSpan* path, uint32_t size, bool array);
+
+    /**
+     * @brief The key of a key/value pair, the value follows
+     * @param [in] path ... segments of the dotted key
+     * @param [in] size ... the number of segments
+     */
+    virtual bool on_key(const TomlSpan* path, uint32_t size);
+
+    /**
+     * @brief A scalar value
+     */
+    virtual bool on_value(TomlType type, TomlSpan text);
+
+    virtual bool on_array_begin();
+    virtual bool on_array_end();
+    virtual bool on_inline_table_begin();
+    virtual bool on_inline_table_end();
+};
+
 /**
  * @brief Toml proxy
  */
@@ -155,10 +244,22 @@ struct TomlProxy
      */
     TomlProxy key() const;
     /**
-     * @return value of an object's entry
+     * @return value of an object's entry. A value deferred by TomlParser::OptionLazy is parsed first, invalid if it is broken
      */
     TomlProxy value() const;
 
+    /**
+     * @brief Find an entry of a table by an interned key, the document must be parsed with OptionInternKeys
+     * @param [in] key ... ID from TomlParser::intern
+     * @return value of the entry
+     */
+    TomlProxy find(uint32_t key) const;
+
+    /**
+     * @return ID of a key or an entry's key, Invalid if the document is parsed without OptionInternKeys
+     */
+    uint32_t getKeyId() const;
+
     /**
      * @brief Get the table name 
      * @param [in] len ... buffer size of str with including null termination
@@ -210,6 +311,16 @@ struct TomlProxy
     const TomlValue* values_;
 };
 
+/**
+ * @brief Result of parsing a file
+ */
+enum class TomlStatus : uint32_t
+{
+    Success,
+    FileError, //!< the file can not be read
+    ParseError,
+};
+
 /**
  * @brief Toml Parser
  */
@@ -219,8 +330,15 @@ public:
     static constexpr uint32_t Invalid = static_cast<uint32_t>(-1);
     static constexpr std::tuple<const char*, uint32_t> InvalidPair = {CPPTOML_NULL, Invalid};
     static constexpr std::tuple<const char*, uint32_t, uint32_t> InvalidTuple = {CPPTOML_NULL, Invalid, Invalid};
-    static constexpr uint32_t Expand = 128;
+    static constexpr uint32_t Expand = 128; //!< the minimum number of nodes to grow the buffer by
     static constexpr int32_t MaxNesting = 128;
+    static constexpr uint32_t Padding = 64; //!< the number of zero bytes after the end, which parse_padded requires
+    static constexpr uint32_t OptionValidate = 0x01U; //!< run validate() at the end of parsing
+    static constexpr uint32_t OptionInternKeys = 0x02U; //!< give every key an ID from the intern table, see intern()
+    static constexpr uint32_t OptionPrefault = 0x04U; //!< parse_file reads every page of the file in before parsing
+    static constexpr uint32_t OptionCheckKeys = 0x08U; //!< parse_events builds the document too, to find keys and tables defined twice
+    static constexpr uint32_t OptionLazy = 0x10U; //!< only match the brackets of arrays and inline tables of key/value pairs, TomlProxy::value parses them
+    static constexpr uint64_t MinChunk = 1ULL << 20; //!< parse_parallel does not make chunks smaller than this
 
     /**
      * @param [in] allocator ... custom allocator
@@ -237,11 +355,181 @@ public:
      */
     bool parse(const char* begin, const char* end);
 
+    /**
+     * @brief Parse only the tables and keys on the paths of a filter, their ancestors and everything below them
+     * @details The rest of the document is only checked for syntax and gets no nodes. With a trusted filter a table
+     * of the filter is read once the first header outside it follows its own, tables defined later are not read.
+     * @return true if succeeded
+     * @param [in] begin ...
+     * @param [in] end ...
+     * @param [in] filter ... paths, which must stay while parsing
+     */
+    bool parse(const char* begin, const char* end, const TomlFilter& filter);
+
+    /**
+     * @brief Parse a document followed by `Padding` zero bytes, the lexer reads over the end without range checks
+     * @return true if succeeded
+     * @param [in] begin ...
+     * @param [in] end ... `Padding` bytes from here must be readable and zero
+     */
+    bool parse_padded(const char* begin, const char* end);
+
+    /**
+     * @brief Parse a file mapped into memory read-only, the parser keeps the mapping for the document until the next parse
+     * @details Pages are read in sequentially while parsing, or all at once before with OptionPrefault.
+     * The file must not be truncated while it is mapped. Where files can not be mapped, the file is read into a buffer of the parser.
+     * After FileError, the last document stays as it was.
+     * @return Success, FileError or ParseError
+     * @param [in] path ...
+     */
+    TomlStatus parse_file(const char* path);
+
+    /**
+     * @brief Parse a document into the events of a handler instead of nodes
+     * @details Values are checked as by parse. Keys and tables defined twice are found only with OptionCheckKeys, which builds
+     * the document as well, root() is an empty table otherwise.
+     * @return true if succeeded and the handler did not stop
+     * @param [in] begin ...
+     * @param [in] end ...
+     * @param [in] handler ...
+     */
+    bool parse_events(const char* begin, const char* end, TomlHandler& handler);
+
+    /**
+     * @brief Parse a document while another thread validates UTF-8 of the blocks ahead
+     * @details The parser skips non-ascii text of validated blocks instead of decoding it, small documents are parsed by parse.
+     * @return true if succeeded
+     * @param [in] begin ...
+     * @param [in] end ...
+     */
+    bool parse_pipelined(const char* begin, const char* end);
+
+    /**
+     * @brief Parse a document on up to `threads` threads, split at lines which begin with a [table] or [[array]] header
+     * @details Each chunk is parsed into its own node buffer and merged in order. When a chunk does not end at the top level,
+     * or merging needs the checks of a table defined again, the document is parsed serially instead, so the result equals parse.
+     * An array value of MinChunk bytes or more is also split at its commas and built on the threads.
+     * Documents with OptionInternKeys are parsed serially.
+     * @return true if succeeded
+     * @param [in] begin ...
+     * @param [in] end ...
+     * @param [in] threads ... the number of threads including the caller
+     */
+    bool parse_parallel(const char* begin, const char* end, uint32_t threads);
+
+    /**
+     * @brief Parse a new version of a document, reusing the nodes of sections which did not change since the last call
+     * @details The document is cut at header lines chosen by the hash of their text, so an edit moves only the cuts next to it.
+     * Sections of the same hash and size as a section of the last call are not parsed again, the others are parsed
+     * and all are merged in order as by parse_parallel. When merging needs the checks of a table defined again,
+     * the document is parsed serially instead. Documents with OptionInternKeys are parsed serially.
+     * @return true if succeeded
+     * @param [in] begin ...
+     * @param [in] end ...
+     */
+    bool reparse_incremental(const char* begin, const char* end);
+
+    /**
+     * @brief The number of sections which the last reparse_incremental parsed, the others were reused
+     */
+    uint32_t reparsed_sections() const;
+
+    /**
+     * @brief The number of sections of the last reparse_incremental
+     */
+    uint32_t section_count() const;
+
+    /**
+     * @brief Parse the text appended to a document since the last call, from the end of its last complete line
+     * @details Only lines which end at the top level are parsed, an unfinished line, array, inline table or multi-line string
+     * waits for the next call. The text before must stay the same, the buffer may move unless OptionInternKeys is set.
+     * After another parse or a failure, the next call parses the document from the beginning.
+     * With final, the text up to end is parsed as the end of the document, a last line without a newline included,
+     * and the next call begins again.
+     * @return true if succeeded
+     * @param [in] begin ... beginning of the whole document
+     * @param [in] end ...
+     * @param [in] final ... the document ends at end
+     */
+    bool parse_append(const char* begin, const char* end, bool final = false);
+
+    /**
+     * @brief Bytes of the document which parse_append has parsed, the next call continues from there
+     */
+    uint64_t appended_size() const;
+
+    /**
+     * @brief Parse the next chunk of a streamed document, the lines which the chunk completes are parsed at once
+     * @details A chunk can end at any byte, an unfinished line waits in a buffer of the parser for the next chunks.
+     * The parser keeps the text of the document, which its nodes refer to. The first call after finish() begins a new document,
+     * other parse functions must not be called in between. With OptionInternKeys, the parsed lines are parsed again when the buffer grows.
+     * @return false if the document already failed
+     * @param [in] chunk ...
+     * @param [in] size ... bytes of the chunk
+     */
+    bool feed(const char* chunk, uint64_t size);
+
+    /**
+     * @brief Parse the rest of the document of feed, then the next feed begins a new document
+     * @return true if the whole document succeeded
+     */
+    bool finish();
+
+    /**
+     * @brief Allocate a buffer for parse_padded with the allocator of this parser
+     * @param [in] size ... size of the document
+     * @return a buffer of `size + Padding` bytes, of which padding is cleared by zero
+     */
+    char* allocate_padded(uint64_t size) const;
+
+    /**
+     * @brief Deallocate a buffer from allocate_padded
+     */
+    void deallocate_padded(char* buffer) const;
+
+    /**
+     * @brief Set options of parsing
+     * @param [in] options ... combination of Option* flags
+     */
+    void set_options(uint32_t options);
+
+    /**
+     * @return combination of Option* flags
+     */
+    uint32_t get_options() const;
+
+    /**
+     * @brief Check the structure of the last parsed document again, every check is already done while parsing
+     * @return true if valid
+     */
+    bool validate() const;
+
+    /**
+     * @brief Get the ID of a key, adding the key to the intern table if it is new
+     * @details A key interned while the table holds no key of a document, e.g. before parse, keeps its ID for later documents.
+     * The same bytes as in the document are compared, quotes included. The key must outlive the parser.
+     * @param [in] begin ...
+     * @param [in] end ...
+     * @return ID of the key
+     */
+    uint32_t intern(const char* begin, const char* end);
+
     /**
      * @return root object of the document
      */
     TomlProxy root() const;
+
+    /**
+     * @brief Move the last parsed document into an immutable document, which keeps a copy of the text
+     * @details The parser is empty afterwards and can parse again. Call it after a successful parse.
+     * Values deferred by OptionLazy are parsed first.
+     * @return the document, or an empty one if nothing was parsed or a deferred value is broken
+     */
+    TomlDocument share();
 private:
+    friend class TomlReader;
+    friend struct TomlProxy;
+
     TomlParser(const TomlParser&) = delete;
     TomlParser& operator=(const TomlParser&) = delete;
 
@@ -252,96 +540,809 @@ private:
         ArrayTable,
     };
 
+    void begin_document(const char* begin, const char* end);
+    bool parse_document(const char* begin, const char* end);
+    template<bool Padded = false>
+    bool parse_expressions(const char* str);
+    bool parse_chunk(const char* document, const char* begin, const char* end, const TomlKernels* kernels);
+    void move_chunk(const TomlParser& chunk, uint32_t base, uint64_t shift);
+    bool merge_chunk(const TomlParser& chunk, uint32_t base);
+    bool merge_table(uint32_t table, uint32_t source, const TomlParser& chunk, uint32_t base, int32_t depth);
+    bool defined(uint32_t table) const;
+    void clear_sections();
+    bool validate_from(uint32_t first) const;
+    void release_file();
+    std::tuple<const char*, uint32_t> parse_array_parallel(const char* str, uint32_t enclosing);
+    static TomlProxy resolve(uint64_t value, const char* data, const TomlValue* values);
+    bool expand_lazy();
+    void release_lazy();
+
+    // The lexer with Padded reads the zero bytes after the end instead of checking the range, no token contains zero.
+    template<bool Padded = false>
     int64_t next_symbol(const char*& str) const;
+    template<bool Padded = false>
     bool parse_unquated_key_char(const char*& str) const;
+    template<bool Padded = false>
     bool basic_char(const char*& str) const;
+    template<bool Padded = false>
     bool literal_char(const char*& str) const;
+    template<bool Padded = false>
     bool escaped(const char*& str) const;
     bool parse_2hexdig(const char*& str) const;
+    template<bool Padded = false>
     bool parse_4hexdig(const char*& str) const;
+    template<bool Padded = false>
     bool parse_8hexdig(const char*& str) const;
     static bool hexgidit(char c);
     static bool digit(char c);
+    template<bool Padded = false>
+    uint64_t load_word(const char* str) const;
 
     const char* bom(const char* str) const;
+    template<bool Padded = false>
     const char* newline(const char* str) const;
     const char* whitespace(const char* str) const;
+    template<bool Padded = false>
     const char* comment(const char* str) const;
+    template<bool Padded = false>
     const char* ws_comment_newline(const char* str) const;
 
+    template<bool Padded = false>
     const char* parse_non_ascii(const char* str) const;
 
+    template<bool Padded = false>
     const char* parse_expression(const char* str);
+    template<bool Padded = false>
     std::tuple<const char*, uint32_t> parse_keyvalue(const char* str);
+    template<bool Padded = false>
     bool keyvalue(const char* str) const;
+    template<bool Padded = false>
     std::tuple<const char*, uint32_t, uint32_t> parse_key(const char* str, uint32_t current, KeyPlace place);
+    template<bool Padded = false>
     const char* parse_unquated_key(const char* str) const;
 
-    std::tuple<const char*, uint32_t> parse_value(const char* str);
+    template<bool Padded = false>
+    std::tuple<const char*, uint32_t> parse_value(const char* str, uint32_t enclosing = 0);
+    template<bool Padded = false>
+    std::tuple<const char*, uint32_t> parse_scalar(const char* str);
+    template<bool Padded = false>
     bool value(const char* str) const;
 
+    template<bool Padded = false>
     const char* parse_basic_string(const char* str);
+    template<bool Padded = false>
     const char* parse_literal_string(const char* str);
 
+    template<bool Padded = false>
     const char* parse_ml_basic_string(const char* str);
+    template<bool Padded = false>
     const char* parse_mlb_content(const char* str);
+    template<bool Padded = false>
     const char* parse_mlb_escaped_nl(const char* str);
+    template<bool Padded = false>
     bool parse_mlb_quotes(const char*& str);
 
+    template<bool Padded = false>
     const char* parse_ml_literal_string(const char* str);
+    template<bool Padded = false>
     const char* parse_mll_content(const char* str);
+    template<bool Padded = false>
     bool parse_mll_quotes(const char*& str);
 
+    template<bool Padded = false>
     std::tuple<const char*, uint32_t> parse_table(const char* str);
+    template<bool Padded = false>
     std::tuple<const char*, uint32_t> parse_std_table(const char* str);
+    template<bool Padded = false>
     std::tuple<const char*, uint32_t> parse_array_table(const char* str);
 
+    const char* event_expression(const char* str, TomlHandler& handler);
+    const char* event_table(const char* str, TomlHandler& handler);
+    const char* event_key(const char* str);
+    const char* event_value(const char* str, TomlHandler& handler);
+    const char* event_element(const char* str, bool array, bool& expect);
+
+    template<bool Padded = false>
     const char* parse_true(const char* str);
+    template<bool Padded = false>
     const char* parse_false(const char* str);
 
-    std::tuple<const char*, uint32_t> parse_array(const char* str);
-    std::tuple<const char*, uint32_t> parse_inline_table(const char* str);
-
+#ifdef CPPTOML_TABLE_LEXER
+    template<bool Padded = false>
+    std::tuple<const char*, uint32_t> lex_scalar(const char* str);
+#endif
+    template<bool Padded = false>
     std::tuple<const char*, uint32_t> parse_number(const char* str);
-    TomlType number_type(const char* str);
-    std::tuple<const char*, uint32_t> parse_integer(const char* str);
-    std::tuple<const char*, uint32_t> parse_hex(const char* str);
-    std::tuple<const char*, uint32_t> parse_oct(const char* str);
-    std::tuple<const char*, uint32_t> parse_bin(const char* str);
-    std::tuple<const char*, uint32_t> parse_float(const char* str);
-    const char* parse_frac(const char* str);
-    const char* parse_exp(const char* str);
+    template<bool Padded = false>
+    std::tuple<const char*, uint32_t> parse_radix(const char* str, TomlType type);
+    template<bool Padded = false>
     const char* parse_zero_prefixable_int(const char* str);
+    template<bool Padded = false>
     std::tuple<const char*, uint32_t> parse_inf(const char* str);
+    template<bool Padded = false>
     std::tuple<const char*, uint32_t> parse_nan(const char* str);
+    template<bool Padded = false>
     std::tuple<const char*, uint32_t> parse_datetime(const char* str);
+    template<bool Padded = false>
     const char* parse_fulldate(const char* str);
+    template<bool Padded = false>
     const char* parse_partial_time(const char* str);
+    template<bool Padded = false>
     const char* parse_timeoffset(const char* str);
 
     static bool strcmp(const char* s0, const char* e0, const char* s1, const char* e1);
-    uint32_t find_keyvalue(uint32_t table, const char* begin, const char* end) const;
-    uint32_t find_table(uint32_t array) const;
-    uint32_t find_table_node(uint32_t node) const;
+    uint32_t find_keyvalue(uint32_t table, const char* begin, const char* end);
+    uint32_t find_keyvalue(uint32_t table, uint32_t key);
+    uint32_t find_entry(uint32_t table, const char* begin, const char* end, uint32_t hash, uint32_t key);
+    void add_entry(uint32_t table, uint32_t keyvalue);
+    uint32_t intern_key(const char* begin, const char* end, uint32_t hash);
+    void reset_keys();
+    uint32_t find_table(uint32_t array);
+    uint32_t last_child(uint32_t parent);
     bool has_child_table(uint32_t table) const;
 
     CPPTOML_MALLOC_TYPE allocator_;
     CPPTOML_FREE_TYPE deallocator_;
+    const TomlKernels* kernels_; //!< lexer kernels of the current parse
     const char* begin_;
     const char* end_;
 
     void clear();
     uint32_t add();
-    uint32_t add_keyvalue(const char* str, const char* end);
+    void reserve(uint32_t capacity);
+    uint32_t add_keyvalue(const char* str, const char* end, uint32_t id);
     uint32_t add_value(TomlType type, const char* str, const char* end);
     uint32_t add_table();
     uint32_t add_array();
     void append(uint32_t parent, uint32_t value);
 
+    /**
+     * @brief An array or an inline table which is being parsed
+     */
+    struct Frame
+    {
+        uint32_t node_;     //!< array or inline table
+        uint32_t keyvalue_; //!< entry of the inline table waiting for its value
+        uint32_t parent_;   //!< table which the entry is appended to, differs from node_ for dotted keys
+        uint32_t tail_;     //!< last element of an array
+        TomlType kind_;     //!< kind of the first element of an array
+        bool expect_;       //!< a value or an entry can come next
+    };
+
+    /**
+     * @brief The last [[header]] and the tail of its array
+     */
+    struct ArrayTableCache
+    {
+        uint64_t key_;   //!< offset of the key from begin_
+        uint64_t size_;  //!< length of the key
+        uint32_t array_; //!< resolved array, or Invalid
+        uint32_t tail_;  //!< last table of the array
+    };
+
+    static constexpr uint32_t IndexedChildren = 16; //!< tables and arrays with more children keep their last child in TailTable
+
+    /**
+     * @brief A table or an array and its last child so far
+     */
+    struct ChildTail
+    {
+        uint32_t parent_; //!< Invalid for an empty slot
+        uint32_t tail_;
+    };
+
+    /**
+     * @brief Last children of tables and arrays with more than IndexedChildren children, open addressing with at most half of slots used
+     * @details The children of a table up to its tail are in EntryTable.
+     */
+    struct TailTable
+    {
+        ChildTail* slots_;
+        uint32_t capacity_; //!< the number of slots, a power of two
+        uint32_t size_;     //!< the number of parents
+    };
+
+    /**
+     * @brief A key/value pair of a table with more than IndexedChildren children
+     */
+    struct KeyEntry
+    {
+        uint32_t table_;    //!< Invalid for an empty slot
+        uint32_t keyvalue_;
+    };
+
+    /**
+     * @brief Key/value pairs of the tables in TailTable by the hash of the table and the key, open addressing with at most half of slots used
+     */
+    struct EntryTable
+    {
+        KeyEntry* slots_;
+        uint32_t capacity_; //!< the number of slots, a power of two
+        uint32_t size_;     //!< the number of pairs
+    };
+
+    static constexpr uint32_t PathDepth = 8; //!< the number of leading segments which PathCache remembers
+
+    /**
+     * @brief A segment of the last dotted key and the table it resolved to
+     */
+    struct PathSegment
+    {
+        uint64_t key_;   //!< offset of the segment from begin_
+        uint32_t size_;  //!< length of the segment
+        uint32_t hash_;  //!< key_hash of the segment
+        uint32_t table_; //!< table which the segment resolved to
+    };
+
+    /**
+     * @brief The tables which the last dotted key passed through, a key with the same leading segments resumes from them
+     */
+    struct PathCache
+    {
+        uint32_t start_; //!< table which the key was resolved from
+        uint32_t size_;  //!< the number of valid segments
+        PathSegment segments_[PathDepth];
+    };
+
+    /**
+     * @brief An interned key, its ID is the index in InternTable::keys_
+     */
+    struct InternKey
+    {
+        const char* key_; //!< bytes of the key, in the document or given to intern()
+        uint32_t size_;   //!< length of the key
+        uint32_t hash_;   //!< key_hash of the key
+    };
+
+    /**
+     * @brief Keys of the document and pinned keys, open addressing with at most half of slots used
+     */
+    struct InternTable
+    {
+        InternKey* keys_;
+        uint32_t* slots_;    //!< IDs or Invalid, twice as many as the capacity
+        uint32_t capacity_;  //!< capacity of keys_, a power of two
+        uint32_t size_;      //!< the number of keys
+        uint32_t pinned_;    //!< the number of leading keys which survive the next document
+    };
+
+    /**
+     * @brief Elements which a worker of parse_array_parallel built from a slice of an array
+     */
+    struct ArraySlice
+    {
+        const char* begin_;
+        const char* end_;
+        uint32_t first_;  //!< first element in the buffer of the worker, or Invalid
+        uint32_t last_;   //!< last element
+        uint32_t size_;   //!< the number of elements
+        uint32_t worker_; //!< index of the worker
+        TomlType kind_;   //!< kind of the elements
+        bool result_;
+    };
+    bool parse_slice(ArraySlice& slice, bool last, uint32_t enclosing);
+
+    /**
+     * @brief Tables defined by [header]s of a chunk of parse_parallel, a merge leaves them to the serial parse
+     */
+    struct HeaderTables
+    {
+        uint32_t* tables_;
+        uint32_t size_;
+        uint32_t capacity_;
+        bool record_;   //!< record tables while parsing
+    };
+
+    /**
+     * @brief Text of parse_file
+     */
+    struct FileText
+    {
+        void* address_;
+        uint64_t size_;
+        bool mapped_; //!< mapped, or allocated by allocate_padded
+    };
+
+    /**
+     * @brief Segments of the last key of parse_events
+     */
+    struct KeySpans
+    {
+        TomlSpan* spans_;
+        uint32_t size_;
+        uint32_t capacity_;
+    };
+
+    /**
+     * @brief Text of feed
+     */
+    struct StreamText
+    {
+        char* text_;
+        uint64_t size_;
+        uint64_t capacity_;
+        bool open_;   //!< feed began a document which is not finished
+        bool failed_; //!< the document failed, the rest is not parsed
+    };
+
+    /**
+     * @brief A section of reparse_incremental, parsed alone with offsets from its beginning
+     */
+    struct Section
+    {
+        uint64_t hash_;
+        uint64_t size_;
+        TomlParser* parser_;
+    };
+
+    /**
+     * @brief Sections of the last reparse_incremental, which the next one reuses
+     */
+    struct SectionCache
+    {
+        Section* sections_;
+        uint32_t size_;
+        uint32_t parsed_; //!< sections which the last call parsed instead of reusing
+    };
+
     uint32_t current_; //!< current table
     uint32_t capacity_; //!< capacity of buffer
     uint32_t size_;     //!< current size of buffer
     TomlValue* values_; //!< elements of Json
+    Frame* frames_;     //!< stack of nested values, MaxNesting frames
+    uint32_t options_;  //!< Option* flags
+    ArrayTableCache array_table_;
+    TailTable tails_;
+    EntryTable entries_; //!< the children of the tables in tails_ up to their tails
+    PathCache header_path_; //!< for [header] and [[header]]
+    PathCache key_path_;    //!< for dotted keys of key/value pairs
+    InternTable keys_;
+    HeaderTables headers_;
+    uint32_t threads_; //!< threads for arrays of MinChunk bytes or more, given to parse_parallel
+    TomlPipeline* pipeline_; //!< blocks validated ahead by parse_pipelined
+    SectionCache sections_; //!< sections kept by reparse_incremental
+    uint64_t resume_; //!< bytes parsed by parse_append, zero to begin again
+    FileText file_; //!< text of the document of parse_file
+    StreamText stream_; //!< text of the document of feed
+    KeySpans spans_; //!< segments of the last key of parse_events
+    TomlLazy* lazy_; //!< values deferred by OptionLazy and the subtrees parsed from them
+};
+
+/**
+ * @brief Immutable document which threads share by reference counting
+ * @details Proxies of a document only read memory which never changes, so any number of threads can read them concurrently
+ * without locks. Copying and destroying handles changes an atomic reference count, the last handle frees the document.
+ * A TomlParser itself is not safe to read while it parses.
+ */
+class TomlDocument
+{
+public:
+    TomlDocument();
+    TomlDocument(const TomlDocument& other);
+    TomlDocument(TomlDocument&& other);
+    ~TomlDocument();
+    TomlDocument& operator=(const TomlDocument& other);
+    TomlDocument& operator=(TomlDocument&& other);
+
+    /**
+     * @return true if this holds a document
+     */
+    explicit operator bool() const;
+
+    /**
+     * @return root object of the document, which is valid while a handle of the document exists
+     */
+    TomlProxy root() const;
+
+    /**
+     * @return the number of handles of the document
+     */
+    uint32_t use_count() const;
+private:
+    friend class TomlParser;
+    explicit TomlDocument(TomlShared* shared);
+    void release();
+
+    TomlShared* shared_;
+};
+
+/**
+ * @brief A config file which is parsed again when it changes, readers never wait for a reload
+ * @details A new document is published by swapping an atomic pointer. Each reader announces the epoch in which it entered,
+ * an old document is freed when every reader has left or entered a later epoch. On Linux a thread watches the file with inotify,
+ * elsewhere call reload() when the file changes.
+ */
+class TomlConfigHandle
+{
+public:
+    static constexpr uint32_t MaxReaders = 64; //!< readers which can attach at once
+
+    /**
+     * @param [in] allocator ... custom allocator
+     * @param [in] deallocator ... custom deallocator
+     */
+    TomlConfigHandle(CPPTOML_MALLOC_TYPE allocator = CPPTOML_NULL, CPPTOML_FREE_TYPE deallocator = CPPTOML_NULL);
+
+    ~TomlConfigHandle();
+
+    /**
+     * @brief Parse a file and start watching it
+     * @return true if the first parse succeeded
+     * @param [in] path ...
+     */
+    bool open(const char* path);
+
+    /**
+     * @brief Stop watching and free all documents, no reader may be inside
+     */
+    void close();
+
+    /**
+     * @brief Parse the file again and publish the document
+     * @return true if succeeded, the last document stays published otherwise
+     */
+    bool reload();
+
+    /**
+     * @return the number of documents published
+     */
+    uint64_t version() const;
+
+    /**
+     * @brief Take a reader slot, each reading thread needs its own
+     * @return the slot, or TomlParser::Invalid if all slots are taken
+     */
+    uint32_t attach();
+
+    /**
+     * @brief Return a reader slot
+     */
+    void detach(uint32_t reader);
+
+    /**
+     * @brief Enter the current epoch and get the current document, which stays valid until leave
+     * @details No locks, a store of the epoch and a load of the document.
+     * @param [in] reader ... a slot from attach
+     */
+    const TomlDocument* enter(uint32_t reader) const;
+
+    /**
+     * @brief Leave the epoch, documents seen since enter may be freed
+     */
+    void leave(uint32_t reader) const;
+private:
+    TomlConfigHandle(const TomlConfigHandle&) = delete;
+    TomlConfigHandle& operator=(const TomlConfigHandle&) = delete;
+
+    void publish(TomlDocument* document);
+    void reclaim();
+    void watch();
+
+    CPPTOML_MALLOC_TYPE allocator_;
+    CPPTOML_FREE_TYPE deallocator_;
+    TomlReload* state_;
+};
+
+/**
+ * @brief Parse many files on threads, keeping a parser for each document
+ */
+class TomlBatch
+{
+public:
+    static constexpr uint32_t OptionShareBuffer = 0x80000000U; //!< read all files into one buffer, the other flags go to each TomlParser
+
+    /**
+     * @param [in] allocator ... custom allocator
+     * @param [in] deallocator ... custom deallocator
+     */
+    TomlBatch(CPPTOML_MALLOC_TYPE allocator = CPPTOML_NULL, CPPTOML_FREE_TYPE deallocator = CPPTOML_NULL);
+
+    ~TomlBatch();
+
+    /**
+     * @brief Read and parse files on up to `threads` threads, an idle thread takes the next file
+     * @details A thread reading a file overlaps the others parsing. Documents of the last batch are released.
+     * Without OptionShareBuffer each file is mapped by TomlParser::parse_file.
+     * @return true if every file succeeded
+     * @param [in] paths ...
+     * @param [in] count ... the number of paths
+     * @param [out] results ... the result for each path, can be null
+     * @param [in] threads ... the number of threads including the caller
+     */
+    bool parse_batch(const char* const* paths, uint32_t count, TomlStatus* results, uint32_t threads);
+
+    /**
+     * @brief Set options of parsing
+     * @param [in] options ... combination of OptionShareBuffer and TomlParser::Option* flags
+     */
+    void set_options(uint32_t options);
+
+    /**
+     * @return combination of Option* flags
+     */
+    uint32_t get_options() const;
+
+    /**
+     * @return the number of documents of the last batch
+     */
+    uint32_t size() const;
+
+    /**
+     * @return the parser of a document, of which root() is valid if the file succeeded
+     */
+    const TomlParser& document(uint32_t index) const;
+
+    /**
+     * @brief Release all documents
+     */
+    void clear();
+private:
+    TomlBatch(const TomlBatch&) = delete;
+    TomlBatch& operator=(const TomlBatch&) = delete;
+
+    uint64_t file_size(const char* path) const;
+    TomlStatus parse_file(uint32_t index, const char* path);
+
+    CPPTOML_MALLOC_TYPE allocator_;
+    CPPTOML_FREE_TYPE deallocator_;
+    uint32_t options_;
+    uint32_t size_;
+    TomlParser* parsers_;
+    char** buffers_;  //!< a document and Padding zero bytes for each file
+    uint64_t* sizes_; //!< size of each file read in advance with OptionShareBuffer, or Invalid
+    char* shared_;    //!< one buffer for all files with OptionShareBuffer
+};
+
+/**
+ * @brief Kind of an event of TomlReader
+ */
+enum class TomlEventType : uint32_t
+{
+    TableHeader,
+    ArrayTableHeader,
+    Key,
+    Value,
+    ArrayBegin,
+    ArrayEnd,
+    InlineTableBegin,
+    InlineTableEnd,
+};
+
+/**
+ * @brief An event of TomlReader
+ */
+struct TomlEvent
+{
+    TomlEventType type_;
+    TomlType value_; //!< type of a Value
+    TomlSpan text_;  //!< the dotted key of a header or a key, the text of a value, or the bracket
+};
+
+/**
+ * @brief Pull parser, which reads the events of TomlParser::parse_events one at a time
+ * @details Values are checked as by parse, keys defined twice are not. A reader keeps no nodes of the document.
+ */
+class TomlReader
+{
+public:
+    /**
+     * @brief Input iterator over the events of a reader, for range-based for loops
+     */
+    class iterator
+    {
+    public:
+        const TomlEvent& operator*() const;
+        const TomlEvent* operator->() const;
+        iterator& operator++();
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+
+    private:
+        friend class TomlReader;
+        explicit iterator(TomlReader* reader);
+
+        TomlReader* reader_; //!< null at the end
+    };
+
+    /**
+     * @param [in] allocator ... custom allocator
+     * @param [in] deallocator ... custom deallocator
+     */
+    TomlReader(CPPTOML_MALLOC_TYPE allocator = CPPTOML_NULL, CPPTOML_FREE_TYPE deallocator = CPPTOML_NULL);
+    ~TomlReader();
+
+    /**
+     * @brief Begin to read a document, which must stay until the reader ends
+     * @param [in] begin ...
+     * @param [in] end ...
+     */
+    void open(const char* begin, const char* end);
+
+    /**
+     * @brief Read the next event
+     * @return false at the end of the document or on an error, see failed()
+     */
+    bool next();
+
+    /**
+     * @brief Skip the value of the last Key event, or the rest of the array or inline table of the last ArrayBegin or InlineTableBegin
+     * @details Arrays and inline tables are skipped by matching brackets outside strings and comments, their contents are not checked.
+     * @return false if the last event has nothing to skip or the value is broken
+     */
+    bool skip_value();
+
+    /**
+     * @return true if the document has an error
+     */
+    bool failed() const;
+
+    /**
+     * @return the last event
+     */
+    const TomlEvent& event() const;
+
+    /**
+     * @brief Key path of the last event, the segments of the header then of the keys which enclose the event
+     */
+    const TomlSpan* path() const;
+
+    /**
+     * @return the number of segments of path()
+     */
+    uint32_t path_size() const;
+
+    /**
+     * @brief Read the first event
+     */
+    iterator begin();
+    iterator end();
+
+private:
+    TomlReader(const TomlReader&) = delete;
+    TomlReader& operator=(const TomlReader&) = delete;
+
+    enum class ReaderState
+    {
+        Expression, //!< an expression at the top level
+        Value,      //!< the value of a key or an element of an array
+        Container,  //!< a separator, an element or the end of an array or inline table
+        End,
+    };
+
+    /**
+     * @brief An open array or inline table
+     */
+    struct ReaderFrame
+    {
+        const char* open_; //!< the opening bracket
+        uint32_t restore_; //!< the size of the path after the container
+        TomlType kind_;    //!< kind of the values of an array
+        bool array_;
+        bool expect_;      //!< a value or a key comes next
+    };
+
+    bool read_expression();
+    bool read_key(const char* str);
+    bool read_value();
+    bool read_container();
+    bool complete(TomlType type);
+    bool fail();
+    void push_path(const TomlSpan* spans, uint32_t size);
+
+    TomlParser parser_; //!< lexer of the document, which keeps only its root
+    const char* str_;
+    ReaderState state_;
+    bool after_;  //!< an expression ended, only a comment and a newline can follow
+    bool failed_;
+    TomlEvent event_;
+    ReaderFrame* frames_; //!< MaxNesting frames
+    uint32_t depth_;
+    TomlSpan* path_;
+    uint32_t path_size_;
+    uint32_t path_capacity_;
+    uint32_t mark_;    //!< the size of the path before the key of the coming value, or Invalid for an element of an array
+    uint32_t restore_; //!< the size of the path which the next event begins with, or Invalid
+};
+
+/**
+ * @brief Receives the records of TomlRecordReader::parse_records
+ */
+class TomlRecordHandler
+{
+public:
+    virtual ~TomlRecordHandler();
+
+    /**
+     * @brief A record, whose nodes are reused after this returns
+     * @param [in] thread ... the worker which parsed the record
+     * @param [in] index ... the position of the record in the document
+     * @param [in] record ... the table of the record
+     * @return false to stop
+     */
+    virtual bool on_record(uint32_t thread, uint64_t index, TomlProxy record) = 0;
+};
+
+/**
+ * @brief Reads the entries of a top level array of tables, each [[name]] with its sub tables, one at a time
+ * @details Each record is parsed alone into nodes which the next record reuses, so memory stays bounded by the largest record.
+ * The text between records is parsed and dropped. Keys and tables are checked within each record or the text between records only.
+ * A sub table of name after another table is an error, its record has been read already.
+ */
+class TomlRecordReader
+{
+public:
+    /**
+     * @param [in] allocator ... custom allocator
+     * @param [in] deallocator ... custom deallocator
+     */
+    TomlRecordReader(CPPTOML_MALLOC_TYPE allocator = CPPTOML_NULL, CPPTOML_FREE_TYPE deallocator = CPPTOML_NULL);
+    ~TomlRecordReader();
+
+    /**
+     * @brief Begin to read a document, which must stay until the reader ends
+     * @param [in] begin ...
+     * @param [in] end ...
+     * @param [in] name ... the bare key of the array of tables, which must stay until the reader ends
+     */
+    void open(const char* begin, const char* end, const char* name);
+
+    /**
+     * @brief Parse the next record
+     * @return false at the end of the document or on an error, see failed()
+     */
+    bool next();
+
+    /**
+     * @return the table of the last record, which is valid until the next call
+     */
+    TomlProxy record() const;
+
+    /**
+     * @return the number of records read
+     */
+    uint64_t count() const;
+
+    /**
+     * @return true if the document has an error
+     */
+    bool failed() const;
+
+    /**
+     * @brief Parse the records on worker threads, which take them from a bounded queue filled by the calling thread
+     * @param [in] begin ...
+     * @param [in] end ...
+     * @param [in] name ... the bare key of the array of tables
+     * @param [in] threads ... the number of workers, with one the calling thread parses every record itself
+     * @param [in] handler ... called on the workers in any order
+     * @return false if the document has an error or the handler stops
+     */
+    bool parse_records(const char* begin, const char* end, const char* name, uint32_t threads, TomlRecordHandler& handler);
+
+    /**
+     * @brief Set flags of TomlParser for each record
+     */
+    void set_options(uint32_t options);
+    uint32_t get_options() const;
+
+private:
+    TomlRecordReader(const TomlRecordReader&) = delete;
+    TomlRecordReader& operator=(const TomlRecordReader&) = delete;
+
+    /**
+     * @brief The next record or text between records
+     */
+    bool next_section(const char*& begin, const char*& end, bool& record);
+
+    CPPTOML_MALLOC_TYPE allocator_;
+    CPPTOML_FREE_TYPE deallocator_;
+    TomlParser parser_;
+    const char* str_;
+    const char* end_;
+    const char* name_;
+    uint64_t name_size_;
+    uint64_t count_;
+    bool failed_;
+    bool detached_; //!< a sub table of name came outside of a record
 };
 
 } // namespace cpptoml
@@ -3,11 +3,17 @@
 #    include <Windows.h>
 #else
 #    include <dirent.h>
+#    include <pthread.h>
+#    include <signal.h>
 #    include <sys/stat.h>
 #    include <sys/types.h>
+#    include <unistd.h>
 #endif
 #include "../cpptoml.h"
 #include "catch_wrap.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 namespace
 {
@@ -375,6 +381,1243 @@ TEST_CASE("TestToml::InValid")
 }
 #endif
 
+TEST_CASE("TestToml::ISA")
+{
+    static const char toml[] =
+        "# a comment which is long enough to cover the widest kernel ##################################\n"
+        "key00 = \"a basic string which is long enough to cover the widest kernel, \\\"escaped\\\" caf\xC3\xA9\"\n"
+        "key01 = 'a literal string which is long enough to cover the widest kernel, C:\\path\\to\\file'\n"
+        "key02 =                                                                      12345678901234567\n";
+    cpptoml::TomlISA previous = cpptoml::get_isa();
+    for(uint32_t i = 0; i < static_cast<uint32_t>(cpptoml::TomlISA::Auto); ++i) {
+        cpptoml::set_isa(static_cast<cpptoml::TomlISA>(i));
+        cpptoml::TomlParser parser;
+        bool result = parser.parse(toml, toml + sizeof(toml) - 1);
+        EXPECT_TRUE(result);
+        if(!result) {
+            continue;
+        }
+        cpptoml::TomlProxy keyvalue = parser.root().begin();
+        EXPECT_TRUE(cpptoml::TomlType::String == keyvalue.value().type());
+        EXPECT_TRUE(83 == keyvalue.value().size());
+        keyvalue = keyvalue.next();
+        EXPECT_TRUE(cpptoml::TomlType::String == keyvalue.value().type());
+        EXPECT_TRUE(83 == keyvalue.value().size());
+        keyvalue = keyvalue.next();
+        EXPECT_TRUE(12345678901234567LL == keyvalue.value().getInt64());
+    }
+    cpptoml::set_isa(previous);
+}
+
+TEST_CASE("TestToml::Padded")
+{
+    static const char toml[] =
+        "[table00]\n"
+        "key00 = \"a basic string which is long enough to cover the widest kernel\"\n"
+        "key01 = 1234 # comment";
+    cpptoml::TomlParser parser;
+    uint64_t size = sizeof(toml) - 1;
+    char* buffer = parser.allocate_padded(size);
+    ::memcpy(buffer, toml, size);
+    bool result = parser.parse_padded(buffer, buffer + size);
+    EXPECT_TRUE(result);
+    if(result) {
+        cpptoml::TomlProxy table = parser.root().begin().value();
+        EXPECT_TRUE(cpptoml::TomlType::Table == table.type());
+        EXPECT_TRUE(2 == table.size());
+        EXPECT_TRUE(1234 == table.begin().next().value().getInt64());
+    }
+    parser.deallocate_padded(buffer);
+
+    // the unterminated string stops at the sentinel
+    static const char unterminated[] = "key00 = \"unterminated";
+    size = sizeof(unterminated) - 1;
+    buffer = parser.allocate_padded(size);
+    ::memcpy(buffer, unterminated, size);
+    EXPECT_FALSE(parser.parse_padded(buffer, buffer + size));
+    parser.deallocate_padded(buffer);
+
+    // documents which end inside a token, or hold a zero before the end, fail as with range checks
+    static const char* const cut[] = {"a = tru", "a = 1979-05-27T07:3", "a = 0x", "a = \"\\u00", "a = [1,", "[[a]", "a.", "a = 1\0"};
+    static const uint64_t sizes[] = {7, 19, 6, 9, 7, 4, 2, 6};
+    for(uint32_t i = 0; i < 8; ++i) {
+        buffer = parser.allocate_padded(sizes[i]);
+        ::memcpy(buffer, cut[i], sizes[i]);
+        EXPECT_FALSE(parser.parse_padded(buffer, buffer + sizes[i]));
+        EXPECT_FALSE(parser.parse(buffer, buffer + sizes[i]));
+        parser.deallocate_padded(buffer);
+    }
+}
+
+TEST_CASE("TestToml::Numbers")
+{
+    static const char toml[] =
+        "a = +1_000\n"
+        "b = -0\n"
+        "c = 0xdead_BEEF\n"
+        "d = 0o755\n"
+        "e = 0b1101\n"
+        "f = 3.14\n"
+        "g = -1e-3\n"
+        "h = 6E+2\n"
+        "i = 1_0.0_1\n"
+        "j = 1979-05-27T07:32:00Z\n";
+    static const cpptoml::TomlType types[] = {
+        cpptoml::TomlType::Integer,
+        cpptoml::TomlType::Integer,
+        cpptoml::TomlType::Hex,
+        cpptoml::TomlType::Oct,
+        cpptoml::TomlType::Bin,
+        cpptoml::TomlType::Float,
+        cpptoml::TomlType::Float,
+        cpptoml::TomlType::Float,
+        cpptoml::TomlType::Float,
+        cpptoml::TomlType::DateTime,
+    };
+    cpptoml::TomlParser parser;
+    bool result = parser.parse(toml, toml + sizeof(toml) - 1);
+    EXPECT_TRUE(result);
+    if(result) {
+        EXPECT_TRUE(10 == parser.root().size());
+        uint32_t count = 0;
+        for(cpptoml::TomlProxy i = parser.root().begin(); i; i = i.next()) {
+            EXPECT_TRUE(count < 10 && types[count] == i.value().type());
+            ++count;
+        }
+        cpptoml::TomlProxy i = parser.root().begin();
+        EXPECT_TRUE(1000 == i.value().getInt64());
+        i = i.next().next();
+        EXPECT_TRUE(0xDEADBEEF == i.value().getInt64());
+        i = i.next().next();
+        EXPECT_TRUE(13 == i.value().getInt64());
+        i = i.next().next();
+        EXPECT_TRUE(-1e-3 == i.value().getFloat64());
+        i = i.next().next();
+        EXPECT_TRUE(10.01 == i.value().getFloat64());
+    }
+
+    static const char* invalid[] = {
+        "a = 01",
+        "a = 1__0",
+        "a = 1_",
+        "a = 0x_1",
+        "a = 0o8",
+        "a = 1.",
+        "a = 1e",
+        "a = +0x1",
+    };
+    for(const char* str: invalid) {
+        EXPECT_FALSE(parser.parse(str, str + ::strlen(str)));
+    }
+}
+
+TEST_CASE("TestToml::Words")
+{
+    static const char* valid[] = {
+        "a = true",
+        "a = false",
+        "a = inf",
+        "a = -nan",
+        "a = 1979-05-27",
+        "a = 07:32:00.999999",
+        "a = 1979-05-27T07:32:00Z",
+        "a = 1979-05-27 07:32:00-07:00",
+        "a=[1979-05-27,07:32:00]",
+    };
+    cpptoml::TomlParser parser;
+    for(const char* str: valid) {
+        EXPECT_TRUE(parser.parse(str, str + ::strlen(str)));
+    }
+    static const char* invalid[] = {
+        "a = tru",
+        "a = fals",
+        "a = in",
+        "a = 1979-5-27",
+        "a = 07:32",
+        "a = 07:32:0a",
+        "a = 07:32:00.",
+        "a = 1979-05-27T07:32:00+07",
+        "a = 1979-05-27,07:32:00",
+    };
+    for(const char* str: invalid) {
+        EXPECT_FALSE(parser.parse(str, str + ::strlen(str)));
+    }
+}
+
+TEST_CASE("TestToml::Nesting")
+{
+    cpptoml::TomlParser parser;
+    std::string toml = "a = ";
+    toml.append(cpptoml::TomlParser::MaxNesting, '[');
+    toml.append(cpptoml::TomlParser::MaxNesting, ']');
+    EXPECT_TRUE(parser.parse(toml.data(), toml.data() + toml.size()));
+
+    toml = "a = ";
+    toml.append(cpptoml::TomlParser::MaxNesting + 1, '[');
+    toml.append(cpptoml::TomlParser::MaxNesting + 1, ']');
+    EXPECT_FALSE(parser.parse(toml.data(), toml.data() + toml.size()));
+
+    // far beyond what a recursive parser could take on the stack
+    toml = "a = ";
+    toml.append(1000000, '{');
+    EXPECT_FALSE(parser.parse(toml.data(), toml.data() + toml.size()));
+
+    static const char inline_table[] = "a = {b = [{c = 1}, {d.e = 2, f = 3}], g = 4}";
+    bool result = parser.parse(inline_table, inline_table + sizeof(inline_table) - 1);
+    EXPECT_TRUE(result);
+    if(result) {
+        cpptoml::TomlProxy a = parser.root().begin().value();
+        EXPECT_TRUE(2 == a.size());
+        cpptoml::TomlProxy b = a.begin().value();
+        EXPECT_TRUE(2 == b.size());
+        EXPECT_TRUE(2 == b.begin().next().size());
+    }
+}
+
+TEST_CASE("TestToml::Ranges")
+{
+    static const char* valid[] = {
+        "a = 9223372036854775807",
+        "a = -9223372036854775808",
+        "a = 0x7FFF_FFFF_FFFF_FFFF",
+        "a = 2000-02-29",
+        "a = 23:59:60",
+        "a = 1979-05-27T07:32:00-23:59",
+        "a = \"\\U0001F600 \xF0\x9F\x98\x80\"",
+        "a = [true, false]",
+    };
+    cpptoml::TomlParser parser;
+    parser.set_options(cpptoml::TomlParser::OptionValidate);
+    for(const char* str: valid) {
+        EXPECT_TRUE(parser.parse(str, str + ::strlen(str)));
+    }
+    static const char* invalid[] = {
+        "a = 9223372036854775808",
+        "a = 0o1000000000000000000000",
+        "a = 1900-02-29",
+        "a = 2023-04-31",
+        "a = 24:00:00",
+        "a = 1979-05-27T07:32:00+24:00",
+        "a = \"\\uD800\"",
+        "a = \"\xED\xA0\x80\"",
+        "a = \"\xC0\xAF\"",
+        "a = [1, 1.0]",
+        "a = [1]\n[[a]]",
+    };
+    parser.set_options(0);
+    for(const char* str: invalid) {
+        EXPECT_FALSE(parser.parse(str, str + ::strlen(str)));
+    }
+}
+
+TEST_CASE("TestToml::ArrayOfTables")
+{
+    std::string toml;
+    for(uint32_t i = 0; i < 10000; ++i) {
+        toml += "[[records]]\nid = " + std::to_string(i) + "\n[records.meta]\nx = 1\n";
+    }
+    // another spelling of the same header
+    toml += "[[ records ]]\nid = 10000\n[[records]]\nid = 10001\n[records.meta]\nx = 2\n";
+    cpptoml::TomlParser parser;
+    bool result = parser.parse(toml.data(), toml.data() + toml.size());
+    EXPECT_TRUE(result);
+    if(result) {
+        cpptoml::TomlProxy records = parser.root().begin().value();
+        EXPECT_TRUE(10002 == records.size());
+        int64_t id = 0;
+        bool ordered = true;
+        for(cpptoml::TomlProxy i = records.begin(); i; i = i.next()) {
+            ordered = ordered && (id == i.begin().value().getInt64());
+            ++id;
+        }
+        EXPECT_TRUE(ordered);
+        EXPECT_TRUE(10002 == id);
+    }
+
+    // headers of other arrays in between, nested and interleaved
+    toml.clear();
+    for(uint32_t i = 0; i < 1000; ++i) {
+        toml += "[[a.rec]]\nid = " + std::to_string(i) + "\n[[a.rec.item]]\nx = " + std::to_string(i) + "\n[[a.rec.item]]\nx = " + std::to_string(i + 1) + "\n";
+        toml += "[[b.rec]]\nid = " + std::to_string(i) + "\n[a.rec.meta]\ny = 1\n";
+    }
+    result = parser.parse(toml.data(), toml.data() + toml.size());
+    EXPECT_TRUE(result);
+    if(result) {
+        cpptoml::TomlProxy a = parser.root().begin().value().begin().value();
+        cpptoml::TomlProxy b = parser.root().begin().next().value().begin().value();
+        EXPECT_TRUE(1000 == a.size());
+        EXPECT_TRUE(1000 == b.size());
+        int64_t id = 0;
+        bool ordered = true;
+        cpptoml::TomlProxy j = b.begin();
+        for(cpptoml::TomlProxy i = a.begin(); i && j; i = i.next(), j = j.next()) {
+            cpptoml::TomlProxy item = i.begin().next().value();
+            ordered = ordered && (3 == i.size()) && (id == i.begin().value().getInt64()) && (id == j.begin().value().getInt64());
+            ordered = ordered && (2 == item.size()) && (id + 1 == item.begin().next().begin().value().getInt64());
+            ++id;
+        }
+        EXPECT_TRUE(ordered);
+        EXPECT_TRUE(1000 == id);
+    }
+
+    // a table is never linked twice, defining it after its sub tables keeps them
+    const char* super = "[a.b]\nx = 1\n[a]\ny = 2\n";
+    result = parser.parse(super, super + ::strlen(super));
+    EXPECT_TRUE(result);
+    if(result) {
+        EXPECT_TRUE(2 == parser.root().begin().value().size());
+    }
+    const char* dotted = "a.b.c = 1\na.b = 2\n";
+    EXPECT_FALSE(parser.parse(dotted, dotted + ::strlen(dotted)));
+}
+
+TEST_CASE("TestToml::HeaderPaths")
+{
+    std::string toml;
+    for(uint32_t i = 0; i < 100; ++i) {
+        toml += "[service.http.routes.r" + std::to_string(i) + "]\nlimits.rate = " + std::to_string(i) + "\nlimits.burst = 1\n";
+    }
+    // defining a table after its sub tables keeps them
+    toml += "[service]\nname = \"s\"\n";
+    cpptoml::TomlParser parser;
+    bool result = parser.parse(toml.data(), toml.data() + toml.size());
+    EXPECT_TRUE(result);
+    if(result) {
+        cpptoml::TomlProxy service = parser.root().begin().value();
+        EXPECT_TRUE(2 == service.size());
+        cpptoml::TomlProxy routes = service.begin().value().begin().value();
+        EXPECT_TRUE(100 == routes.size());
+        int64_t rate = 0;
+        bool ordered = true;
+        for(cpptoml::TomlProxy i = routes.begin(); i; i = i.next()) {
+            cpptoml::TomlProxy limits = i.value().begin().value();
+            ordered = ordered && (2 == limits.size()) && (rate == limits.begin().value().getInt64());
+            ++rate;
+        }
+        EXPECT_TRUE(ordered);
+        EXPECT_TRUE(100 == rate);
+    }
+
+    // a key/value pair cannot redefine a table
+    const char* header = "[a.b]\n[a]\nb = 1\n";
+    EXPECT_FALSE(parser.parse(header, header + ::strlen(header)));
+
+    // the keys of tables with many children are found through an index, with interned keys too
+    for(uint32_t options: {0U, cpptoml::TomlParser::OptionInternKeys}) {
+        parser.set_options(options);
+        std::string siblings;
+        for(uint32_t i = 0; i < 1000; ++i) {
+            siblings += "[svc.routes.r" + std::to_string(i) + "]\nk" + std::to_string(i) + " = " + std::to_string(i) + "\n";
+        }
+        siblings += "[svc.routes.r7.extra]\nx = 1\n";
+        EXPECT_TRUE(parser.parse(siblings.data(), siblings.data() + siblings.size()));
+        cpptoml::TomlProxy routes = parser.root().begin().value().begin().value();
+        EXPECT_TRUE(1000 == routes.size());
+        cpptoml::TomlProxy r7 = routes.begin();
+        for(uint32_t i = 0; i < 7; ++i) {
+            r7 = r7.next();
+        }
+        EXPECT_TRUE(2 == r7.value().size());
+        std::string twice = siblings + "[svc.routes.r500]\n";
+        EXPECT_FALSE(parser.parse(twice.data(), twice.data() + twice.size()));
+        twice = siblings + "[svc.routes.r500.extra]\n[svc.routes.r500]\nk500 = 1\n";
+        EXPECT_FALSE(parser.parse(twice.data(), twice.data() + twice.size()));
+    }
+    parser.set_options(0);
+}
+
+TEST_CASE("TestToml::InternKeys")
+{
+    static const char name[] = "name";
+    static const char enabled[] = "enabled";
+    cpptoml::TomlParser parser;
+    parser.set_options(cpptoml::TomlParser::OptionInternKeys);
+    uint32_t name_id = parser.intern(name, name + 4);
+    uint32_t enabled_id = parser.intern(enabled, enabled + 7);
+    EXPECT_TRUE(name_id != enabled_id);
+    EXPECT_TRUE(name_id == parser.intern(name, name + 4));
+
+    std::string toml;
+    for(uint32_t i = 0; i < 1000; ++i) {
+        toml += "[[items]]\nid = " + std::to_string(i) + "\nname = \"n\"\nenabled = " + ((i & 1) ? "true" : "false") + "\n";
+    }
+    for(uint32_t i = 0; i < 2; ++i) {
+        // pinned IDs survive the next document
+        bool result = parser.parse(toml.data(), toml.data() + toml.size());
+        EXPECT_TRUE(result);
+        if(!result) {
+            continue;
+        }
+        cpptoml::TomlProxy items = parser.root().begin().value();
+        uint32_t odd = 0;
+        bool found = true;
+        for(cpptoml::TomlProxy item = items.begin(); item; item = item.next()) {
+            found = found && item.find(name_id) && (name_id == item.begin().next().getKeyId());
+            odd += item.find(enabled_id).getBool() ? 1 : 0;
+        }
+        EXPECT_TRUE(found);
+        EXPECT_TRUE(500 == odd);
+    }
+
+    const char* duplicate = "name = 1\nname = 2\n";
+    EXPECT_FALSE(parser.parse(duplicate, duplicate + ::strlen(duplicate)));
+}
+
+TEST_CASE("TestToml::ParseParallel")
+{
+    std::string toml = "title = \"parallel\"\n";
+    uint32_t count = 0;
+    while(toml.size() < 3 * cpptoml::TomlParser::MinChunk) {
+        toml += "[[records]]\nid = " + std::to_string(count) + "\nname = \"record\"\n[records.meta]\nscore = 1.5\n";
+        if(0 == (count % 100)) {
+            toml += "[services.s" + std::to_string(count) + ".http]\nport = " + std::to_string(count) + "\n";
+        }
+        ++count;
+    }
+    cpptoml::TomlParser serial;
+    cpptoml::TomlParser parallel;
+    EXPECT_TRUE(serial.parse(toml.data(), toml.data() + toml.size()));
+    bool result = parallel.parse_parallel(toml.data(), toml.data() + toml.size(), 3);
+    EXPECT_TRUE(result);
+    if(result) {
+        cpptoml::TomlProxy root = parallel.root();
+        EXPECT_TRUE(3 == root.size());
+        cpptoml::TomlProxy records = root.begin().next().value();
+        EXPECT_TRUE(count == records.size());
+        int64_t id = 0;
+        bool ordered = true;
+        for(cpptoml::TomlProxy i = records.begin(); i; i = i.next()) {
+            ordered = ordered && (id == i.begin().value().getInt64()) && (3 == i.size());
+            ++id;
+        }
+        EXPECT_TRUE(ordered);
+        EXPECT_TRUE(count == id);
+        EXPECT_TRUE(serial.root().begin().next().next().value().size() == root.begin().next().next().value().size());
+    }
+
+    // a table defined again far away is found by the serial parse
+    toml += "[services.s0.http]\n";
+    EXPECT_FALSE(parallel.parse_parallel(toml.data(), toml.data() + toml.size(), 3));
+}
+
+TEST_CASE("TestToml::LargeArrays")
+{
+    std::string toml = "values = [\n";
+    uint32_t count = 0;
+    while(toml.size() < 2 * cpptoml::TomlParser::MinChunk) {
+        toml += "\"" + std::to_string(count) + ",]\", # [\n";
+        ++count;
+    }
+    toml += "]\nnext = 1\n";
+    cpptoml::TomlParser serial;
+    cpptoml::TomlParser parallel;
+    EXPECT_TRUE(serial.parse(toml.data(), toml.data() + toml.size()));
+    bool result = parallel.parse_parallel(toml.data(), toml.data() + toml.size(), 4);
+    EXPECT_TRUE(result);
+    if(result) {
+        cpptoml::TomlProxy root = parallel.root();
+        EXPECT_TRUE(2 == root.size());
+        cpptoml::TomlProxy values = root.begin().value();
+        EXPECT_TRUE(count == values.size());
+        EXPECT_TRUE(serial.root().begin().value().size() == values.size());
+        uint32_t index = 0;
+        bool ordered = true;
+        char value[32];
+        for(cpptoml::TomlProxy i = values.begin(); i; i = i.next()) {
+            ordered = ordered && i.getStrLen() < sizeof(value);
+            if(ordered) {
+                uint64_t size = i.getString(value);
+                ordered = ("\"" + std::to_string(index) + ",]\"") == std::string(value, size);
+            }
+            ++index;
+        }
+        EXPECT_TRUE(ordered);
+        EXPECT_TRUE(count == index);
+    }
+
+    // arrays are homogeneous across slices
+    toml.insert(toml.rfind("]\nnext"), "1,\n");
+    EXPECT_FALSE(parallel.parse_parallel(toml.data(), toml.data() + toml.size(), 4));
+    EXPECT_FALSE(serial.parse(toml.data(), toml.data() + toml.size()));
+
+    // elements of slices count the array around them to MaxNesting
+    std::string nested = "values = [\n";
+    while(nested.size() < 2 * cpptoml::TomlParser::MinChunk) {
+        nested += "[1],\n";
+    }
+    std::string deep = std::string(cpptoml::TomlParser::MaxNesting - 1, '[') + "1" + std::string(cpptoml::TomlParser::MaxNesting - 1, ']');
+    toml = nested + deep + "]\n";
+    EXPECT_TRUE(parallel.parse_parallel(toml.data(), toml.data() + toml.size(), 4));
+    EXPECT_TRUE(serial.parse(toml.data(), toml.data() + toml.size()));
+    toml = nested + "[" + deep + "]]\n";
+    EXPECT_FALSE(parallel.parse_parallel(toml.data(), toml.data() + toml.size(), 4));
+    EXPECT_FALSE(serial.parse(toml.data(), toml.data() + toml.size()));
+}
+
+TEST_CASE("TestToml::ParsePipelined")
+{
+    std::string toml;
+    uint32_t count = 0;
+    while(toml.size() < 512 * 1024) {
+        toml += "[[text]]\nvalue = \"\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E \xC3\xA9\" # \xF0\x9F\x98\x80\nliteral = '\xE2\x82\xAC'\n";
+        ++count;
+    }
+    cpptoml::TomlParser serial;
+    cpptoml::TomlParser pipelined;
+    EXPECT_TRUE(serial.parse(toml.data(), toml.data() + toml.size()));
+    bool result = pipelined.parse_pipelined(toml.data(), toml.data() + toml.size());
+    EXPECT_TRUE(result);
+    if(result) {
+        cpptoml::TomlProxy text = pipelined.root().begin().value();
+        EXPECT_TRUE(count == text.size());
+        EXPECT_TRUE(serial.root().begin().value().size() == text.size());
+    }
+
+    // a surrogate is found either by the producer or by the parser, the key is new to the last table
+    std::string valid = toml + "surrogate = \"\xED\x9F\xBF\"\n";
+    EXPECT_TRUE(pipelined.parse_pipelined(valid.data(), valid.data() + valid.size()));
+    EXPECT_TRUE(serial.parse(valid.data(), valid.data() + valid.size()));
+    toml += "surrogate = \"\xED\xA0\x80\"\n";
+    EXPECT_FALSE(pipelined.parse_pipelined(toml.data(), toml.data() + toml.size()));
+    EXPECT_FALSE(serial.parse(toml.data(), toml.data() + toml.size()));
+}
+
+TEST_CASE("TestToml::SharedDocument")
+{
+    static constexpr uint32_t Readers = 8;
+    std::string toml = "[servers]\n";
+    for(uint32_t i = 0; i < 100; ++i) {
+        toml += "s" + std::to_string(i) + " = { port = " + std::to_string(8000 + i) + ", name = \"server\" }\n";
+    }
+    cpptoml::TomlDocument document;
+    {
+        cpptoml::TomlParser parser;
+        EXPECT_TRUE(parser.parse(toml.data(), toml.data() + toml.size()));
+        document = parser.share();
+        EXPECT_FALSE(parser.root());
+    }
+    // the document keeps its own text
+    toml.assign(toml.size(), '#');
+    EXPECT_TRUE(document);
+    EXPECT_TRUE(1 == document.use_count());
+
+    std::atomic<uint32_t> found(0);
+    std::thread readers[Readers];
+    for(uint32_t r = 0; r < Readers; ++r) {
+        readers[r] = std::thread([document, &found]() {
+            for(uint32_t n = 0; n < 100; ++n) {
+                cpptoml::TomlDocument local = document;
+                cpptoml::TomlProxy servers = local.root().begin().value();
+                int64_t sum = 0;
+                for(cpptoml::TomlProxy i = servers.begin(); i; i = i.next()) {
+                    sum += i.value().begin().value().getInt64();
+                }
+                if((8000 * 100 + 99 * 100 / 2) == sum) {
+                    found.fetch_add(1);
+                }
+            }
+        });
+    }
+    for(uint32_t r = 0; r < Readers; ++r) {
+        readers[r].join();
+    }
+    EXPECT_TRUE((Readers * 100) == found.load());
+    EXPECT_TRUE(1 == document.use_count());
+    cpptoml::TomlDocument moved = std::move(document);
+    EXPECT_FALSE(document);
+    EXPECT_TRUE(1 == moved.use_count());
+}
+
+TEST_CASE("TestToml::ConfigHandle")
+{
+    const char* path = "config_handle.toml";
+    // replace the file by renaming, the watcher may read it at any time
+    auto replace = [path](const std::string& toml) {
+        FILE* f = fopen("config_handle.tmp", "wb");
+        if(NULL == f) {
+            return false;
+        }
+        fwrite(toml.data(), toml.size(), 1, f);
+        fclose(f);
+        return 0 == rename("config_handle.tmp", path);
+    };
+    auto write = [&replace](int64_t value) {
+        return replace("[server]\nport = " + std::to_string(value) + "\n");
+    };
+    if(!write(8000)) {
+        return;
+    }
+    cpptoml::TomlConfigHandle handle;
+    EXPECT_TRUE(handle.open(path));
+    uint32_t reader = handle.attach();
+    EXPECT_TRUE(cpptoml::TomlParser::Invalid != reader);
+    auto port = [&handle, reader]() {
+        const cpptoml::TomlDocument* document = handle.enter(reader);
+        int64_t value = document->root().begin().value().begin().value().getInt64();
+        handle.leave(reader);
+        return value;
+    };
+    EXPECT_TRUE(8000 == port());
+
+    // a document seen by a reader stays valid until it leaves
+    const cpptoml::TomlDocument* document = handle.enter(reader);
+    write(8001);
+    EXPECT_TRUE(handle.reload());
+    EXPECT_TRUE(8000 == document->root().begin().value().begin().value().getInt64());
+    handle.leave(reader);
+    EXPECT_TRUE(8001 == port());
+
+    // a broken file keeps the last document
+    replace("port = \n");
+    EXPECT_FALSE(handle.reload());
+    EXPECT_TRUE(8001 == port());
+
+#ifdef __linux__
+    uint64_t version = handle.version();
+    write(8002);
+    for(uint32_t i = 0; i < 500 && handle.version() == version; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(8002 == port());
+
+    // a signal which interrupts the watcher does not stop it, this thread blocks the signal so the watcher takes it
+    struct sigaction action = {};
+    struct sigaction previous = {};
+    action.sa_handler = [](int) {};
+    sigaction(SIGUSR1, &action, &previous);
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    for(uint32_t i = 0; i < 4; ++i) {
+        kill(getpid(), SIGUSR1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    version = handle.version();
+    write(8003);
+    for(uint32_t i = 0; i < 500 && handle.version() == version; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(8003 == port());
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+    sigaction(SIGUSR1, &previous, NULL);
+#endif
+    handle.detach(reader);
+    handle.close();
+    remove(path);
+}
+
+TEST_CASE("TestToml::ReparseIncremental")
+{
+    std::string toml = "title = \"incremental\"\n";
+    uint32_t count = 0;
+    while(toml.size() < 256 * 1024) {
+        toml += "[[records]]\nid = " + std::to_string(count) + "\nname = \"record\"\n";
+        if(0 == (count % 50)) {
+            toml += "[section" + std::to_string(count) + "]\nvalue = " + std::to_string(count) + "\n";
+        }
+        ++count;
+    }
+    cpptoml::TomlParser serial;
+    cpptoml::TomlParser incremental;
+    EXPECT_TRUE(incremental.reparse_incremental(toml.data(), toml.data() + toml.size()));
+    EXPECT_TRUE(incremental.root().size() == 2 + (count + 49) / 50);
+    uint32_t sections = incremental.section_count();
+    EXPECT_TRUE(8 <= sections);
+    EXPECT_TRUE(sections == incremental.reparsed_sections());
+
+    // edit a value in the middle, sections before and after it are reused
+    std::string edited = toml;
+    size_t position = edited.find("[section2500]\nvalue = 2500");
+    EXPECT_TRUE(std::string::npos != position);
+    edited.replace(position, 26, "[section2500]\nvalue = 12345\nadded = true");
+    EXPECT_TRUE(serial.parse(edited.data(), edited.data() + edited.size()));
+    bool result = incremental.reparse_incremental(edited.data(), edited.data() + edited.size());
+    EXPECT_TRUE(result);
+    // the edit can move the cuts next to it only
+    EXPECT_TRUE(1 <= incremental.reparsed_sections() && incremental.reparsed_sections() <= 2);
+    EXPECT_TRUE(sections - 1 <= incremental.section_count() && incremental.section_count() <= sections + 1);
+    if(result) {
+        cpptoml::TomlProxy root = incremental.root();
+        EXPECT_TRUE(serial.root().size() == root.size());
+        cpptoml::TomlProxy records = root.begin().next().value();
+        EXPECT_TRUE(count == records.size());
+        int64_t id = 0;
+        bool ordered = true;
+        for(cpptoml::TomlProxy i = records.begin(); i; i = i.next()) {
+            ordered = ordered && (id == i.begin().value().getInt64());
+            ++id;
+        }
+        EXPECT_TRUE(ordered);
+        bool found = false;
+        char key[32];
+        for(cpptoml::TomlProxy i = root.begin(); i; i = i.next()) {
+            if(i.key().getStrLen() < sizeof(key) && std::string("section2500") == std::string(key, i.key().getString(key))) {
+                found = 2 == i.value().size() && 12345 == i.value().begin().value().getInt64();
+            }
+        }
+        EXPECT_TRUE(found);
+    }
+
+    // the original again, a table defined twice and an empty document
+    EXPECT_TRUE(incremental.reparse_incremental(toml.data(), toml.data() + toml.size()));
+    EXPECT_TRUE(incremental.root().size() == 2 + (count + 49) / 50);
+    EXPECT_TRUE(incremental.reparsed_sections() <= 2);
+    EXPECT_TRUE(incremental.reparse_incremental(toml.data(), toml.data() + toml.size()));
+    EXPECT_TRUE(0 == incremental.reparsed_sections());
+    edited = toml + "[section0]\nvalue = 1\n";
+    EXPECT_FALSE(incremental.reparse_incremental(edited.data(), edited.data() + edited.size()));
+    EXPECT_TRUE(incremental.reparse_incremental(toml.data(), toml.data()));
+    EXPECT_TRUE(0 == incremental.root().size());
+}
+
+TEST_CASE("TestToml::ParseAppend")
+{
+    cpptoml::TomlParser tail;
+    std::string log = "title = \"events\"\n";
+    EXPECT_TRUE(tail.parse_append(log.data(), log.data() + log.size()));
+    EXPECT_TRUE(log.size() == tail.appended_size());
+    for(int64_t i = 0; i < 1000; ++i) {
+        log += "[[event]]\nid = " + std::to_string(i) + "\ntags = [\n  \"a\",\n  \"b\",\n]\n";
+        if(0 == (i % 10)) {
+            // polls see unfinished lines and arrays, the string may move its buffer
+            std::string part = log.substr(0, log.size() - 12);
+            EXPECT_TRUE(tail.parse_append(part.data(), part.data() + part.size()));
+            EXPECT_TRUE(tail.appended_size() <= part.size());
+        }
+    }
+    EXPECT_TRUE(tail.parse_append(log.data(), log.data() + log.size()));
+    EXPECT_TRUE(log.size() == tail.appended_size());
+    cpptoml::TomlProxy events = tail.root().begin().next().value();
+    EXPECT_TRUE(1000 == events.size());
+    int64_t id = 0;
+    bool ordered = true;
+    for(cpptoml::TomlProxy i = events.begin(); i; i = i.next()) {
+        ordered = ordered && (id == i.begin().value().getInt64()) && (2 == i.begin().next().value().size());
+        ++id;
+    }
+    EXPECT_TRUE(ordered);
+
+    // a line without a newline waits, a broken line fails and the next call begins again
+    std::string more = log + "last = 1";
+    EXPECT_TRUE(tail.parse_append(more.data(), more.data() + more.size()));
+    EXPECT_TRUE(log.size() == tail.appended_size());
+    EXPECT_TRUE(2 == tail.root().size());
+    more += "\nbroken = \n";
+    EXPECT_FALSE(tail.parse_append(more.data(), more.data() + more.size()));
+    EXPECT_TRUE(0 == tail.appended_size());
+    EXPECT_TRUE(tail.parse_append(log.data(), log.data() + log.size()));
+    EXPECT_TRUE(1000 == tail.root().begin().next().value().size());
+
+    // the final call parses the last line without a newline, the next call begins again
+    cpptoml::TomlParser last;
+    std::string tail_line = "a = 1\nb = 2";
+    EXPECT_TRUE(last.parse_append(tail_line.data(), tail_line.data() + tail_line.size()));
+    EXPECT_TRUE(1 == last.root().size());
+    EXPECT_TRUE(last.parse_append(tail_line.data(), tail_line.data() + tail_line.size(), true));
+    EXPECT_TRUE(0 == last.appended_size());
+    EXPECT_TRUE(2 == last.root().size());
+    EXPECT_TRUE(2 == last.root().begin().next().value().getInt64());
+    EXPECT_FALSE(last.parse_append(tail_line.data(), tail_line.data() + tail_line.size() - 1, true));
+}
+
+TEST_CASE("TestToml::ParseFile")
+{
+    const char* path = "parse_file.toml";
+    auto write = [path](const std::string& toml) {
+        FILE* f = fopen(path, "wb");
+        if(NULL == f) {
+            return false;
+        }
+        fwrite(toml.data(), toml.size(), 1, f);
+        fclose(f);
+        return true;
+    };
+    // the padding after the end of a mapping depends on the size of the file
+    std::string toml = "[server]\nname = \"mapped\"\nport = 8080\n";
+    for(uint32_t size : {0U, 4096U - 64U, 4096U}) {
+        while(toml.size() < size) {
+            toml += "#";
+        }
+        if(!write(toml)) {
+            return;
+        }
+        cpptoml::TomlParser parser;
+        parser.set_options(0 == size ? cpptoml::TomlParser::OptionPrefault : 0);
+        EXPECT_TRUE(cpptoml::TomlStatus::Success == parser.parse_file(path));
+        cpptoml::TomlProxy server = parser.root().begin().value();
+        EXPECT_TRUE(2 == server.size());
+        EXPECT_TRUE(8080 == server.begin().next().value().getInt64());
+        // another document releases the mapping
+        EXPECT_TRUE(parser.parse(toml.data(), toml.data() + toml.size()));
+        EXPECT_TRUE(8080 == parser.root().begin().value().begin().next().value().getInt64());
+    }
+
+    cpptoml::TomlParser parser;
+    write("");
+    EXPECT_TRUE(cpptoml::TomlStatus::Success == parser.parse_file(path));
+    EXPECT_TRUE(0 == parser.root().size());
+    write("port = \n");
+    EXPECT_TRUE(cpptoml::TomlStatus::ParseError == parser.parse_file(path));
+    remove(path);
+    EXPECT_TRUE(cpptoml::TomlStatus::FileError == parser.parse_file(path));
+
+    // a file which can not be read keeps the last document
+    write(toml);
+    EXPECT_TRUE(cpptoml::TomlStatus::Success == parser.parse_file(path));
+    remove(path);
+    EXPECT_TRUE(cpptoml::TomlStatus::FileError == parser.parse_file(path));
+    EXPECT_TRUE(cpptoml::TomlStatus::FileError == parser.parse_file("."));
+    char key[16];
+    EXPECT_TRUE(std::string("server") == std::string(key, parser.root().begin().key().getString(key)));
+    EXPECT_TRUE(8080 == parser.root().begin().value().begin().next().value().getInt64());
+}
+
+TEST_CASE("TestToml::Feed")
+{
+    std::string toml = "title = \"stream\"\n"
+                       "text = \"\"\"\nmulti\\\n  line \\u00e9\"\"\"\n"
+                       "[[items]]\nid = 1\ntags = [\"a\", # comment\n  \"b\"]\n"
+                       "[[items]]\nid = 2\ninline = {x = 1, y = 'two'}\n"
+                       "last = 3";
+    cpptoml::TomlParser serial;
+    EXPECT_TRUE(serial.parse(toml.data(), toml.data() + toml.size()));
+    // chunks end at every byte, inside strings, escapes and arrays
+    cpptoml::TomlParser stream;
+    for(uint64_t step = 1; step < 16; ++step) {
+        bool result = true;
+        for(uint64_t i = 0; i < toml.size(); i += step) {
+            result = stream.feed(toml.data() + i, (std::min)(step, toml.size() - i)) && result;
+        }
+        result = stream.finish() && result;
+        EXPECT_TRUE(result);
+        cpptoml::TomlProxy root = stream.root();
+        EXPECT_TRUE(serial.root().size() == root.size());
+        cpptoml::TomlProxy items = root.begin().next().next().value();
+        EXPECT_TRUE(2 == items.size());
+        EXPECT_TRUE(2 == items.begin().next().begin().value().getInt64());
+        EXPECT_TRUE(3 == items.begin().next().begin().next().next().value().getInt64());
+        EXPECT_TRUE(serial.root().begin().next().value().getStrLen() == root.begin().next().value().getStrLen());
+    }
+
+    // a broken line fails the document, finish begins the next one
+    std::string broken = "a = 1\nb = \n";
+    EXPECT_TRUE(stream.feed(broken.data(), 7));
+    EXPECT_FALSE(stream.feed(broken.data() + 7, broken.size() - 7));
+    EXPECT_FALSE(stream.feed("c = 1\n", 6));
+    EXPECT_FALSE(stream.finish());
+    const char unclosed[] = "s = \"\"\"unclosed\n";
+    EXPECT_TRUE(stream.feed(unclosed, sizeof(unclosed) - 1));
+    EXPECT_FALSE(stream.finish());
+    EXPECT_TRUE(stream.finish());
+    EXPECT_TRUE(0 == stream.root().size());
+}
+
+TEST_CASE("TestToml::ParseEvents")
+{
+    struct Counter : public cpptoml::TomlHandler
+    {
+        uint32_t headers_ = 0;
+        uint32_t arrays_ = 0;
+        uint32_t keys_ = 0;
+        uint32_t segments_ = 0;
+        uint32_t values_ = 0;
+        uint32_t depth_ = 0;
+        uint32_t stop_ = 0xFFFFFFFFU;
+        std::string last_;
+
+        bool on_table_header(const cpptoml::TomlSpan* path, uint32_t size, bool array) override
+        {
+            ++headers_;
+            arrays_ += array ? 1 : 0;
+            last_.assign(path[size - 1].begin_, path[size - 1].end_);
+            return true;
+        }
+        bool on_key(const cpptoml::TomlSpan* path, uint32_t size) override
+        {
+            ++keys_;
+            segments_ += size;
+            last_.assign(path[0].begin_, path[size - 1].end_);
+            return true;
+        }
+        bool on_value(cpptoml::TomlType, cpptoml::TomlSpan) override
+        {
+            return ++values_ < stop_;
+        }
+        bool on_array_begin() override
+        {
+            ++depth_;
+            return true;
+        }
+        bool on_array_end() override
+        {
+            --depth_;
+            return true;
+        }
+        bool on_inline_table_begin() override
+        {
+            ++depth_;
+            return true;
+        }
+        bool on_inline_table_end() override
+        {
+            --depth_;
+            return true;
+        }
+    };
+    static const char toml[] =
+        "title = \"events\" # comment\n"
+        "[server.\"http\"]\n"
+        "ports = [ 8000, 8001,\n  8002 ]\n"
+        "limits = { read = 1.5, write = [true, false] }\n"
+        "[[items]]\n"
+        "a.b.c = 1979-05-27T07:32:00Z\n"
+        "[[items]]\n";
+    cpptoml::TomlParser parser;
+    Counter counter;
+    EXPECT_TRUE(parser.parse_events(toml, toml + sizeof(toml) - 1, counter));
+    EXPECT_TRUE(3 == counter.headers_);
+    EXPECT_TRUE(2 == counter.arrays_);
+    EXPECT_TRUE(6 == counter.keys_);
+    EXPECT_TRUE(8 == counter.segments_);
+    EXPECT_TRUE(8 == counter.values_);
+    EXPECT_TRUE(0 == counter.depth_);
+    EXPECT_TRUE("items" == counter.last_);
+    EXPECT_TRUE(0 == parser.root().size());
+
+    // values are checked, keys defined twice only with OptionCheckKeys
+    static const char mixed[] = "a = [1, \"one\"]\n";
+    EXPECT_FALSE(parser.parse_events(mixed, mixed + sizeof(mixed) - 1, counter));
+    static const char twice[] = "a = 1\na = 2\n";
+    EXPECT_TRUE(parser.parse_events(twice, twice + sizeof(twice) - 1, counter));
+    parser.set_options(cpptoml::TomlParser::OptionCheckKeys);
+    EXPECT_FALSE(parser.parse_events(twice, twice + sizeof(twice) - 1, counter));
+    EXPECT_TRUE(parser.parse_events(toml, toml + sizeof(toml) - 1, counter));
+    EXPECT_TRUE(3 == parser.root().size());
+
+    // a handler stops parsing
+    Counter stop;
+    stop.stop_ = 2;
+    EXPECT_FALSE(parser.parse_events(toml, toml + sizeof(toml) - 1, stop));
+    EXPECT_TRUE(2 == stop.values_);
+}
+
+TEST_CASE("TestToml::Reader")
+{
+    static const char toml[] =
+        "title = \"reader\" # comment\n"
+        "\n"
+        "[server.\"http\"]\n"
+        "ports = [ 8000,\n  8001 ]\n"
+        "limits = { read = 1.5, write.max = 4 }\n"
+        "skipped = [[1, 2], { a = \"]\" }] # ]\n"
+        "[[items]]\n"
+        "name = \"first\"\n";
+    cpptoml::TomlReader reader;
+    reader.open(toml, toml + sizeof(toml) - 1);
+    uint32_t values = 0;
+    while(reader.next()) {
+        const cpptoml::TomlEvent& event = reader.event();
+        std::string text(event.text_.begin_, event.text_.end_);
+        if(cpptoml::TomlEventType::Value == event.type_) {
+            ++values;
+        }
+        if("1.5" == text) {
+            // server, "http", limits, read
+            EXPECT_TRUE(cpptoml::TomlType::Float == event.value_);
+            EXPECT_TRUE(4 == reader.path_size());
+            EXPECT_TRUE("limits" == std::string(reader.path()[2].begin_, reader.path()[2].end_));
+        } else if("4" == text) {
+            EXPECT_TRUE(5 == reader.path_size());
+        } else if("skipped" == text) {
+            EXPECT_TRUE(cpptoml::TomlEventType::Key == event.type_);
+            EXPECT_TRUE(3 == reader.path_size());
+            EXPECT_TRUE(reader.skip_value());
+            EXPECT_TRUE(2 == reader.path_size());
+        } else if("items" == text) {
+            EXPECT_TRUE(cpptoml::TomlEventType::ArrayTableHeader == event.type_);
+            EXPECT_TRUE(1 == reader.path_size());
+        } else if("[" == text && 3 == reader.path_size()) {
+            // the rest of ports
+            EXPECT_TRUE(cpptoml::TomlEventType::ArrayBegin == event.type_);
+            EXPECT_TRUE(reader.skip_value());
+            EXPECT_FALSE(reader.skip_value());
+        }
+    }
+    EXPECT_FALSE(reader.failed());
+    EXPECT_TRUE(4 == values);
+
+    // the events of a range-based for loop
+    static const char small[] = "a = [1, 2]\nb = {}\n";
+    reader.open(small, small + sizeof(small) - 1);
+    uint32_t events = 0;
+    for(const cpptoml::TomlEvent& event: reader) {
+        (void)event;
+        ++events;
+    }
+    EXPECT_TRUE(8 == events);
+    EXPECT_FALSE(reader.failed());
+
+    // values are checked as by parse
+    static const char mixed[] = "a = [1, \"one\"]\n";
+    reader.open(mixed, mixed + sizeof(mixed) - 1);
+    while(reader.next()) {
+    }
+    EXPECT_TRUE(reader.failed());
+    static const char broken[] = "a = 1 b = 2\n";
+    reader.open(broken, broken + sizeof(broken) - 1);
+    while(reader.next()) {
+    }
+    EXPECT_TRUE(reader.failed());
+}
+
+TEST_CASE("TestToml::RecordReader")
+{
+    static const char toml[] =
+        "title = \"records\"\n"
+        "[[row]]\n"
+        "id = 0\n"
+        "text = '''\n[[row]]\nid = 9\n'''\n"
+        "[row.sub]\n"
+        "x = 1\n"
+        "[other]\n"
+        "y = [\n[1], [2]]\n"
+        "  [[ row ]] # comment\n"
+        "id = 1\n"
+        "[[row.items]]\n"
+        "z = 2\n"
+        "[[rows]]\n"
+        "id = 5\n"
+        "[[row]]\n"
+        "id = 2\n";
+    cpptoml::TomlRecordReader reader;
+    reader.open(toml, toml + sizeof(toml) - 1, "row");
+    int64_t ids = 0;
+    while(reader.next()) {
+        cpptoml::TomlProxy record = reader.record();
+        EXPECT_TRUE(cpptoml::TomlType::Table == record.type());
+        ids += record.begin().value().getInt64();
+    }
+    EXPECT_FALSE(reader.failed());
+    EXPECT_TRUE(3 == reader.count());
+    EXPECT_TRUE(3 == ids);
+
+    // records are handed to workers through a bounded queue
+    struct Sum : public cpptoml::TomlRecordHandler
+    {
+        std::atomic<int64_t> ids_{0};
+        std::atomic<uint64_t> indices_{0};
+        bool on_record(uint32_t, uint64_t index, cpptoml::TomlProxy record) override
+        {
+            ids_ += record.begin().value().getInt64();
+            indices_ += index;
+            return true;
+        }
+    };
+    std::string many;
+    for(int32_t i = 0; i < 1000; ++i) {
+        many += "[[row]]\nid = " + std::to_string(i) + "\n[row.sub]\nname = \"r" + std::to_string(i) + "\"\n";
+    }
+    for(uint32_t threads: {1U, 3U}) {
+        Sum sum;
+        EXPECT_TRUE(reader.parse_records(many.data(), many.data() + many.size(), "row", threads, sum));
+        EXPECT_TRUE(499500 == sum.ids_.load());
+        EXPECT_TRUE(499500 == sum.indices_.load());
+        EXPECT_TRUE(1000 == reader.count());
+    }
+
+    // an error in a record
+    static const char broken[] = "[[row]]\nid = 0\n[[row]]\nid = \n[[row]]\nid = 2\n";
+    reader.open(broken, broken + sizeof(broken) - 1, "row");
+    EXPECT_TRUE(reader.next());
+    EXPECT_FALSE(reader.next());
+    EXPECT_TRUE(reader.failed());
+    Sum sum;
+    EXPECT_FALSE(reader.parse_records(broken, broken + sizeof(broken) - 1, "row", 2, sum));
+    EXPECT_TRUE(reader.failed());
+
+    // a sub table after another table belongs to a record which is already read
+    static const char detached[] = "[[row]]\na = 1\n[other]\nx = 1\n[row.sub]\ny = 2\n";
+    reader.open(detached, detached + sizeof(detached) - 1, "row");
+    EXPECT_TRUE(reader.next());
+    EXPECT_FALSE(reader.next());
+    EXPECT_TRUE(reader.failed());
+    EXPECT_FALSE(reader.parse_records(detached, detached + sizeof(detached) - 1, "row", 2, sum));
+    EXPECT_TRUE(reader.failed());
+    static const char table[] = "[row.sub]\ny = 2\n[[row]]\na = 1\n";
+    reader.open(table, table + sizeof(table) - 1, "row");
+    EXPECT_FALSE(reader.next());
+    EXPECT_TRUE(reader.failed());
+
+    // a handler which stops wakes the thread waiting for room in the queue
+    struct Stop : public cpptoml::TomlRecordHandler
+    {
+        bool on_record(uint32_t, uint64_t, cpptoml::TomlProxy) override
+        {
+            return false;
+        }
+    };
+    Stop stop;
+    EXPECT_FALSE(reader.parse_records(many.data(), many.data() + many.size(), "row", 2, stop));
+    EXPECT_FALSE(reader.failed());
+}
+
+TEST_CASE("TestToml::Lazy")
+{
+    static const char toml[] =
+        "[server]\n"
+        "ports = [ 8000, 8001, # ]\n  8002 ]\n"
+        "limits = { read = 1.5, write = [\"}\", \"]\"] }\n"
+        "broken = [1, \"one\"]\n"
+        "name = \"lazy\"\n";
+    cpptoml::TomlParser parser;
+    parser.set_options(cpptoml::TomlParser::OptionLazy);
+    // the broken array is only found when it is read
+    EXPECT_TRUE(parser.parse(toml, toml + sizeof(toml) - 1));
+    cpptoml::TomlProxy server = parser.root().begin().value();
+    cpptoml::TomlProxy ports = server.begin().value();
+    EXPECT_TRUE(cpptoml::TomlType::Array == ports.type());
+    EXPECT_TRUE(3 == ports.size());
+    EXPECT_TRUE(8002 == ports.begin().next().next().getInt64());
+    cpptoml::TomlProxy limits = server.begin().next().value();
+    EXPECT_TRUE(cpptoml::TomlType::Table == limits.type());
+    EXPECT_TRUE(2 == limits.begin().next().value().size());
+    EXPECT_FALSE(server.begin().next().next().value());
+    EXPECT_TRUE(cpptoml::TomlType::String == server.begin().next().next().next().value().type());
+
+    // a value which fails is parsed once, the parser of a deferred value allocates
+    struct Counted
+    {
+        static std::atomic<uint32_t>& count()
+        {
+            static std::atomic<uint32_t> allocations(0);
+            return allocations;
+        }
+        static void* allocate(size_t size)
+        {
+            ++count();
+            return ::malloc(size);
+        }
+    };
+    cpptoml::TomlParser counted(Counted::allocate, ::free);
+    counted.set_options(cpptoml::TomlParser::OptionLazy);
+    EXPECT_TRUE(counted.parse(toml, toml + sizeof(toml) - 1));
+    cpptoml::TomlProxy broken = counted.root().begin().value().begin().next().next();
+    EXPECT_FALSE(broken.value());
+    uint32_t allocations = Counted::count().load();
+    EXPECT_FALSE(broken.value());
+    EXPECT_TRUE(allocations == Counted::count().load());
+    EXPECT_FALSE(static_cast<bool>(counted.share()));
+    EXPECT_FALSE(broken.value());
+
+    // threads which reach a deferred value at once parse it once
+    static const char many[] = "a = [[1, 2], [3, 4, 5]]\nb = {c = {d = [6]}}\n";
+    EXPECT_TRUE(parser.parse(many, many + sizeof(many) - 1));
+    std::atomic<uint32_t> sizes(0);
+    std::thread readers[4];
+    for(std::thread& reader: readers) {
+        reader = std::thread([&parser, &sizes]() {
+            cpptoml::TomlProxy a = parser.root().begin().value();
+            sizes += static_cast<uint32_t>(a.begin().next().size());
+        });
+    }
+    for(std::thread& reader: readers) {
+        reader.join();
+    }
+    EXPECT_TRUE(12 == sizes.load());
+
+    // a shared document has no deferred values
+    cpptoml::TomlDocument document = parser.share();
+    EXPECT_TRUE(static_cast<bool>(document));
+    EXPECT_TRUE(6 == document.root().begin().next().value().begin().value().begin().value().begin().getInt64());
+    EXPECT_TRUE(parser.parse(toml, toml + sizeof(toml) - 1));
+    EXPECT_FALSE(static_cast<bool>(parser.share()));
+}
+
+TEST_CASE("TestToml::Filter")
+{
+    static const char toml[] =
+        "title = \"filter\"\n"
+        "[server]\n"
+        "host = \"a\"\n"
+        "[metrics]\n"
+        "port = 9100\n"
+        "tags = [\"a\", \"b\"]\n"
+        "[metrics.history]\n"
+        "days = 7\n"
+        "[logs]\n"
+        "level = \"info\"\n";
+    const char* paths[] = {"metrics.port", "logs"};
+    cpptoml::TomlFilter filter = {paths, 2, false};
+    cpptoml::TomlParser parser;
+    EXPECT_TRUE(parser.parse(toml, toml + sizeof(toml) - 1, filter));
+    // the root keeps the ancestors of the paths only
+    cpptoml::TomlProxy root = parser.root();
+    EXPECT_TRUE(2 == root.size());
+    cpptoml::TomlProxy metrics = root.begin().value();
+    EXPECT_TRUE(1 == metrics.size());
+    EXPECT_TRUE(9100 == metrics.begin().value().getInt64());
+    cpptoml::TomlProxy logs = root.begin().next().value();
+    EXPECT_TRUE(1 == logs.size());
+    EXPECT_TRUE(cpptoml::TomlType::String == logs.begin().value().type());
+
+    // content outside the paths is still checked for syntax
+    static const char broken[] = "[metrics]\nport = 9100\n[server]\nhost = [1\n";
+    EXPECT_FALSE(parser.parse(broken, broken + sizeof(broken) - 1, filter));
+
+    // a trusted filter stops at the first header after the paths
+    const char* port[] = {"metrics.port"};
+    EXPECT_TRUE(parser.parse(broken, broken + sizeof(broken) - 1, cpptoml::TomlFilter{port, 1, true}));
+    EXPECT_TRUE(9100 == parser.root().begin().value().begin().value().getInt64());
+    const char* quoted[] = {"\"a.b\".c"};
+    static const char keys[] = "\"a.b\" = {c = 1}\na.b = {c = 2}\n";
+    EXPECT_TRUE(parser.parse(keys, keys + sizeof(keys) - 1, cpptoml::TomlFilter{quoted, 1, false}));
+    EXPECT_TRUE(1 == parser.root().size());
+    EXPECT_TRUE(1 == parser.root().begin().value().begin().value().getInt64());
+}
+
+TEST_CASE("TestToml::ParseBatch")
+{
+    static constexpr uint32_t Files = 16;
+    std::string names[Files];
+    const char* paths[Files];
+    for(uint32_t i = 0; i < Files; ++i) {
+        names[i] = "batch" + std::to_string(i) + ".toml";
+        paths[i] = names[i].c_str();
+        if(1 == i) {
+            continue;
+        }
+        FILE* f = fopen(paths[i], "wb");
+        if(NULL == f) {
+            return;
+        }
+        std::string toml = (2 == i) ? "id = \n" : "id = " + std::to_string(i) + "\n[table]\nkey = \"value\"\n";
+        fwrite(toml.data(), toml.size(), 1, f);
+        fclose(f);
+    }
+    remove(paths[1]);
+
+    for(uint32_t options: {0U, cpptoml::TomlBatch::OptionShareBuffer}) {
+        cpptoml::TomlBatch batch;
+        batch.set_options(options);
+        cpptoml::TomlStatus results[Files];
+        EXPECT_FALSE(batch.parse_batch(paths, Files, results, 4));
+        EXPECT_TRUE(Files == batch.size());
+        EXPECT_TRUE(cpptoml::TomlStatus::FileError == results[1]);
+        EXPECT_TRUE(cpptoml::TomlStatus::ParseError == results[2]);
+        bool parsed = true;
+        for(uint32_t i = 3; i < Files; ++i) {
+            parsed = parsed && cpptoml::TomlStatus::Success == results[i];
+            parsed = parsed && static_cast<int64_t>(i) == batch.document(i).root().begin().value().getInt64();
+        }
+        EXPECT_TRUE(parsed);
+        EXPECT_TRUE(batch.parse_batch(paths + 3, Files - 3, NULL, 2));
+    }
+    for(uint32_t i = 0; i < Files; ++i) {
+        remove(paths[i]);
+    }
+}
+
 TEST_CASE("TestToml::PrintValues")
 {
     std::string path = "../../test00.toml";